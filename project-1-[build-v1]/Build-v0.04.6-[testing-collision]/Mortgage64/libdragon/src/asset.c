@@ -101,20 +101,11 @@ FILE *must_fopen(const char *fn)
     return fdopen(must_open(fn), "rb");
 }
 
-static bool decompress_inplace(asset_compression_t *algo, int fd, size_t cmp_size, size_t size, int margin, void *buf, int *buf_size)
+// Load the compressed data at buf+cmp_offset and decompress it to buf. The memory
+// between buf+cmp_offset and buf+bufsize must not contain any data yet, as it
+// might be invalidated from the cache.
+static void decompress_inplace_at(asset_compression_t *algo, int fd, size_t cmp_size, size_t size, void *buf, int cmp_offset, int bufsize)
 {
-    // Consistency check on input data
-    assert(margin >= 0);
-    int cmp_offset;
-    int bufsize = asset_buf_size(size, cmp_size, margin, &cmp_offset);
-    if(buf == NULL || *buf_size < bufsize) {
-        *buf_size = bufsize;
-        return false;
-    } else {
-        #ifdef N64
-        assertf(((uintptr_t)(buf) & (ASSET_ALIGNMENT_MIN-1)) == 0, "Asset buffer incorrectly aligned.");
-        #endif
-    }
     void *s = buf;
     int n;
 
@@ -146,6 +137,88 @@ static bool decompress_inplace(asset_compression_t *algo, int fd, size_t cmp_siz
         n = algo->decompress_full_inplace(s+cmp_offset, cmp_size, s, size); (void)n;
     }
     assertf(n == size, "asset: decompression error: corrupted? (%d/%d)", n, size);
+}
+
+static bool decompress_inplace(asset_compression_t *algo, int fd, size_t cmp_size, size_t size, int margin, void *buf, int *buf_size)
+{
+    // Consistency check on input data
+    assert(margin >= 0);
+    int cmp_offset;
+    int bufsize = asset_buf_size(size, cmp_size, margin, &cmp_offset);
+    if(buf == NULL || *buf_size < bufsize) {
+        *buf_size = bufsize;
+        return false;
+    } else {
+        #ifdef N64
+        assertf(((uintptr_t)(buf) & (ASSET_ALIGNMENT_MIN-1)) == 0, "Asset buffer incorrectly aligned.");
+        #endif
+    }
+    decompress_inplace_at(algo, fd, cmp_size, size, buf, cmp_offset, bufsize);
+    return true;
+}
+
+// Each block is decompressed in-place into its own slice of the buffer, with its
+// compressed data aligned down to 4 bytes. Reserve 3 more bytes of margin for that.
+static int asset_blocks_buf_size(int size, int margin)
+{
+    return asset_buf_size(size, 0, margin+3, NULL);
+}
+
+static asset_blocks_t *asset_read_blocks(int fd)
+{
+    uint32_t table[2];
+    read(fd, table, sizeof(table));
+    if (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) {  // for mkasset running on PC
+        table[0] = __builtin_bswap32(table[0]);
+        table[1] = __builtin_bswap32(table[1]);
+    }
+
+    asset_blocks_t *blocks = malloc(ASSET_BLOCKS_TABLE_SIZE(table[1]));
+    blocks->block_size = table[0];
+    blocks->block_count = table[1];
+    assertf(blocks->block_size > 0 && (blocks->block_size & 15) == 0, "asset: invalid block size: %lu", (unsigned long)blocks->block_size);
+    read(fd, blocks->offsets, (blocks->block_count+1) * sizeof(uint32_t));
+    if (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) {
+        for (int i=0; i<=blocks->block_count; i++)
+            blocks->offsets[i] = __builtin_bswap32(blocks->offsets[i]);
+    }
+    return blocks;
+}
+
+// Decompress a single block into out, whose size must be at least asset_blocks_buf_size(size, margin).
+// The file must be positioned at the beginning of the block data.
+static void decompress_block(asset_compression_t *algo, int fd, const asset_blocks_t *blocks, int idx, int size, int margin, void *out, int bufsize)
+{
+    int cmp_size = asset_block_cmp_size(blocks, idx);
+    if (algo->decompress_full_inplace) {
+        int cmp_offset = (size + margin + 8 + 3 - cmp_size) & ~3;
+        decompress_inplace_at(algo, fd, cmp_size, size, out, cmp_offset, bufsize);
+    } else {
+        bool ret = algo->decompress_full(fd, cmp_size, size, out, &bufsize); (void)ret;
+        assertf(ret, "asset: block buffer too small (%d/%d)", bufsize, size);
+    }
+}
+
+static bool decompress_blocks(asset_compression_t *algo, int fd, size_t size, int margin, void *buf, int *buf_size)
+{
+    int bufsize = asset_blocks_buf_size(size, margin);
+    if(buf == NULL || *buf_size < bufsize) {
+        *buf_size = bufsize;
+        return false;
+    } else {
+        #ifdef N64
+        assertf(((uintptr_t)(buf) & (ASSET_ALIGNMENT_MIN-1)) == 0, "Asset buffer incorrectly aligned.");
+        #endif
+    }
+
+    asset_blocks_t *blocks = asset_read_blocks(fd);
+    off_t data_start = lseek(fd, 0, SEEK_CUR);
+    for (int i=0; i<blocks->block_count; i++) {
+        int offset = i * blocks->block_size;
+        lseek(fd, data_start + asset_block_offset(blocks, i), SEEK_SET);
+        decompress_block(algo, fd, blocks, i, asset_block_size(blocks, i, size), margin, buf+offset, bufsize-offset);
+    }
+    free(blocks);
     return true;
 }
 
@@ -173,6 +246,8 @@ static int asset_read_header(int fd, asset_header_t *header, int *sz)
             "unsupported compression algorithm: %d", header->algo);
         assertf(algos[header->algo-1].decompress_full || algos[header->algo-1].decompress_full_inplace, 
             "asset: compression level %d not initialized. Call asset_init_compression(%d) at initialization time", header->algo, header->algo);
+        if (header->flags & ASSET_FLAG_BLOCKS)
+            return asset_blocks_buf_size(header->orig_size, header->inplace_margin);
         return asset_buf_size(header->orig_size, header->cmp_size, header->inplace_margin, NULL);
     } else {
         assertf(*sz >= 0, "Invalid uncompressed size");
@@ -185,7 +260,9 @@ static bool asset_read(int fd, asset_header_t *header, int *sz, void *buf, int *
     if(!memcmp(header->magic, ASSET_MAGIC, 3)) {
         bool ret;
 
-        if ((header->flags & ASSET_FLAG_INPLACE) && algos[header->algo-1].decompress_full_inplace)
+        if (header->flags & ASSET_FLAG_BLOCKS)
+            ret = decompress_blocks(&algos[header->algo-1], fd, header->orig_size, header->inplace_margin, buf, buf_size);
+        else if ((header->flags & ASSET_FLAG_INPLACE) && algos[header->algo-1].decompress_full_inplace)
             ret = decompress_inplace(&algos[header->algo-1], fd, header->cmp_size, header->orig_size, header->inplace_margin, buf, buf_size);
         else
             ret = algos[header->algo-1].decompress_full(fd, header->cmp_size, header->orig_size, buf, buf_size);
@@ -351,6 +428,75 @@ static int closefn_cmp(void *c)
     return 0;
 }
 
+typedef struct {
+    int fd;
+    int pos;                        ///< Current position in the decompressed data
+    int size;                       ///< Decompressed size of the file
+    int margin;                     ///< In-place margin of the blocks
+    off_t data_start;               ///< File offset of the first block
+    asset_compression_t *algo;      ///< Decompression algorithm
+    asset_blocks_t *blocks;         ///< Block table
+    int cur_block;                  ///< Block currently held in buf (-1 if none)
+    int buf_size;                   ///< Size of buf
+    uint8_t *buf;                   ///< Decompressed block
+} cookie_blk_t;
+
+static int readfn_blk(void *c, char *buf, int sz)
+{
+    cookie_blk_t *cookie = (cookie_blk_t*)c;
+    int block_size = cookie->blocks->block_size;
+    int total = 0;
+
+    while (sz > 0 && cookie->pos < cookie->size) {
+        int idx = cookie->pos / block_size;
+        int size = asset_block_size(cookie->blocks, idx, cookie->size);
+        if (idx != cookie->cur_block) {
+            lseek(cookie->fd, cookie->data_start + asset_block_offset(cookie->blocks, idx), SEEK_SET);
+            decompress_block(cookie->algo, cookie->fd, cookie->blocks, idx, size, cookie->margin, cookie->buf, cookie->buf_size);
+            cookie->cur_block = idx;
+        }
+
+        int offset = cookie->pos - idx * block_size;
+        int n = size - offset;
+        if (n > sz) n = sz;
+        memcpy(buf, cookie->buf + offset, n);
+        buf += n; sz -= n;
+        cookie->pos += n;
+        total += n;
+    }
+    return total;
+}
+
+static fpos_t seekfn_blk(void *c, fpos_t pos, int whence)
+{
+    cookie_blk_t *cookie = (cookie_blk_t*)c;
+
+    // Seeking just moves the position, the target block is only
+    // decompressed by the next read (if it is not the current one).
+    switch (whence) {
+    case SEEK_SET: break;
+    case SEEK_CUR: pos += cookie->pos; break;
+    case SEEK_END: pos += cookie->size; break;
+    default: errno = EINVAL; return -1;
+    }
+    if (pos < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    cookie->pos = pos;
+    return pos;
+}
+
+static int closefn_blk(void *c)
+{
+    cookie_blk_t *cookie = (cookie_blk_t*)c;
+    close(cookie->fd); cookie->fd = -1;
+    free(cookie->buf);
+    free(cookie->blocks);
+    free(cookie);
+    return 0;
+}
+
 FILE *asset_fopen(const char *fn, int *sz)
 {
     // Open the file. We use buffering on the outer file created by funopen,
@@ -378,12 +524,30 @@ FILE *asset_fdopen(int fd, int *sz)
             header.inplace_margin = __builtin_bswap32(header.inplace_margin);
         }
 
-        cookie_cmp_t *cookie;
-
         assertf(header.algo >= 1 || header.algo <= 2,
             "unsupported compression algorithm: %d", header.algo);
         assertf(algos[header.algo-1].decompress_full || algos[header.algo-1].decompress_full_inplace, 
             "asset: compression level %d not initialized. Call asset_init_compression(%d) at initialization time", header.algo, header.algo);
+
+        if (header.flags & ASSET_FLAG_BLOCKS) {
+            // Block-compressed file: seeking is supported, only the block
+            // containing the new position will be decompressed.
+            cookie_blk_t *cookie = malloc(sizeof(cookie_blk_t));
+            cookie->fd = fd;
+            cookie->pos = 0;
+            cookie->size = header.orig_size;
+            cookie->margin = header.inplace_margin;
+            cookie->algo = &algos[header.algo-1];
+            cookie->blocks = asset_read_blocks(fd);
+            cookie->data_start = lseek(fd, 0, SEEK_CUR);
+            cookie->cur_block = -1;
+            cookie->buf_size = asset_blocks_buf_size(cookie->blocks->block_size, cookie->margin);
+            cookie->buf = memalign(ASSET_ALIGNMENT, cookie->buf_size);
+            if (sz) *sz = header.orig_size;
+            return funopen(cookie, readfn_blk, NULL, seekfn_blk, closefn_blk);
+        }
+
+        cookie_cmp_t *cookie;
         assertf(algos[header.algo-1].decompress_init, 
             "asset: compression level %d does not currently support asset_fopen()", header.algo);
 
@@ -17,6 +17,7 @@
 #define ASSET_FLAG_WINSIZE_128K     0x0006  ///< 128 KiB window size
 #define ASSET_FLAG_WINSIZE_256K     0x0007  ///< 256 KiB window size
 #define ASSET_FLAG_INPLACE          0x0100  ///< Decompress in-place
+#define ASSET_FLAG_BLOCKS           0x0200  ///< Independently compressed blocks, see #asset_blocks_t
 #define ASSET_ALIGNMENT             32      ///< Aligned to instruction cacheline
 
 __attribute__((used))
@@ -78,6 +79,47 @@ typedef struct {
 
 _Static_assert(sizeof(asset_header_t) == 20, "invalid sizeof(asset_header_t)");
 
+/**
+ * @brief Block table of a compressed asset with #ASSET_FLAG_BLOCKS
+ *
+ * The table follows #asset_header_t, and is then followed by the blocks themselves.
+ * Each block is compressed on its own (no matches across blocks), so any block
+ * can be decompressed without touching the previous ones. This is what allows
+ * asset_fopen() to seek in these files.
+ *
+ * Blocks start at even offsets, so that they can be DMA'd from ROM. Bit 0 of an
+ * offset is set if the block is followed by one byte of padding.
+ * The #asset_header_t::cmp_size field covers both the table and the blocks,
+ * while #asset_header_t::inplace_margin is the maximum margin of all blocks.
+ */
+typedef struct {
+    uint32_t block_size;    ///< Decompressed size of each block (the last one can be shorter)
+    uint32_t block_count;   ///< Number of blocks
+    uint32_t offsets[];     ///< Offsets of the blocks (block_count+1 entries), relative to the end of the table
+} asset_blocks_t;
+
+/** @brief Size of the block table of a file with the specified number of blocks */
+#define ASSET_BLOCKS_TABLE_SIZE(block_count)    (8 + 4*((block_count)+1))
+
+/** @brief Offset of a block within the block data */
+__attribute__((used))
+static inline uint32_t asset_block_offset(const asset_blocks_t *blocks, int idx) {
+    return blocks->offsets[idx] & ~1;
+}
+
+/** @brief Compressed size of a block, excluding padding */
+__attribute__((used))
+static inline int asset_block_cmp_size(const asset_blocks_t *blocks, int idx) {
+    return asset_block_offset(blocks, idx+1) - asset_block_offset(blocks, idx) - (blocks->offsets[idx] & 1);
+}
+
+/** @brief Decompressed size of a block */
+__attribute__((used))
+static inline int asset_block_size(const asset_blocks_t *blocks, int idx, int orig_size) {
+    int size = orig_size - idx*blocks->block_size;
+    return size < (int)blocks->block_size ? size : (int)blocks->block_size;
+}
+
 /** @brief A decompression algorithm used by the asset library */
 typedef struct {
     int state_size;     ///< Basic size of the decompression state (without ringbuffer)
@@ -49,6 +49,10 @@ static uint32_t base_ptr = 0;
 static dfs_lookup_t *lookup;
 /** @brief Base ROM address for path data */
 static uint32_t lookup_path_ofs;
+/** @brief True if opened files are being traced (see #dfs_trace_start) */
+static bool trace_enabled = false;
+/** @brief File the trace is written to, or NULL for the debug channel */
+static FILE *trace_file = NULL;
 /** @brief Directory pointer stack */
 static uint32_t directories[MAX_DIRECTORY_DEPTH];
 /** @brief Depth into directory pointer stack */
@@ -772,6 +776,56 @@ static dfs_lookup_file_t *lookup_file(const char *const path)
     return NULL;
 }
 
+/**
+ * @brief Log an opened file to the trace, if enabled
+ *
+ * @param[in] path
+ *            Path of the file, without the initial slash
+ */
+static void trace_open(const char *path)
+{
+    if(!trace_enabled)
+        return;
+
+    if(trace_file)
+    {
+        /* Flush every line, so that the trace survives a crash */
+        fprintf(trace_file, "%s\n", path);
+        fflush(trace_file);
+    }
+    else
+    {
+        debugf(DFS_TRACE_TAG "%s\n", path);
+    }
+}
+
+int dfs_trace_start(const char *filename)
+{
+    dfs_trace_stop();
+
+    if(filename)
+    {
+        trace_file = fopen(filename, "w");
+        if(!trace_file)
+        {
+            return DFS_EBADINPUT;
+        }
+    }
+
+    trace_enabled = true;
+    return DFS_ESUCCESS;
+}
+
+void dfs_trace_stop(void)
+{
+    if(trace_file)
+    {
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+    trace_enabled = false;
+}
+
 int dfs_open(const char *path)
 {
     dfs_open_file_t *file;
@@ -824,6 +878,7 @@ int dfs_open(const char *path)
         file->loc = 0;
         file->cart_start_loc = get_start_location(&t_node);
     }
+    trace_open(path);
     return OPENFILE_TO_HANDLE(file);
 }
 
@@ -1028,6 +1083,7 @@ uint32_t dfs_rom_addr(const char *path)
             //File not found
             return 0;
         }
+        trace_open(path);
         return base_ptr+entry->data_ofs;
     } else {
         /* Try to find file */
@@ -1045,6 +1101,7 @@ uint32_t dfs_rom_addr(const char *path)
         grab_sector(dirent, &t_node);
 
         /* Return the starting location in ROM */
+        trace_open(path);
         return get_start_location(&t_node);
     }
 }
@@ -43,6 +43,11 @@
  * If you know that the file will never be compressed and you absolutely need
  * to freely seek, simply use the standard fopen() function.
  * 
+ * Alternatively, mkasset can compress a file in independent blocks (`--blocks`).
+ * Files in this format can be freely seeked after #asset_fopen: a seek just
+ * moves the position, and the next read decompresses only the block that
+ * contains it.
+ * 
  * ## Asset compression
  * 
  * To compress your own data files, you can use the mkasset tool.
@@ -63,6 +68,11 @@
  * To minimize text siz and RAM usage, only the decompression code for level 1
  * is compiled by default. If you need to use level 2, you must call
  * #asset_init_compression(2).
+ * 
+ * Tools can also choose the level per file (`--compress auto`), picking the
+ * smallest one that still loads fast enough. Files compressed this way can
+ * end up at level 2 (or 3 when no streaming window is used, e.g. XM64 data),
+ * so the matching #asset_init_compression call is needed as well.
  */
 
 #include <stdio.h>
@@ -223,6 +233,11 @@ bool asset_loadf_into(FILE *f, int *sz, void *buf, int *buf_size);
  * required. If you need random access to an uncompressed file, simply use
  * the standard fopen() function.
  * 
+ * The exception are files compressed in blocks (`mkasset --blocks`), which
+ * support fseek with SEEK_SET, SEEK_CUR and SEEK_END. Seeking is O(1): only the
+ * block containing the new position is decompressed, by the next read. Opening
+ * such a file allocates a buffer of one block instead of the window.
+ * 
  * @param fn        Filename to load (including filesystem prefix, eg: "rom:/foo.dat")
  * @param sz        If not NULL, this will be filed with the uncompressed size of the loaded file
  * @return FILE*    FILE pointer to use with standard C functions (fread, fclose)
@@ -77,6 +77,35 @@ typedef struct dfs_lookup_s {
     dfs_lookup_file_t files[];
 } dfs_lookup_t;
 
+/**
+ * @brief Prefix of the lines written by the open trace to the debug log
+ *
+ * mkdfs --order uses it to pick the trace out of a full debug log.
+ */
+#define DFS_TRACE_TAG   "dfs-trace: "
+
+/**
+ * @brief Start tracing the files opened in the filesystem
+ *
+ * Each successful #dfs_open or #dfs_rom_addr logs the path of the file, one
+ * per line, in the order they happen. The trace can be passed to
+ * `mkdfs --order=<trace>` to store files that are loaded together
+ * contiguously in the next build of the filesystem image.
+ *
+ * @param[in] filename
+ *            File to write the trace to (eg: on SD card, or a file exposed by
+ *            an emulator), or NULL to log each path to the debug channel
+ *            (see #debugf), prefixed by #DFS_TRACE_TAG.
+ *
+ * @return DFS_ESUCCESS on success, or DFS_EBADINPUT if the file could not be created.
+ */
+int dfs_trace_start(const char *filename);
+
+/**
+ * @brief Stop tracing started by #dfs_trace_start, and close the trace file.
+ */
+void dfs_trace_stop(void);
+
 /** @} */ /* dfs */
 
 #endif
\ No newline at end of file
@@ -74,7 +74,8 @@ void usage(void) {
 	printf("   --xm-8bit                 	Convert all samples to 8-bit\n");
 	printf("   --xm-ext-samples <dir>    	Export samples externally as wav64 files in the specified directory\n");
 	printf("   --xm-compress <0|1>          Compression level for XM samples (default: 1=vadpcm)\n");
-	printf("   --xm-compress-data <0..3>    Compression level for XM binary data (default: 1)\n");
+	printf("   --xm-compress-data <level>   Compression level for XM binary data, 0-3 or \"auto\" (default: 1)\n");
+	printf("                                \"auto\" may pick level 2 or 3, which require asset_init_compression() at runtime\n");
 	printf("\n");
 	printf("YM options:\n");
 	printf("   --ym-compress <true|false>  	Compress output file\n");
@@ -334,8 +335,11 @@ int main(int argc, char *argv[]) {
 					fprintf(stderr, "missing argument for --xm-compress\n");
 					return 1;
 				}
-				flag_xm_compress_meta = atoi(argv[i]);
-				if (flag_xm_compress_meta < 0 || flag_xm_compress_meta > MAX_COMPRESSION) {
+				if (!strcmp(argv[i], "auto"))
+					flag_xm_compress_meta = COMPRESSION_AUTO;
+				else
+					flag_xm_compress_meta = atoi(argv[i]);
+				if (flag_xm_compress_meta != COMPRESSION_AUTO && (flag_xm_compress_meta < 0 || flag_xm_compress_meta > MAX_COMPRESSION)) {
 					fprintf(stderr, "invalid argument for --xm-compress: %s\n", argv[i]);
 					return 1;
 				}
@@ -151,6 +151,9 @@ int asset_compress_mem(void *data, int sz, FILE *out, int compression, int winsi
             winsize /= 2;
     }
 
+    if (compression == COMPRESSION_AUTO)
+        return asset_compress_mem_auto(data, sz, out, winsize, margin, NULL);
+
     // FIXME: use asset_compress_mem_raw() instead of duplicating the code here
     switch (compression) {
     case 0: { // none
@@ -251,3 +254,402 @@ int asset_compress_mem(void *data, int sz, FILE *out, int compression, int winsi
         return -1;
     }
 }
+
+/**
+ * @brief Compress a buffer in the seekable block format of the libdragon asset library.
+ * 
+ * The data is split into blocks of @p block_size bytes, which are compressed
+ * independently and indexed by a table in the header (see #asset_blocks_t).
+ * This costs some compression ratio, but allows asset_fopen() to seek
+ * anywhere in the file by decompressing just the block at the new position.
+ * 
+ * @param data          Data to compress
+ * @param sz            Size of the data
+ * @param out           Output file
+ * @param compression   Compression level (only 1 = lz4hc and 2 = aplib are supported)
+ * @param winsize       Window size, or zero to let the compressor choose it per block
+ * @param block_size    Decompressed size of each block (multiple of 16)
+ * @param margin        If not NULL, receives the in-place margin of the biggest block
+ * @return int          Size of the output in bytes, or -1 on error
+ */
+int asset_compress_mem_blocks(void *data, int sz, FILE *out, int compression, int winsize, int block_size, int *margin)
+{
+    if (compression != 1 && compression != 2) {
+        fprintf(stderr, "block compression is only supported with compression levels 1 and 2\n");
+        return -1;
+    }
+    if (block_size <= 0 || (block_size & 15)) {
+        fprintf(stderr, "invalid block size: %d (must be a multiple of 16)\n", block_size);
+        return -1;
+    }
+    if (winsize && asset_winsize_to_flags(winsize) < 0) {
+        fprintf(stderr, "unsupported window size: %d\n", winsize);
+        fprintf(stderr, "supported window sizes: 2, 4, 8, 16, 32, 64, 128, 256\n");
+        return -1;
+    }
+
+    int block_count = (sz + block_size - 1) / block_size;
+    uint32_t *offsets = malloc((block_count+1) * sizeof(uint32_t));
+    uint8_t *blocks = NULL; int blocks_size = 0;
+    int max_winsize = 2*1024, max_margin = 0;
+
+    for (int i=0; i<block_count; i++) {
+        int offset = i * block_size;
+        int size = sz - offset < block_size ? sz - offset : block_size;
+
+        // Each block gets a fresh compressor state, so that no match can
+        // reference data of a previous block.
+        uint8_t *output; int cmp_size, block_winsize = winsize, block_margin;
+        asset_compress_mem_raw(compression, (uint8_t*)data + offset, size, &output, &cmp_size, &block_winsize, &block_margin);
+        if (block_winsize > max_winsize) max_winsize = block_winsize;
+        if (block_margin > max_margin) max_margin = block_margin;
+
+        // Blocks start at even offsets so that they can be DMA'd from ROM.
+        // Bit 0 of the offset tells the reader that the block is padded.
+        int pad = cmp_size & 1;
+        offsets[i] = blocks_size | pad;
+        blocks = realloc(blocks, blocks_size + cmp_size + pad);
+        memcpy(blocks + blocks_size, output, cmp_size);
+        if (pad) blocks[blocks_size + cmp_size] = 0;
+        blocks_size += cmp_size + pad;
+        free(output);
+    }
+    offsets[block_count] = blocks_size;
+
+    int cmp_size = ASSET_BLOCKS_TABLE_SIZE(block_count) + blocks_size;
+    fwrite("DCA3", 1, 4, out);
+    w16(out, compression); // algo
+    w16(out, asset_winsize_to_flags(max_winsize) | ASSET_FLAG_INPLACE | ASSET_FLAG_BLOCKS); // flags
+    w32(out, cmp_size); // cmp_size
+    w32(out, sz); // dec_size
+    w32(out, max_margin); // inplace margin
+    w32(out, block_size); // block table
+    w32(out, block_count);
+    for (int i=0; i<=block_count; i++)
+        w32(out, offsets[i]);
+    fwrite(blocks, 1, blocks_size, out);
+
+    free(blocks);
+    free(offsets);
+    if (margin) *margin = max_margin;
+    return cmp_size + 20;
+}
+
+// Load time estimation.
+// The N64 decode time of a compressed stream is estimated by walking it, counting
+// the operations that the assembly decoders in src/compress/*_fast.S perform,
+// and weighting them with a simple VR4300 cycle model. The model is intentionally
+// rough (no pipeline or TLB effects), but good enough to rank levels per asset.
+
+#define EST_CPU_HZ              93750000    // VR4300 clock
+#define EST_DCACHE_SIZE         (8*1024)    // VR4300 data cache
+#define EST_DCACHE_LINE         16          // VR4300 data cache line
+#define EST_LINE_FILL           36          // Cycles to fill a cache line from RDRAM
+#define EST_LINE_WRITEBACK      24          // Cycles to write back a dirty cache line
+
+/** @brief Operations performed by a decoder, collected by walking a compressed stream */
+typedef struct {
+    int64_t ops;            ///< Commands decoded (LZ4 tokens, aPLib prefixes, Shrinkler literal/match choices)
+    int64_t literals;       ///< Literal bytes
+    int64_t matches;        ///< Number of matches
+    int64_t match_bytes;    ///< Bytes copied by matches
+    int64_t far_bytes;      ///< Bytes copied by matches further away than the data cache
+    int64_t bits;           ///< Entropy-coded bits read one by one
+    int64_t out_size;       ///< Decompressed size (to validate the walker)
+} est_ops_t;
+
+/** @brief Cycle costs of a decoder, derived from the inner loops of the assembly version */
+typedef struct {
+    float op;               ///< Decoding one command (branches, length/offset decoding)
+    float literal;          ///< Copying one literal byte
+    float match;            ///< Setting up one match
+    float match_byte;       ///< Copying one byte of a match
+    float bit;              ///< Reading one entropy-coded bit
+} est_model_t;
+
+static const est_model_t est_models[MAX_COMPRESSION] = {
+    // LZ4: literals and matches are copied with unaligned 64-bit loads/stores
+    { .op = 20, .literal = 0.4f, .match = 12, .match_byte = 0.6f, .bit = 0 },
+    // aPLib: bit-oriented prefixes and gamma codes, literals go through the byte reader
+    { .op = 10, .literal = 4,    .match = 16, .match_byte = 1.0f, .bit = 4 },
+    // Shrinkler: every bit goes through the range decoder (multiply, renormalize, update context)
+    { .op = 6,  .literal = 2,    .match = 10, .match_byte = 1.0f, .bit = 22 },
+};
+
+static void est_match(est_ops_t *ops, int offset, int len)
+{
+    ops->matches++;
+    ops->match_bytes += len;
+    if (offset >= EST_DCACHE_SIZE) ops->far_bytes += len;
+    ops->out_size += len;
+}
+
+static void est_walk_lz4(const uint8_t *in, int cmp_size, est_ops_t *ops)
+{
+    const uint8_t *end = in + cmp_size;
+    while (in < end) {
+        int token = *in++;
+        ops->ops++;
+
+        int nlit = token >> 4;
+        if (nlit == 15) {
+            int b;
+            do { b = *in++; nlit += b; } while (b == 255);
+        }
+        in += nlit;
+        ops->literals += nlit;
+        ops->out_size += nlit;
+        if (in + 2 > end) break;
+
+        int offset = in[0] | (in[1] << 8);
+        in += 2;
+        int len = token & 15;
+        if (len == 15) {
+            int b;
+            do { b = *in++; len += b; } while (b == 255);
+        }
+        est_match(ops, offset, len + 4);
+    }
+}
+
+typedef struct {
+    const uint8_t *in, *end;
+    uint8_t cc;
+    int shift;
+    est_ops_t *ops;
+} est_aplib_reader_t;
+
+static int est_aplib_bit(est_aplib_reader_t *r)
+{
+    r->ops->bits++;
+    if (r->shift < 0) {
+        r->shift = 7;
+        r->cc = r->in < r->end ? *r->in++ : 0;
+    }
+    return (r->cc >> r->shift--) & 1;
+}
+
+static int est_aplib_gamma(est_aplib_reader_t *r)
+{
+    int v = 1;
+    do v = (v << 1) | est_aplib_bit(r);
+    while (est_aplib_bit(r));
+    return v;
+}
+
+// Same parsing as decompress_full() in aplib_dec.c, without producing any output
+static void est_walk_aplib(const uint8_t *in, int cmp_size, est_ops_t *ops)
+{
+    est_aplib_reader_t r = { .in = in, .end = in + cmp_size, .shift = -1, .ops = ops };
+    int nlit = 3;
+
+    r.in++;
+    ops->literals++;
+    ops->out_size++;
+    while (r.in <= r.end) {
+        ops->ops++;
+        if (!est_aplib_bit(&r)) {
+            r.in++;
+            ops->literals++;
+            ops->out_size++;
+            nlit = 3;
+            continue;
+        }
+
+        if (!est_aplib_bit(&r)) {
+            int off_hi = est_aplib_gamma(&r) - nlit;
+            int match_off = 0, match_len;
+            if (off_hi >= 0) {
+                match_off = (off_hi << 8) | *r.in++;
+                match_len = est_aplib_gamma(&r);
+                if (match_off < 128 || match_off >= MINMATCH4_OFFSET)
+                    match_len += 2;
+                else if (match_off >= MINMATCH3_OFFSET)
+                    match_len += 1;
+            } else {
+                match_len = est_aplib_gamma(&r);
+            }
+            est_match(ops, match_off, match_len);
+            nlit = 2;
+        } else if (!est_aplib_bit(&r)) {
+            uint8_t cmd = *r.in++;
+            if (cmd == 0) break;
+            est_match(ops, cmd >> 1, (cmd & 1) + 2);
+            nlit = 2;
+        } else {
+            for (int i=0; i<4; i++) est_aplib_bit(&r);
+            est_match(ops, 1, 1);
+            nlit = 3;
+        }
+    }
+}
+
+static int est_shr_bit(shrinkler_ctx_t *ctx, int context, est_ops_t *ops)
+{
+    ops->bits++;
+    return shr_decode_bit(ctx, NUM_SINGLE_CONTEXTS + context);
+}
+
+static int est_shr_number(shrinkler_ctx_t *ctx, int context_group, est_ops_t *ops)
+{
+    int base = context_group << 8;
+    int i;
+    for (i = 0 ;; i++) {
+        if (est_shr_bit(ctx, base + (i * 2 + 2), ops) == 0) break;
+    }
+    int number = 1;
+    for (; i >= 0 ; i--)
+        number = (number << 1) | est_shr_bit(ctx, base + (i * 2 + 1), ops);
+    return number;
+}
+
+// Same parsing as shr_unpack() in shrinkler_dec.c, without producing any output
+static void est_walk_shrinkler(const uint8_t *in, int cmp_size, est_ops_t *ops)
+{
+    // The range decoder reads 32 bits at a time, so it can overrun the input a bit
+    uint8_t *src = calloc(1, cmp_size + 8);
+    memcpy(src, in, cmp_size);
+    shrinkler_ctx_t *ctx = malloc(sizeof(shrinkler_ctx_t));
+    shr_decode_init(ctx, src);
+
+    bool ref = false, prev_was_ref = false;
+    int offset = 0;
+    while (1) {
+        ops->ops++;
+        if (ref) {
+            bool repeated = false;
+            if (!prev_was_ref)
+                repeated = est_shr_bit(ctx, CONTEXT_REPEATED, ops);
+            if (!repeated) {
+                offset = est_shr_number(ctx, CONTEXT_GROUP_OFFSET, ops) - 2;
+                if (offset == 0) break;
+            }
+            est_match(ops, offset, est_shr_number(ctx, CONTEXT_GROUP_LENGTH, ops));
+            prev_was_ref = true;
+        } else {
+            int parity = ops->out_size & 1;
+            int context = 1;
+            for (int i = 7 ; i >= 0 ; i--)
+                context = (context << 1) | est_shr_bit(ctx, (parity << 8) | context, ops);
+            ops->literals++;
+            ops->out_size++;
+            prev_was_ref = false;
+        }
+        int parity = ops->out_size & 1;
+        ref = est_shr_bit(ctx, CONTEXT_KIND + (parity << 8), ops);
+    }
+    free(ctx);
+    free(src);
+}
+
+/**
+ * @brief Estimate the time needed to load an asset on N64.
+ * 
+ * @param compression   Compression level of the stream (0 = none)
+ * @param cmp           Compressed stream, as returned by asset_compress_mem_raw() (without header)
+ * @param cmp_size      Size of the compressed stream
+ * @param dec_size      Decompressed size
+ * @param pi_bandwidth  ROM DMA speed to assume, in bytes/sec
+ * @param est           Filled with the estimate
+ * @return true         The estimate is based on a complete walk of the stream
+ * @return false        The stream did not decode to dec_size, so the estimate is off
+ */
+bool asset_estimate_load(int compression, const uint8_t *cmp, int cmp_size, int dec_size, int pi_bandwidth, asset_load_estimate_t *est)
+{
+    est->size = compression ? cmp_size + (int)sizeof(asset_header_t) : dec_size;
+    est->dma_ms = est->size * 1000.0 / pi_bandwidth;
+    est->decode_ms = 0;
+    est->load_ms = est->dma_ms;
+    if (compression == 0)
+        return true;
+
+    est_ops_t ops = {0};
+    switch (compression) {
+    case 1: est_walk_lz4(cmp, cmp_size, &ops); break;
+    case 2: est_walk_aplib(cmp, cmp_size, &ops); break;
+    case 3: est_walk_shrinkler(cmp, cmp_size, &ops); break;
+    default: assert(0);
+    }
+
+    const est_model_t *m = &est_models[compression-1];
+    double cycles = ops.ops * m->op + ops.literals * m->literal +
+                    ops.matches * m->match + ops.match_bytes * m->match_byte +
+                    ops.bits * m->bit;
+
+    // Memory: the output is written through the cache (fill + writeback of each line),
+    // the input is read once, and far matches miss the cache on their source.
+    cycles += (double)ops.out_size / EST_DCACHE_LINE * (EST_LINE_FILL + EST_LINE_WRITEBACK);
+    cycles += (double)(cmp_size + ops.far_bytes) / EST_DCACHE_LINE * EST_LINE_FILL;
+
+    // The in-place decoders race with the DMA, so the slowest of the two wins
+    est->decode_ms = cycles * 1000.0 / EST_CPU_HZ;
+    est->load_ms = est->decode_ms > est->dma_ms ? est->decode_ms : est->dma_ms;
+    return ops.out_size == dec_size;
+}
+
+static int auto_pi_bandwidth = DEFAULT_PI_BANDWIDTH;
+static int auto_min_load_speed = 0;
+
+/**
+ * @brief Configure the load-time budget used by #COMPRESSION_AUTO.
+ * 
+ * @param pi_bandwidth      ROM DMA speed to assume, in bytes/sec
+ * @param min_load_speed    Minimum load speed in bytes/sec of decompressed data,
+ *                          or 0 to use pi_bandwidth (never load slower than an
+ *                          uncompressed file)
+ */
+void asset_compress_set_auto_budget(int pi_bandwidth, int min_load_speed)
+{
+    auto_pi_bandwidth = pi_bandwidth;
+    auto_min_load_speed = min_load_speed;
+}
+
+/**
+ * @brief Compress a buffer choosing the compression level automatically.
+ * 
+ * All levels are tried in parallel, and the smallest output whose estimated
+ * N64 load time fits the budget set by #asset_compress_set_auto_budget is
+ * written. If no level fits, the fastest one to load is used.
+ * 
+ * @param data          Data to compress
+ * @param sz            Size of the data
+ * @param out           Output file
+ * @param winsize       Window size, or zero to let the compressor choose it
+ * @param margin        If not NULL, receives the in-place margin
+ * @param level         If not NULL, receives the chosen level
+ * @return int          Size of the output in bytes
+ */
+int asset_compress_mem_auto(void *data, int sz, FILE *out, int winsize, int *margin, int *level)
+{
+    uint8_t *output = NULL;
+    int cmp_size = 0, inplace_margin = 0;
+
+    // Same as asset_compress_mem(), so that the result matches a fixed level
+    // compressed with the same window.
+    if (winsize) {
+        while (sz < winsize && winsize > 2*1024)
+            winsize /= 2;
+    }
+
+    int min_load_speed = auto_min_load_speed ? auto_min_load_speed : auto_pi_bandwidth;
+    int compression = asset_compress_choose_level(data, sz, winsize, auto_pi_bandwidth, min_load_speed,
+        &output, &cmp_size, &winsize, &inplace_margin);
+    if (level) *level = compression;
+
+    if (compression == 0) {
+        fwrite(data, 1, sz, out);
+        if (margin) *margin = 0;
+        return sz;
+    }
+
+    fwrite("DCA3", 1, 4, out);
+    w16(out, compression); // algo
+    w16(out, asset_winsize_to_flags(winsize) | ASSET_FLAG_INPLACE); // flags
+    w32(out, cmp_size); // cmp_size
+    w32(out, sz); // dec_size
+    w32(out, inplace_margin); // inplace margin
+    fwrite(output, 1, cmp_size, out);
+    free(output);
+    if (margin) *margin = inplace_margin;
+    return cmp_size + 20;
+}
@@ -6,15 +6,39 @@
 #define DEFAULT_COMPRESSION     1
 #define MAX_COMPRESSION         3
 
+// Pseudo compression level: pick the best level for each file, given a load
+// time budget (see asset_compress_set_auto_budget())
+#define COMPRESSION_AUTO        99
+
 // Default window size for streaming decompression (asset_fopen())
 #define DEFAULT_WINSIZE_STREAMING    (4*1024)
 
+// Default ROM DMA speed assumed when estimating load times (bytes/sec)
+#define DEFAULT_PI_BANDWIDTH         (5*1000*1000)
+
+// Default block size for seekable block-compressed files (asset_fopen() + fseek())
+#define DEFAULT_BLOCK_SIZE           (16*1024)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Estimated cost of loading an asset on N64 (see asset_estimate_load())
+typedef struct {
+    int size;               // Size of the asset file
+    double decode_ms;       // CPU time spent decompressing
+    double dma_ms;          // Time spent transferring the file from ROM
+    double load_ms;         // Total load time (decompression races with the DMA)
+} asset_load_estimate_t;
+
 bool asset_compress(const char *infn, const char *outfn, int compression, int winsize);
 int asset_compress_mem(void *data, int sz, FILE *out, int compression, int winsize, int *margin);
+int asset_compress_mem_blocks(void *data, int sz, FILE *out, int compression, int winsize, int block_size, int *margin);
+int asset_compress_mem_auto(void *data, int sz, FILE *out, int winsize, int *margin, int *level);
+void asset_compress_set_auto_budget(int pi_bandwidth, int min_load_speed);
+bool asset_estimate_load(int compression, const uint8_t *cmp, int cmp_size, int dec_size, int pi_bandwidth, asset_load_estimate_t *est);
+int asset_compress_choose_level(const void *data, int sz, int winsize, int pi_bandwidth, int min_load_speed,
+    uint8_t **output, int *cmp_size, int *out_winsize, int *margin);
 void asset_compress_mem_raw(int compression, const uint8_t *inbuf, int size, uint8_t **outbuf, int *cmp_size, int *winsize, int *margin);
 
 #ifdef __cplusplus
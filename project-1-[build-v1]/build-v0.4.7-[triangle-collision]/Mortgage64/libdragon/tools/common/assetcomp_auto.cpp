@@ -0,0 +1,79 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+#include "assetcomp.h"
+#include "thread_utils.h"
+
+/**
+ * @brief Compress a buffer with all levels in parallel, and choose the best one.
+ *
+ * The chosen level is the one producing the smallest file, among those whose
+ * estimated N64 load time does not exceed loading the decompressed data at
+ * min_load_speed. If no level fits, the fastest one to load is chosen.
+ * Level 0 (no compression) is also a candidate. Level 3 (Shrinkler) is only a
+ * candidate when winsize is zero, since it does not support streaming via
+ * asset_fopen().
+ *
+ * @param data              Data to compress
+ * @param sz                Size of the data
+ * @param winsize           Window size, or zero to let each compressor choose it
+ * @param pi_bandwidth      ROM DMA speed to assume, in bytes/sec
+ * @param min_load_speed    Minimum load speed, in bytes/sec of decompressed data
+ * @param output            Receives the compressed stream (NULL for level 0), to be freed by the caller
+ * @param cmp_size          Receives the size of the compressed stream
+ * @param out_winsize       Receives the window size used by the chosen level
+ * @param margin            Receives the in-place margin of the chosen level
+ * @return int              The chosen level
+ */
+extern "C"
+int asset_compress_choose_level(const void *data, int sz, int winsize, int pi_bandwidth, int min_load_speed,
+    uint8_t **output, int *cmp_size, int *out_winsize, int *margin)
+{
+    struct candidate_t {
+        uint8_t *output = NULL;
+        int cmp_size = 0;
+        int winsize = 0;
+        int margin = 0;
+        asset_load_estimate_t est = {};
+    };
+    std::vector<candidate_t> cands(MAX_COMPRESSION+1);
+
+    asset_estimate_load(0, NULL, 0, sz, pi_bandwidth, &cands[0].est);
+    if (sz > 0) {
+        // Each level is compressed by a different thread. The compressors are
+        // independent, and there is only one LZ4 encode in flight (which uses a global).
+        thParaLoop(MAX_COMPRESSION, [&](int i) {
+            int level = i+1;
+            if (level == 3 && winsize) return; // shrinkler cannot be streamed
+            candidate_t &c = cands[level];
+            c.winsize = winsize;
+            asset_compress_mem_raw(level, (const uint8_t*)data, sz, &c.output, &c.cmp_size, &c.winsize, &c.margin);
+            if (c.margin < 0) c.margin = 0;
+            if (!asset_estimate_load(level, c.output, c.cmp_size, sz, pi_bandwidth, &c.est)) {
+                // Should never happen: the model could not walk the stream, so don't trust it
+                c.est.load_ms = 1e30;
+            }
+        });
+    }
+
+    double budget_ms = min_load_speed > 0 ? sz * 1000.0 / min_load_speed : 1e30;
+    int best = -1, fastest = 0;
+    for (int level=0; level<(int)cands.size(); level++) {
+        if (level && !cands[level].output) continue;
+        const asset_load_estimate_t &est = cands[level].est;
+        if (est.load_ms < cands[fastest].est.load_ms)
+            fastest = level;
+        if (est.load_ms <= budget_ms && (best < 0 || est.size < cands[best].est.size))
+            best = level;
+    }
+    if (best < 0) best = fastest;
+
+    for (int level=1; level<(int)cands.size(); level++) {
+        if (level != best) free(cands[level].output);
+    }
+    *output = cands[best].output;
+    *cmp_size = cands[best].cmp_size;
+    *out_winsize = cands[best].winsize;
+    *margin = cands[best].margin;
+    return best;
+}
@@ -13,6 +13,8 @@
 
 bool flag_verbose = false;
 
+#include "mkasset_bench.c"
+
 void print_args(char * name)
 {
     fprintf(stderr, "%s -- Libdragon asset compression tool\n\n", name);
@@ -24,11 +26,29 @@ void print_args(char * name)
     fprintf(stderr, "Command-line flags:\n");
     fprintf(stderr, "   -v/--verbose            Verbose output\n");
     fprintf(stderr, "   -o/--output <dir>       Specify output directory (default: .)\n");
-    fprintf(stderr, "   -c/--compress <algo>    Compression level 0-%d (default: %d)\n", MAX_COMPRESSION, DEFAULT_COMPRESSION);
+    fprintf(stderr, "   -c/--compress <algo>    Compression level 0-%d, or \"auto\" (default: %d)\n", MAX_COMPRESSION, DEFAULT_COMPRESSION);
     fprintf(stderr, "   -w/--winsize <window>   Maximum size of the matching window in KiB. (default: %d)\n", DEFAULT_WINSIZE_STREAMING/1024);
+    fprintf(stderr, "   -b/--blocks [size]      Compress in independent blocks of <size> KiB, to allow seeking (default: %d)\n", DEFAULT_BLOCK_SIZE/1024);
+    fprintf(stderr, "   --bench                 Benchmark all compression levels on the input files, without writing them\n");
+    fprintf(stderr, "   --pi-speed <MB/s>       ROM DMA speed assumed by auto and --bench (default: %.1f)\n", DEFAULT_PI_BANDWIDTH / 1e6);
+    fprintf(stderr, "   --min-speed <MB/s>      Minimum load speed for auto, in MB/s of decompressed data (default: same as --pi-speed)\n");
     fprintf(stderr, "\nSupported window sizes: 2, 4, 8, 16, 32, 64, 128, 256\n");
     fprintf(stderr, "The window size affects the memory used by asset_fopen() only.\n");
     fprintf(stderr, "If you only use asset_load(), use the biggest window (256 KiB) to improve ratio.\n");
+    fprintf(stderr, "\nFiles compressed in blocks can be seeked with fseek() after asset_fopen(),\n");
+    fprintf(stderr, "which decompresses only the block containing the new position. Each block is\n");
+    fprintf(stderr, "compressed on its own, so smaller blocks mean faster seeks but a worse ratio.\n");
+    fprintf(stderr, "asset_fopen() needs one block worth of memory instead of the window.\n");
+    fprintf(stderr, "Only compression levels 1 and 2 are supported.\n");
+    fprintf(stderr, "\nWith \"--compress auto\", each file is compressed with all levels and the smallest\n");
+    fprintf(stderr, "result that loads at --min-speed or faster on N64 (estimated) is kept. By default\n");
+    fprintf(stderr, "this means that compression never makes loading slower than a raw file.\n");
+    fprintf(stderr, "Decrease --min-speed to trade load time for ROM space. Level 3 is never chosen, as\n");
+    fprintf(stderr, "it does not support asset_fopen(), but level 2 can be: make sure to call\n");
+    fprintf(stderr, "asset_init_compression(2) at runtime.\n");
+    fprintf(stderr, "\nThe benchmark prints ratio and host decode speed of each level, plus an estimate\n");
+    fprintf(stderr, "of the decode and load time on N64 based on a model of the CPU, and recommends\n");
+    fprintf(stderr, "the level that \"--compress auto\" would pick with the same -w and --min-speed.\n");
     fprintf(stderr, "\n");
 }
 
@@ -37,6 +57,11 @@ int main(int argc, char *argv[])
     char *infn = NULL, *outdir = ".", *outfn = NULL;
     int compression = DEFAULT_COMPRESSION;
     int winsize = DEFAULT_WINSIZE_STREAMING;
+    bool winsize_set = false;
+    int block_size = 0;
+    bool flag_bench = false;
+    int pi_bandwidth = DEFAULT_PI_BANDWIDTH, min_load_speed = 0;
+    char **bench_files = NULL; int bench_nfiles = 0;
 
     // Initialize all compression levels
     asset_init_compression(2);
@@ -54,6 +79,23 @@ int main(int argc, char *argv[])
                 return 0;
             } else if (!strcmp(argv[i], "-v") || !strcmp(argv[i], "--verbose")) {
                 flag_verbose = true;
+            } else if (!strcmp(argv[i], "--bench")) {
+                flag_bench = true;
+            } else if (!strcmp(argv[i], "--pi-speed") || !strcmp(argv[i], "--min-speed")) {
+                if (++i == argc) {
+                    fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                    return 1;
+                }
+                float speed; char extra;
+                if (sscanf(argv[i], "%f%c", &speed, &extra) != 1 || speed <= 0) {
+                    fprintf(stderr, "invalid argument for %s: %s\n", argv[i-1], argv[i]);
+                    return 1;
+                }
+                if (!strcmp(argv[i-1], "--pi-speed"))
+                    pi_bandwidth = speed * 1e6;
+                else
+                    min_load_speed = speed * 1e6;
+                asset_compress_set_auto_budget(pi_bandwidth, min_load_speed);
             } else if (!strcmp(argv[i], "-w") || !strcmp(argv[i], "--window")) {
                 if (++i == argc) {
                     fprintf(stderr, "missing argument for %s\n", argv[i-1]);
@@ -70,6 +112,23 @@ int main(int argc, char *argv[])
                     fprintf(stderr, "supported window sizes: 2, 4, 8, 16, 32, 64, 128, 256\n");
                     return 1;
                 }    
+                winsize_set = true;
+            } else if (!strcmp(argv[i], "-b") || !strcmp(argv[i], "--blocks")) {
+                block_size = DEFAULT_BLOCK_SIZE;
+                // The size is optional
+                int size; char extra;
+                if (i+1 < argc && sscanf(argv[i+1], "%d%c", &size, &extra) == 1) {
+                    i++;
+                    if (size <= 0) {
+                        fprintf(stderr, "invalid block size: %s\n", argv[i]);
+                        return 1;
+                    }
+                    block_size = size * 1024;
+                }
+                if (compression == COMPRESSION_AUTO) {
+                    fprintf(stderr, "block compression does not support --compress auto\n");
+                    return 1;
+                }
             } else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) {
                 if (++i == argc) {
                     fprintf(stderr, "missing argument for %s\n", argv[i-1]);
@@ -82,11 +141,16 @@ int main(int argc, char *argv[])
                     return 1;
                 }
                 char extra;
-                if (sscanf(argv[i], "%d%c", &compression, &extra) != 1) {
+                if (!strcmp(argv[i], "auto")) {
+                    compression = COMPRESSION_AUTO;
+                    if (block_size) {
+                        fprintf(stderr, "block compression does not support --compress auto\n");
+                        return 1;
+                    }
+                } else if (sscanf(argv[i], "%d%c", &compression, &extra) != 1) {
                     fprintf(stderr, "invalid argument for %s: %s\n", argv[i-1], argv[i]);
                     return 1;
-                }
-                if (compression < 0 || compression > MAX_COMPRESSION) {
+                } else if (compression < 0 || compression > MAX_COMPRESSION) {
                     fprintf(stderr, "invalid compression algorithm: %d\n", compression);
                     return 1;
                 }
@@ -98,13 +162,25 @@ int main(int argc, char *argv[])
         }
 
         infn = argv[i];
+        if (flag_bench) {
+            bench_files = realloc(bench_files, (bench_nfiles+1) * sizeof(char*));
+            bench_files[bench_nfiles++] = infn;
+            continue;
+        }
+
         char *basename = strrchr(infn, '/');
         if (!basename) basename = infn; else basename += 1;
 
         asprintf(&outfn, "%s/%s", outdir, basename);
 
-        if (flag_verbose)
-            printf("Compressing: %s => %s [algo=%d]\n", infn, outfn, compression);
+        if (flag_verbose) {
+            if (block_size)
+                printf("Compressing: %s => %s [algo=%d, blocks=%d KiB]\n", infn, outfn, compression, block_size/1024);
+            else if (compression == COMPRESSION_AUTO)
+                printf("Compressing: %s => %s [algo=auto]\n", infn, outfn);
+            else
+                printf("Compressing: %s => %s [algo=%d]\n", infn, outfn, compression);
+        }
 
         if (!file_exists(infn)) {
             fprintf(stderr, "error: input file not found: %s\n", infn);
@@ -121,9 +197,42 @@ int main(int argc, char *argv[])
             fprintf(stderr, "error opening output file: %s\n", outfn);
             return 1;
         }
-        asset_compress_mem(data, sz, out, compression, winsize, NULL);
+        int ret;
+        if (compression == COMPRESSION_AUTO) {
+            int level;
+            ret = asset_compress_mem_auto(data, sz, out, winsize, NULL, &level);
+            if (flag_verbose)
+                printf("  auto: level %d (%d -> %d bytes)\n", level, sz, ret);
+        } else if (block_size && compression) {
+            // Streaming does not go through a ring buffer for block files, so unless
+            // requested otherwise let the window span the whole block (LZ4 cannot
+            // go past 64 KiB).
+            int block_winsize = winsize;
+            if (!winsize_set) {
+                block_winsize = 2*1024;
+                while (block_winsize < block_size && block_winsize < 256*1024)
+                    block_winsize *= 2;
+                if (compression == 1 && block_winsize > 64*1024)
+                    block_winsize = 64*1024;
+            }
+            ret = asset_compress_mem_blocks(data, sz, out, compression, block_winsize, block_size, NULL);
+        } else {
+            ret = asset_compress_mem(data, sz, out, compression, winsize, NULL);
+        }
         fclose(out);
+        free(data);
+        if (ret < 0) {
+            remove(outfn);
+            return 1;
+        }
 
         free(outfn);
     }
+
+    if (flag_bench) {
+        int ret = mkasset_bench(bench_files, bench_nfiles, winsize, pi_bandwidth, min_load_speed);
+        free(bench_files);
+        return ret;
+    }
+    return 0;
 }
@@ -0,0 +1,180 @@
+// mkasset --bench: compress each file with all levels and estimate the load time on N64.
+//
+// The host decode speed is measured with the same decoders used by asset_load()
+// (built for the host), so it is only useful to compare levels with each other.
+// The N64 time is estimated by asset_estimate_load(), the same model used by
+// "--compress auto".
+
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MIN_TIME_NS       100000000   // Minimum time spent measuring each host decode
+
+static const char *bench_algo_names[MAX_COMPRESSION+1] = { "none", "lz4hc", "aplib", "shrinkler" };
+
+static uint64_t bench_nanotime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/** @brief Result of a single level on a single file */
+typedef struct {
+    int size;               ///< Size of the asset file
+    double host_mbps;       ///< Host decode throughput (MB/s of decompressed data)
+    double decode_ms;       ///< Estimated N64 decode time
+    double dma_ms;          ///< Estimated N64 time to DMA the file from ROM
+    double load_ms;         ///< Estimated N64 load time (decoders race with the DMA)
+} bench_result_t;
+
+static bool bench_level(void *data, int sz, int level, int winsize, int pi_bandwidth, bench_result_t *res)
+{
+    // Compress into a temporary file with the same window mkasset would use,
+    // so that the results match what "--compress auto" sees.
+    FILE *f = tmpfile();
+    if (!f) {
+        fprintf(stderr, "error creating temporary file\n");
+        return false;
+    }
+    res->size = asset_compress_mem(data, sz, f, level, winsize, NULL);
+    fflush(f);
+    res->dma_ms = res->size * 1000.0 / pi_bandwidth;
+
+    if (level == 0) {
+        res->host_mbps = 0;
+        res->decode_ms = 0;
+        res->load_ms = res->dma_ms;
+        fclose(f);
+        return true;
+    }
+
+    // Host decode, through the asset library
+    int fd = fileno(f);
+    int buf_size = 0;
+    void *buf = NULL;
+    int dec_size = res->size;
+    lseek(fd, 0, SEEK_SET);
+    asset_loadfd_into(fd, &dec_size, NULL, &buf_size);
+    buf = malloc(buf_size);
+
+    int runs = 0;
+    uint64_t best = UINT64_MAX, start = bench_nanotime();
+    do {
+        lseek(fd, 0, SEEK_SET);
+        dec_size = res->size;
+        uint64_t t0 = bench_nanotime();
+        asset_loadfd_into(fd, &dec_size, buf, &buf_size);
+        uint64_t t1 = bench_nanotime();
+        if (t1 - t0 < best) best = t1 - t0;
+        runs++;
+    } while (runs < 3 || bench_nanotime() - start < BENCH_MIN_TIME_NS);
+
+    if (dec_size != sz || memcmp(buf, data, sz)) {
+        fprintf(stderr, "error: level %d does not roundtrip\n", level);
+        free(buf); fclose(f);
+        return false;
+    }
+    res->host_mbps = best ? (sz / 1e6) / (best / 1e9) : 0;
+
+    // N64 estimate, walking the compressed stream
+    int cmp_size = res->size - sizeof(asset_header_t);
+    uint8_t *cmp = malloc(cmp_size);
+    lseek(fd, sizeof(asset_header_t), SEEK_SET);
+    read(fd, cmp, cmp_size);
+
+    asset_load_estimate_t est;
+    if (!asset_estimate_load(level, cmp, cmp_size, sz, pi_bandwidth, &est))
+        fprintf(stderr, "warning: level %d: the load time model could not walk the stream, estimate is off\n", level);
+    res->decode_ms = est.decode_ms;
+    res->load_ms = est.load_ms;
+
+    free(cmp);
+    free(buf);
+    fclose(f);
+    return true;
+}
+
+// Same choice as "--compress auto" (see asset_compress_choose_level()): the smallest
+// level that loads at least at min_load_speed, or the fastest one if none does.
+// Shrinkler is skipped with a streaming window, as it cannot be opened with asset_fopen().
+static int bench_recommend(const bench_result_t *res, int sz, int winsize, int min_load_speed)
+{
+    double budget_ms = sz * 1000.0 / min_load_speed;
+    int best = -1, fastest = 0;
+    for (int level=0; level<=MAX_COMPRESSION; level++) {
+        if (level == 3 && winsize) continue;
+        if (res[level].load_ms < res[fastest].load_ms)
+            fastest = level;
+        if (res[level].load_ms <= budget_ms && (best < 0 || res[level].size < res[best].size))
+            best = level;
+    }
+    return best >= 0 ? best : fastest;
+}
+
+/** @brief Benchmark all files, printing per-file results and a final recommendation table */
+int mkasset_bench(char **files, int nfiles, int winsize, int pi_bandwidth, int min_load_speed)
+{
+    typedef struct { const char *fn; int sz; int level; bench_result_t res; } bench_summary_t;
+    bench_summary_t *summary = calloc(nfiles, sizeof(bench_summary_t));
+    int nsummary = 0;
+
+    if (!min_load_speed) min_load_speed = pi_bandwidth;
+    printf("N64 estimates assume %.1f MB/s ROM DMA and a %d KiB window, recommending the smallest level that loads at %.1f MB/s or more\n\n",
+        pi_bandwidth / 1e6, winsize / 1024, min_load_speed / 1e6);
+    for (int i=0; i<nfiles; i++) {
+        const char *infn = files[i];
+        if (!file_exists(infn)) {
+            fprintf(stderr, "error: input file not found: %s\n", infn);
+            free(summary);
+            return 1;
+        }
+
+        // Use asset_load so that already compressed files are benchmarked on their contents
+        int sz;
+        void *data = asset_load(infn, &sz);
+        if (sz == 0) {
+            printf("%s: empty, skipped\n\n", infn);
+            free(data);
+            continue;
+        }
+
+        bench_result_t res[MAX_COMPRESSION+1];
+        bool ok = true;
+        for (int level=0; level<=MAX_COMPRESSION && ok; level++)
+            ok = bench_level(data, sz, level, winsize, pi_bandwidth, &res[level]);
+        free(data);
+        if (!ok) {
+            free(summary);
+            return 1;
+        }
+
+        int rec = bench_recommend(res, sz, winsize, min_load_speed);
+        printf("%s (%d bytes)\n", infn, sz);
+        printf("  %-5s %-10s %10s %7s %10s %10s %10s %10s\n", "level", "algo", "size", "ratio", "host MB/s", "N64 dec", "N64 dma", "N64 load");
+        for (int level=0; level<=MAX_COMPRESSION; level++) {
+            bench_result_t *r = &res[level];
+            printf("  %-5d %-10s %10d %6.1f%% ", level, bench_algo_names[level], r->size, sz ? r->size * 100.0 / sz : 100.0);
+            if (level) printf("%10.1f %7.2f ms ", r->host_mbps, r->decode_ms);
+            else       printf("%10s %10s ", "-", "-");
+            printf("%7.2f ms %7.2f ms%s\n", r->dma_ms, r->load_ms, level == rec ? "  <==" : "");
+        }
+        printf("\n");
+
+        summary[nsummary++] = (bench_summary_t){ infn, sz, rec, res[rec] };
+    }
+
+    printf("Recommendation:\n");
+    printf("  %-40s %10s %5s %10s %10s\n", "file", "size", "level", "asset size", "N64 load");
+    int64_t total_sz = 0, total_cmp = 0;
+    double total_ms = 0;
+    for (int i=0; i<nsummary; i++) {
+        bench_summary_t *s = &summary[i];
+        printf("  %-40s %10d %5d %10d %7.2f ms\n", s->fn, s->sz, s->level, s->res.size, s->res.load_ms);
+        total_sz += s->sz; total_cmp += s->res.size; total_ms += s->res.load_ms;
+    }
+    printf("  %-40s %10lld %5s %10lld %7.2f ms\n", "total", (long long)total_sz, "", (long long)total_cmp, total_ms);
+
+    free(summary);
+    return 0;
+}
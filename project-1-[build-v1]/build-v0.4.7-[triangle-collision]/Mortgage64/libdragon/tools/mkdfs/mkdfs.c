@@ -9,8 +9,10 @@
 #include <sys/types.h>
 #include <sys/param.h>
 #include <stdbool.h>
+#include <limits.h>
 #include "dragonfs.h"
 #include "dfsinternal.h"
+#include "../common/polyfill.h"
 
 #define STBDS_NO_SHORT_NAMES
 #define STB_DS_IMPLEMENTATION //Hack to get tools to compile
@@ -23,65 +25,81 @@ typedef struct dfs_file_s {
     uint32_t data_len;
 } dfs_file_t;
 
+/* A file or directory found while scanning the input directory */
+typedef struct dfs_node_s {
+    char *path;             ///< Path on disk
+    bool is_dir;            ///< True for directories
+    int next;               ///< Next node in the same directory, or -1
+    int first_child;        ///< Directories: first node inside it (never -1, empty directories are skipped)
+    uint32_t entry_ofs;     ///< Offset of the directory entry in the image
+
+    uint8_t *data;          ///< Files: contents
+    uint32_t size;          ///< Files: size in bytes
+    uint64_t hash;          ///< Files: hash of the contents
+    bool read_ok;           ///< Files: true if the file was read successfully
+    int same_as;            ///< Files: earlier node with the same contents, or -1
+    uint32_t data_ofs;      ///< Files: offset of the contents in the image
+    int order;              ///< Files: position of the contents in the --order trace, or INT_MAX
+} dfs_node_t;
+
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
 #define SWAPLONG(i) (i)
 #else
 #define SWAPLONG(i) (((uint32_t)((i) & 0xFF000000) >> 24) | ((uint32_t)((i) & 0x00FF0000) >>  8) | ((uint32_t)((i) & 0x0000FF00) <<  8) | ((uint32_t)((i) & 0x000000FF) << 24))
 #endif
 
+/* Implemented in mkdfs_para.cpp */
+void mkdfs_parallel_for(int n, void (*func)(int i, void *arg), void *arg);
+
 uint8_t *dfs = NULL;
 dfs_file_t *dfs_files;
+dfs_node_t *dfs_nodes;
 
 uint32_t fs_size = 0;
 
-/* Offset from start of filesystem */
-static inline uint32_t sector_offset(void *sector)
-{
-    uint32_t x = (uint8_t *)sector - dfs;
+int num_dupes = 0;
+uint64_t dupe_bytes = 0;
 
-    return x;
-}
+/* Block size for --align (0 = disabled) */
+uint32_t align_size = 0;
 
 static inline void *sector_to_memory(uint32_t offset)
 {
     return (void *)(dfs + offset);
 }
 
-uint32_t dfs_alloc(int size)
+/* Reserve space in the filesystem image, return its offset. The image itself
+   is only allocated once the whole layout is known. */
+uint32_t dfs_alloc(uint32_t size)
 {
-    void *end;
-    int rsize = (size + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
-
-    if(!dfs)
-    {
-        dfs = malloc(rsize);
-        fs_size = rsize;
-
-        end = dfs;
-    }
-    else
-    {
-        dfs = realloc(dfs, fs_size + rsize);
-
-        end = dfs + fs_size;
-        fs_size += rsize;
-    }
-
-    /* Zero out last bytes */
-    memset(end, 0, rsize);
-
-    return sector_offset(end);    
+    uint32_t ofs = fs_size;
+    fs_size += (size + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
+    return ofs;
 }
 
-/* Add a new sector to the filesystem, return that sector pointer */
+/* Add a new sector to the filesystem, return its offset */
 uint32_t new_sector(void)
 {
     return dfs_alloc(SECTOR_SIZE);
 }
 
-uint32_t new_blob(int size)
+uint32_t new_blob(uint32_t size)
 {
-    return dfs_alloc(size);    
+    return dfs_alloc(size);
+}
+
+/* Reserve space for file contents, honoring --align: a file that fits in a
+   block does not straddle a block boundary, a larger one starts on a boundary.
+   This minimizes the number of blocks read to load it. */
+uint32_t new_file_blob(uint32_t size)
+{
+    if(align_size && size)
+    {
+        uint32_t block_ofs = fs_size % align_size;
+        if(size <= align_size ? block_ofs + size > align_size : block_ofs != 0)
+            fs_size += align_size - block_ofs;
+    }
+    return dfs_alloc(size);
 }
 
 void kill_fs()
@@ -94,52 +112,84 @@ void kill_fs()
         free(dfs_files[i].path);
     }
     stbds_arrfree(dfs_files);
+    for(size_t i=0; i<stbds_arrlenu(dfs_nodes); i++) {
+        free(dfs_nodes[i].path);
+        free(dfs_nodes[i].data);
+    }
+    stbds_arrfree(dfs_nodes);
 }
 
 void print_help(const char * const prog_name)
 {
-    fprintf(stderr, "Usage: %s <File> <Directory>\n", prog_name);
+    fprintf(stderr, "Usage: %s [flags] <File> <Directory>\n", prog_name);
     fprintf(stderr, "  where <File> is the resulting filesystem image\n");
     fprintf(stderr, "  and <Directory> is the directory (including subdirectories) to include\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Flags:\n");
+    fprintf(stderr, "   --order=<trace.txt>     Store file contents in the order of a trace (one path per line, as\n");
+    fprintf(stderr, "                           recorded by dfs_trace_start), so that files loaded together are\n");
+    fprintf(stderr, "                           contiguous. Files not in the trace follow, in directory order.\n");
+    fprintf(stderr, "   --align=<bytes>         Avoid file contents straddling blocks of this size (multiple of %d)\n", SECTOR_SIZE);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Files with identical contents are stored only once in the image.\n");
 }
 
-uint32_t add_file(const char * const file, uint32_t *size)
+/* FNV-1a style 64-bit hash, used to find files with identical contents.
+   It consumes 8 bytes per step: contents are compared anyway on a match, so
+   it only needs to be fast and well spread. */
+static uint64_t content_hash(const uint8_t *data, uint32_t size)
 {
-    FILE *fp;
-
-    printf("Adding '%s' to filesystem image.\n", file);
+    uint64_t hash = 0xcbf29ce484222325ull ^ size;
+    uint32_t i = 0;
+    for(; i+8<=size; i+=8) {
+        uint64_t v;
+        memcpy(&v, data+i, 8);
+        hash ^= v;
+        hash *= 0x100000001b3ull;
+        hash ^= hash >> 29;
+    }
+    for(; i<size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
 
-    fp = fopen(file, "rb");
+/* Read and hash a file. Called in parallel on multiple threads for different nodes */
+static void read_file(int idx, void *arg)
+{
+    int *file_nodes = arg;
+    dfs_node_t *node = &dfs_nodes[file_nodes[idx]];
+    FILE *fp = fopen(node->path, "rb");
 
     if(!fp)
     {
-        fprintf(stderr, "Cannot open file '%s' for read!\n", file);
-        return 0;
+        fprintf(stderr, "Cannot open file '%s' for read!\n", node->path);
+        return;
     }
 
     fseek(fp, 0, SEEK_END);
-    *size = ftell(fp);
+    long size = ftell(fp);
     fseek(fp, 0, SEEK_SET);
 
-    if (*size > 0x0FFFFFFF)
+    if (size < 0 || size > 0x0FFFFFFF)
     {
-        fprintf(stderr, "File '%s' too big for the filesystem!\n", file);
-        return 0;
+        fprintf(stderr, "File '%s' too big for the filesystem!\n", node->path);
+        fclose(fp);
+        return;
     }
 
-    uint32_t blob = new_blob(*size);
-    uint8_t *data = sector_to_memory(blob);
-
-    int read = fread(data, 1, *size, fp);
-    if (read < 0) {
-        /* Wat? */
-        fprintf(stderr, "Cannot add all contents of file '%s' to filesystem!\n", file);
+    node->size = size;
+    node->data = malloc(size ? size : 1);
+    if (fread(node->data, 1, size, fp) != size) {
+        fprintf(stderr, "Cannot add all contents of file '%s' to filesystem!\n", node->path);
         fclose(fp);
-        return 0;    
+        return;
     }
-
     fclose(fp);
-    return blob;
+
+    node->hash = content_hash(node->data, node->size);
+    node->read_ok = true;
 }
 
 static uint32_t prime_hash(const char *str, uint32_t prime)
@@ -198,11 +248,12 @@ const char *mybasename(const char *path)
     return base ? base + 1 : path;
 }
 
-uint32_t add_directory(const char * const base_path, const char * const path)
+/* Scan a directory recursively into dfs_nodes. Returns the index of the first
+   node in it, or -1 if there are no files in it. */
+int scan_directory(const char * const path)
 {
-    directory_entry_t *tmp_entry;
-    uint32_t first_entry = 0;
-    uint32_t cur_entry = 0;
+    int first_node = -1;
+    int cur_node = -1;
     char **files = read_directory(path);
 
     for (int i = 0; i < stbds_arrlen(files); i++)
@@ -213,94 +264,241 @@ uint32_t add_directory(const char * const base_path, const char * const path)
         /* Figure out if it is a directory or regular (windows doesn't include d_type in dirent) */
         stat( file, &stats );
 
+        dfs_node_t node = { .path = file, .next = -1, .first_child = -1, .same_as = -1, .order = INT_MAX };
+        int new_node = stbds_arrlen(dfs_nodes);
+
         if(S_ISREG(stats.st_mode))
         {
-            uint32_t new_entry = new_sector();
-            uint32_t file_size = 0;
-
-            tmp_entry = sector_to_memory(new_entry);
-            tmp_entry->next_entry = 0;
-
-            /* Copy over filename */
-            strncpy(tmp_entry->path, mybasename(file), MAX_FILENAME_LEN);
-            tmp_entry->path[MAX_FILENAME_LEN] = 0;
-
-            uint32_t new_file = add_file(file, &file_size);
-
-            if(!new_file)
-            {
-                free(file);
-                return 0;
-            }
-            dfs_file_t temp_file;
-            temp_file.path = strdup(file+strlen(base_path)+1);
-            temp_file.path_hash = prime_hash(temp_file.path, DFS_LOOKUP_PRIME);
-            temp_file.data_ofs = new_file;
-            temp_file.data_len = file_size;
-            stbds_arrpush(dfs_files, temp_file);
-            
-            tmp_entry = sector_to_memory(new_entry);
-            tmp_entry->file_pointer = SWAPLONG(new_file);
-            tmp_entry->flags = SWAPLONG((FLAGS_FILE << 28) | (file_size & 0x0FFFFFFF));
-
-            if(cur_entry)
-            {
-                /* Link up! */
-                tmp_entry = sector_to_memory(cur_entry);
-                tmp_entry->next_entry = SWAPLONG(new_entry);
-            }
-
-            /* This is now the current working entry */
-            cur_entry = new_entry;
+            stbds_arrpush(dfs_nodes, node);
         }
         else if(S_ISDIR(stats.st_mode))
         {
-            uint32_t new_entry = new_sector();
+            node.is_dir = true;
+            stbds_arrpush(dfs_nodes, node);
 
-            tmp_entry = sector_to_memory(new_entry);
-            tmp_entry->flags = SWAPLONG(FLAGS_DIR << 28); /* Size doesn't matter for directories */
-            tmp_entry->next_entry = 0;
-
-            /* Copy over filename */
-            strncpy(tmp_entry->path, mybasename(file), MAX_FILENAME_LEN);
-            tmp_entry->path[MAX_FILENAME_LEN] = 0;
-
-            uint32_t new_directory = add_directory(base_path, file);
-
-            if(!new_directory)
+            int first_child = scan_directory(file);
+            if(first_child < 0)
             {
                 fprintf(stderr, "Skipping empty directory: %s\n", file);
+                stbds_arrsetlen(dfs_nodes, new_node);
                 free(file);
                 continue;
             }
+            dfs_nodes[new_node].first_child = first_child;
+        }
+        else
+        {
+            free(file);
+            continue;
+        }
 
-            tmp_entry = sector_to_memory(new_entry);
-            tmp_entry->file_pointer = SWAPLONG(new_directory);
+        /* Link up! */
+        if(cur_node >= 0)
+            dfs_nodes[cur_node].next = new_node;
+        else
+            first_node = new_node;
+        cur_node = new_node;
+    }
 
-            if(cur_entry)
-            {
-                /* Link up! */
-                tmp_entry = sector_to_memory(cur_entry);
-                tmp_entry->next_entry = SWAPLONG(new_entry);
-            }
+    stbds_arrfree(files);
+    return first_node;
+}
+
+/* Read all files, using all available cores, and find files with the same
+   contents as earlier ones. Returns false if any file could not be read. */
+bool read_files(void)
+{
+    int *file_nodes = NULL;
+    for(int i=0; i<stbds_arrlen(dfs_nodes); i++) {
+        if(!dfs_nodes[i].is_dir)
+            stbds_arrpush(file_nodes, i);
+    }
 
-            /* This is now the current working entry */
-            cur_entry = new_entry;
+    mkdfs_parallel_for(stbds_arrlen(file_nodes), read_file, file_nodes);
+
+    // Walk in scan order (not in completion order), so that the output does
+    // not depend on thread scheduling.
+    struct { uint64_t key; int value; } *by_hash = NULL;
+    bool ok = true;
+    for(int i=0; i<stbds_arrlen(file_nodes) && ok; i++) {
+        dfs_node_t *node = &dfs_nodes[file_nodes[i]];
+        if(!node->read_ok) {
+            ok = false;
+            break;
         }
 
-        free(file);
+        int other = stbds_hmget(by_hash, node->hash);
+        dfs_node_t *prev = stbds_hmgeti(by_hash, node->hash) >= 0 ? &dfs_nodes[other] : NULL;
+        if(prev && prev->size == node->size && memcmp(prev->data, node->data, node->size) == 0) {
+            printf("Adding '%s' to filesystem image (same contents as '%s').\n", node->path, prev->path);
+            node->same_as = other;
+            free(node->data);
+            node->data = NULL;
+            num_dupes++;
+            dupe_bytes += node->size;
+            continue;
+        }
 
-        if(!first_entry)
-        {
-            /* Return pointer to first file on list */
-            first_entry = cur_entry;
+        printf("Adding '%s' to filesystem image.\n", node->path);
+        // In case of a hash collision, only the first file is a candidate (which is harmless)
+        if(!prev)
+            stbds_hmput(by_hash, node->hash, file_nodes[i]);
+    }
+
+    stbds_hmfree(by_hash);
+    stbds_arrfree(file_nodes);
+    return ok;
+}
+
+/* Read a trace recorded by dfs_trace_start, and number the contents of
+   the files in it in order of first appearance. Returns false on error. */
+bool read_order(const char *trace_fn, const char * const base_path)
+{
+    FILE *fp = fopen(trace_fn, "r");
+    if(!fp)
+    {
+        fprintf(stderr, "Cannot open trace '%s' for read!\n", trace_fn);
+        return false;
+    }
+
+    struct { char *key; int value; } *by_path = NULL;
+    for(int i=0; i<stbds_arrlen(dfs_nodes); i++) {
+        if(!dfs_nodes[i].is_dir)
+            stbds_shput(by_path, dfs_nodes[i].path+strlen(base_path)+1, i);
+    }
+
+    // A trace captured from a debug log contains other lines as well: if
+    // any line is tagged, only use those.
+    const char *tag = DFS_TRACE_TAG;
+    bool tagged = false;
+    char **lines = NULL;
+    char *line = NULL; size_t line_size = 0;
+    while(getline(&line, &line_size, fp) > 0) {
+        line[strcspn(line, "\r\n")] = 0;
+        tagged |= strncmp(line, tag, strlen(tag)) == 0;
+        stbds_arrpush(lines, strdup(line));
+    }
+    free(line);
+    fclose(fp);
+
+    int num_order = 0, num_missing = 0;
+    for(int i=0; i<stbds_arrlen(lines); i++) {
+        char *fn = lines[i];
+        if(tagged) {
+            if(strncmp(fn, tag, strlen(tag)) != 0) continue;
+            fn += strlen(tag);
         }
+        if(fn[0] == '/') fn++;
+        if(!fn[0]) continue;
+
+        int idx = stbds_shgeti(by_path, fn) >= 0 ? stbds_shget(by_path, fn) : -1;
+        if(idx < 0) {
+            fprintf(stderr, "Warning: file '%s' in trace is not in the filesystem\n", fn);
+            num_missing++;
+            continue;
+        }
+
+        dfs_node_t *owner = &dfs_nodes[dfs_nodes[idx].same_as >= 0 ? dfs_nodes[idx].same_as : idx];
+        if(owner->order == INT_MAX)
+            owner->order = num_order++;
     }
+    printf("Ordering %d files from trace '%s'.\n", num_order, trace_fn);
 
-    stbds_arrfree(files);
+    for(int i=0; i<stbds_arrlen(lines); i++)
+        free(lines[i]);
+    stbds_arrfree(lines);
+    stbds_shfree(by_path);
+    return true;
+}
+
+/* Assign offsets to the directory entries in scan order. Unless the contents
+   are laid out separately (--order), each file's contents follow its entry. */
+void layout_directory(int first_node, bool with_data)
+{
+    for(int i=first_node; i>=0; i=dfs_nodes[i].next)
+    {
+        dfs_node_t *node = &dfs_nodes[i];
+        node->entry_ofs = new_sector();
+
+        if(node->is_dir)
+            layout_directory(node->first_child, with_data);
+        else if(with_data && node->same_as < 0)
+            node->data_ofs = new_file_blob(node->size);
+    }
+}
+
+static int compare_node_order(const void *a, const void *b)
+{
+    const dfs_node_t *n1 = &dfs_nodes[*(const int *)a];
+    const dfs_node_t *n2 = &dfs_nodes[*(const int *)b];
+    if(n1->order != n2->order)
+        return n1->order < n2->order ? -1 : 1;
+    // Not in the trace: keep scan order
+    return *(const int *)a - *(const int *)b;
+}
 
-    /* Will return 0 if we don't find any entries (don't support directories without files) */
-    return first_entry;
+/* Lay out all file contents after the directory entries, in trace order */
+void layout_data_ordered(void)
+{
+    int *data_nodes = NULL;
+    for(int i=0; i<stbds_arrlen(dfs_nodes); i++) {
+        if(!dfs_nodes[i].is_dir && dfs_nodes[i].same_as < 0)
+            stbds_arrpush(data_nodes, i);
+    }
+    qsort(data_nodes, stbds_arrlen(data_nodes), sizeof(int), compare_node_order);
+
+    for(int i=0; i<stbds_arrlen(data_nodes); i++)
+        dfs_nodes[data_nodes[i]].data_ofs = new_file_blob(dfs_nodes[data_nodes[i]].size);
+    stbds_arrfree(data_nodes);
+}
+
+/* Fill dfs_files for the lookup table, once all data offsets are known.
+   Files with the same contents as an earlier one point to its data. */
+void collect_files(const char * const base_path)
+{
+    for(int i=0; i<stbds_arrlen(dfs_nodes); i++)
+    {
+        dfs_node_t *node = &dfs_nodes[i];
+        if(node->is_dir)
+            continue;
+        if(node->same_as >= 0)
+            node->data_ofs = dfs_nodes[node->same_as].data_ofs;
+
+        dfs_file_t temp_file;
+        temp_file.path = strdup(node->path+strlen(base_path)+1);
+        temp_file.path_hash = prime_hash(temp_file.path, DFS_LOOKUP_PRIME);
+        temp_file.data_ofs = node->data_ofs;
+        temp_file.data_len = node->size;
+        stbds_arrpush(dfs_files, temp_file);
+    }
+}
+
+/* Fill the directory entries and file contents into the image */
+void write_directory(int first_node)
+{
+    for(int i=first_node; i>=0; i=dfs_nodes[i].next)
+    {
+        dfs_node_t *node = &dfs_nodes[i];
+        directory_entry_t *tmp_entry = sector_to_memory(node->entry_ofs);
+
+        /* Copy over filename */
+        strncpy(tmp_entry->path, mybasename(node->path), MAX_FILENAME_LEN);
+        tmp_entry->path[MAX_FILENAME_LEN] = 0;
+        tmp_entry->next_entry = node->next >= 0 ? SWAPLONG(dfs_nodes[node->next].entry_ofs) : 0;
+
+        if(node->is_dir)
+        {
+            tmp_entry->flags = SWAPLONG(FLAGS_DIR << 28); /* Size doesn't matter for directories */
+            tmp_entry->file_pointer = SWAPLONG(dfs_nodes[node->first_child].entry_ofs);
+            write_directory(node->first_child);
+            continue;
+        }
+
+        tmp_entry->flags = SWAPLONG((FLAGS_FILE << 28) | (node->size & 0x0FFFFFFF));
+        tmp_entry->file_pointer = SWAPLONG(node->data_ofs);
+        if(node->data)
+            memcpy(sector_to_memory(node->data_ofs), node->data, node->size);
+    }
 }
 
 int compare_dfs_entry_hash(const void *a, const void *b)
@@ -330,18 +528,23 @@ uint32_t dfs_get_path_size(void)
     return size;
 }
 
-void write_dfs_lookup(void)
+/* Reserve space for the lookup table and the path strings */
+void layout_dfs_lookup(uint32_t *lookup_ptr, uint32_t *path_ofs)
+{
+    uint32_t num_files = stbds_arrlenu(dfs_files);
+    *lookup_ptr = new_blob(sizeof(dfs_lookup_t) + num_files*sizeof(dfs_lookup_file_t));
+    *path_ofs = new_blob(dfs_get_path_size());
+}
+
+void write_dfs_lookup(uint32_t lookup_ptr, uint32_t path_ofs)
 {
     uint32_t num_files = stbds_arrlenu(dfs_files);
     qsort(&dfs_files[0], num_files, sizeof(dfs_file_t), compare_dfs_entry_hash);
     uint32_t lookup_size = sizeof(dfs_lookup_t);
     lookup_size += num_files*sizeof(dfs_lookup_file_t);
-    uint32_t lookup_ptr = new_blob(lookup_size);
     directory_entry_t *id_dir = sector_to_memory(0);
     id_dir->next_entry = SWAPLONG(lookup_size);
     id_dir->file_pointer = SWAPLONG(lookup_ptr);
-    uint32_t path_size = dfs_get_path_size();
-    uint32_t path_ofs = new_blob(path_size);
     dfs_lookup_t *rom_lookup = sector_to_memory(lookup_ptr);
     rom_lookup->num_files = SWAPLONG(num_files);
     rom_lookup->path_ofs = SWAPLONG(path_ofs);
@@ -374,32 +577,45 @@ void write_dfs_lookup(void)
 
 int main(int argc, char *argv[])
 {
-    if(argc != 3)
+    const char *order_fn = NULL;
+    int i = 1;
+    for(; i < argc && argv[i][0] == '-'; i++)
     {
-        print_help(argv[0]);
-        return -1;
+        if(!strncmp(argv[i], "--order=", 8))
+        {
+            order_fn = argv[i] + 8;
+        }
+        else if(!strncmp(argv[i], "--align=", 8))
+        {
+            char extra;
+            if(sscanf(argv[i] + 8, "%u%c", &align_size, &extra) != 1 || align_size == 0 || align_size % SECTOR_SIZE != 0)
+            {
+                fprintf(stderr, "invalid argument for --align: %s (must be a multiple of %d)\n", argv[i] + 8, SECTOR_SIZE);
+                return -1;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "invalid flag: %s\n", argv[i]);
+            print_help(argv[0]);
+            return -1;
+        }
     }
 
-    /* Add in identifier */
-    directory_entry_t *id = sector_to_memory(new_sector());
-
-    if(!id)
+    if(argc - i != 2)
     {
-        fprintf(stderr, "Out of memory!\n");
-
+        print_help(argv[0]);
         return -1;
     }
-
-    id->flags = SWAPLONG(ROOT_FLAGS);
-    id->next_entry = SWAPLONG(ROOT_NEXT_ENTRY);
-    strcpy(id->path, ROOT_PATH);
+    argv += i - 1;
 
     // Remove trailing slash if present
     char *path = strdup(argv[2]);
     if (path[strlen(path) - 1] == '/')
         path[strlen(path) - 1] = 0;
 
-    if(!add_directory(path, path))
+    int root = scan_directory(path);
+    if(root < 0)
     {
         /* Error adding directory */
         fprintf(stderr, "Error creating '%s': directory '%s' is empty or does not exist\n", argv[1], argv[2]);
@@ -408,7 +624,57 @@ int main(int argc, char *argv[])
 
         return -1;
     }
-    write_dfs_lookup();
+
+    if(!read_files())
+    {
+        fprintf(stderr, "Error creating '%s'\n", argv[1]);
+
+        kill_fs();
+
+        return -1;
+    }
+
+    if(order_fn && !read_order(order_fn, path))
+    {
+        kill_fs();
+
+        return -1;
+    }
+
+    /* Identifier sector first, followed by the root directory */
+    uint32_t id_ofs = new_sector();
+    layout_directory(root, !order_fn);
+    if(order_fn)
+        layout_data_ordered();
+    collect_files(path);
+    uint32_t lookup_ptr, path_ofs;
+    layout_dfs_lookup(&lookup_ptr, &path_ofs);
+
+    /* Build the whole image in memory */
+    dfs = calloc(1, fs_size);
+
+    if(!dfs)
+    {
+        fprintf(stderr, "Out of memory!\n");
+
+        kill_fs();
+
+        return -1;
+    }
+
+    directory_entry_t *id = sector_to_memory(id_ofs);
+    id->flags = SWAPLONG(ROOT_FLAGS);
+    id->next_entry = SWAPLONG(ROOT_NEXT_ENTRY);
+    strcpy(id->path, ROOT_PATH);
+
+    write_directory(root);
+    write_dfs_lookup(lookup_ptr, path_ofs);
+
+    if(num_dupes)
+    {
+        printf("%d duplicate files stored once, saving %llu bytes.\n", num_dupes, (unsigned long long)dupe_bytes);
+    }
+
     /* Write out filesystem */
     FILE *fp = fopen(argv[1], "wb");
 
@@ -422,10 +688,17 @@ int main(int argc, char *argv[])
         return -1;
     }
     
-    fwrite(dfs, 1, fs_size, fp);
-    fclose(fp);
+    bool ok = fwrite(dfs, 1, fs_size, fp) == fs_size;
+    ok = (fclose(fp) == 0) && ok;
 
+    if(!ok)
+    {
+        fprintf(stderr, "Error writing '%s'.\n", argv[1]);
+        remove(argv[1]);
+    }
+
+    free(path);
     kill_fs();
 
-    return 0;
-}
\ No newline at end of file
+    return ok ? 0 : -1;
+}
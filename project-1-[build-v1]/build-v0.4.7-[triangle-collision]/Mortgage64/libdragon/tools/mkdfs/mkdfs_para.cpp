@@ -0,0 +1,12 @@
+#include <vector>
+#include <algorithm>
+#include "../common/thread_utils.h"
+
+// Run func(i, arg) for i in [0, n-1], using all available cores.
+// Used by mkdfs.c, which is C and cannot use thParaLoop directly.
+extern "C"
+void mkdfs_parallel_for(int n, void (*func)(int i, void *arg), void *arg)
+{
+    if (n <= 0) return;
+    thParaLoop(n, [&](int i) { func(i, arg); });
+}
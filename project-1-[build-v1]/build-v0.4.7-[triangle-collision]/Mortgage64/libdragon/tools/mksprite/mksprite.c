@@ -155,7 +155,8 @@ void print_args( char * name )
     fprintf(stderr, "   -o/--output <dir>     Specify output directory (default: .)\n");
     fprintf(stderr, "   -f/--format <fmt>     Specify output format (default: AUTO)\n");
     fprintf(stderr, "   -D/--dither <dither>  Dithering algorithm (default: NONE)\n");
-    fprintf(stderr, "   -c/--compress <level> Compress output files (default: %d)\n", DEFAULT_COMPRESSION);
+    fprintf(stderr, "   -c/--compress <level> Compress output files, level 0-%d or \"auto\" (default: %d)\n", MAX_COMPRESSION, DEFAULT_COMPRESSION);
+    fprintf(stderr, "                         \"auto\" may pick level 2, which requires asset_init_compression(2) at runtime\n");
     fprintf(stderr, "   -g/--gamma            Adjust colors for when VI gamma correction is enabled on console (convert to linear colors)\n");
     fprintf(stderr, "   -d/--debug            Dump computed images (eg: mipmaps) as PNG files in output directory\n");
     fprintf(stderr, "\nSampling flags:\n");
@@ -1950,7 +1951,11 @@ int main(int argc, char *argv[])
             /* -c/--compress         Compress output files (using mksasset)             */
             else if (!strcmp(argv[i], "-c") || !strcmp(argv[i], "--compress")) {
                 // Optional compression level
-                if (i+1 < argc && argv[i+1][1] == 0) {
+                if (i+1 < argc && !strcmp(argv[i+1], "auto")) {
+                    compression = COMPRESSION_AUTO;
+                    i++;
+                }
+                else if (i+1 < argc && argv[i+1][1] == 0) {
                     int level = argv[i+1][0] - '0';
                     if (level >= 0 && level <= 3) {
                         compression = level;
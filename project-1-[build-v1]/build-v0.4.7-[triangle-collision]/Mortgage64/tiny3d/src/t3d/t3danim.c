@@ -16,6 +16,98 @@ typedef struct {
   uint16_t data[2]; // can be either 1 or 2 16-bit values (scalar / quat)
 } T3DAnimKF;
 
+// Resident keyframes currently loaded, shared by all instances of the same animation
+static uint32_t residentCacheSize = 0;
+static T3DAnimResident **residentCache = NULL;
+
+static T3DAnimStats animStats = {0};
+static uint8_t nextLodPhase = 0;
+
+static T3DAnimResident* resident_get(const T3DChunkAnim *animDef) {
+  for(uint32_t i = 0; i < residentCacheSize; i++) {
+    if(strcmp(residentCache[i]->filePath, animDef->filePath) == 0) {
+      residentCache[i]->refCount++;
+      return residentCache[i];
+    }
+  }
+
+  // load the whole stream once, then split it up per channel.
+  // Times are accumulated in the same order as when streaming, so playback is identical
+  int size = 0;
+  uint8_t *stream = asset_load(animDef->filePath, &size);
+  uint32_t channelCount = animDef->channelsQuat + animDef->channelsScalar;
+
+  T3DAnimResident *res = malloc(sizeof(T3DAnimResident));
+  res->filePath = strdup(animDef->filePath);
+  res->refCount = 1;
+  res->channelOffsets = calloc(channelCount + 1, sizeof(uint32_t));
+  res->keyframes = malloc(sizeof(T3DAnimKFResident) * animDef->keyframeCount);
+
+  uint32_t *fillIdx = malloc(sizeof(uint32_t) * channelCount);
+  float *timeEnd = calloc(channelCount, sizeof(float));
+
+  for(int pass = 0; pass < 2; pass++) {
+    int pos = 0;
+    int kfSize = sizeof(T3DAnimKF);
+    for(uint32_t k = 0; k < animDef->keyframeCount && pos + kfSize <= size; k++) {
+      T3DAnimKF kf = {};
+      memcpy(&kf, stream + pos, kfSize);
+      pos += kfSize;
+      bool isLarge = kf.nextTime & 0x8000;
+      if(kfSize != sizeof(T3DAnimKF))kf.data[1] = 0;
+      kfSize = isLarge ? sizeof(T3DAnimKF) : (sizeof(T3DAnimKF)-2);
+      kf.nextTime &= 0x7FFF;
+
+      if(pass == 0) {
+        res->channelOffsets[kf.channelIdx + 1]++;
+        continue;
+      }
+
+      timeEnd[kf.channelIdx] += (float)kf.nextTime * KF_TIME_TICK;
+      T3DAnimKFResident *kfRes = &res->keyframes[fillIdx[kf.channelIdx]++];
+      kfRes->timeEnd = timeEnd[kf.channelIdx];
+      kfRes->data[0] = kf.data[0];
+      kfRes->data[1] = kf.data[1];
+    }
+
+    if(pass == 0) {
+      for(uint32_t c = 0; c < channelCount; c++) {
+        res->channelOffsets[c+1] += res->channelOffsets[c];
+        fillIdx[c] = res->channelOffsets[c];
+      }
+    }
+  }
+
+  free(timeEnd);
+  free(fillIdx);
+  free(stream);
+
+  residentCacheSize++;
+  residentCache = realloc(residentCache, sizeof(T3DAnimResident*) * residentCacheSize);
+  residentCache[residentCacheSize-1] = res;
+  return res;
+}
+
+static void resident_release(T3DAnimResident *res) {
+  if(--res->refCount != 0)return;
+
+  for(uint32_t i = 0; i < residentCacheSize; i++) {
+    if(residentCache[i] == res) {
+      residentCache[i] = residentCache[--residentCacheSize];
+      break;
+    }
+  }
+  if(residentCacheSize == 0) {
+    free(residentCache);
+    residentCache = NULL;
+  }
+
+  free(res->filePath);
+  free(res->channelOffsets);
+  free(res->keyframes);
+  free(res);
+}
+
 T3DAnim t3d_anim_create(const T3DModel *model, const char *name) {
   T3DChunkAnim* animDef = t3d_model_get_animation(model, name);
   assertf(animDef, "Animation '%s' not found in model", name);
@@ -28,8 +120,29 @@ T3DAnim t3d_anim_create(const T3DModel *model, const char *name) {
     .speed = 1.0f,
     .nextKfSize = sizeof(T3DAnimKF),
     .file = asset_fopen(animDef->filePath, NULL),
+    .resident = NULL,
     .isPlaying = 1,
-    .isLooping = 1
+    .isLooping = 1,
+    .lodPhase = nextLodPhase++,
+  };
+}
+
+T3DAnim t3d_anim_create_resident(const T3DModel *model, const char *name) {
+  T3DChunkAnim* animDef = t3d_model_get_animation(model, name);
+  assertf(animDef, "Animation '%s' not found in model", name);
+
+  return (T3DAnim){
+    .animRef = animDef,
+    .targetsScalar = NULL,
+    .targetsQuat = NULL,
+    .time = 0.0f,
+    .speed = 1.0f,
+    .nextKfSize = sizeof(T3DAnimKF),
+    .file = NULL,
+    .resident = resident_get(animDef),
+    .isPlaying = 1,
+    .isLooping = 1,
+    .lodPhase = nextLodPhase++,
   };
 }
 
@@ -37,12 +150,14 @@ static void rewind_anim(T3DAnim *anim)
 {
   for(int c=0; c<anim->animRef->channelsScalar; c++) {
     anim->targetsScalar[c].base.timeEnd = 0;
+    anim->targetsScalar[c].base.kfIndex = 0;
   }
   for(int c=0; c<anim->animRef->channelsQuat; c++) {
     anim->targetsQuat[c].base.timeEnd = 0;
+    anim->targetsQuat[c].base.kfIndex = 0;
   }
   anim->nextKfSize = sizeof(T3DAnimKF);
-  rewind(anim->file);
+  if(anim->file)rewind(anim->file);
 }
 
 void t3d_anim_attach(T3DAnim *anim, const T3DSkeleton *skeleton) {
@@ -167,8 +282,58 @@ static inline bool load_keyframe(T3DAnim *anim) {
   return true;
 }
 
-void t3d_anim_update(T3DAnim *anim, float deltaTime) {
-  if(!anim->isPlaying)return;
+// Sets the current/next keyframe of a channel in resident mode, 'idx' is the amount of keyframes loaded.
+// This results in the same state as streaming in 'idx' keyframes for that channel.
+static void resident_set_keyframe(T3DAnim *anim, uint32_t channelIdx, T3DAnimTargetBase *targetBase, uint32_t idx) {
+  uint32_t idxOld = targetBase->kfIndex;
+  targetBase->kfIndex = idx;
+  if(idx == 0) {
+    targetBase->timeStart = 0;
+    targetBase->timeEnd = 0;
+    return;
+  }
+
+  const T3DAnimKFResident *kfs = &anim->resident->keyframes[anim->resident->channelOffsets[channelIdx]];
+  const T3DAnimKFResident *kf = &kfs[idx-1];
+  const T3DAnimKFResident *kfPrev = idx > 1 ? &kfs[idx-2] : kf;
+
+  targetBase->timeStart = idx > 1 ? kfPrev->timeEnd : 0.0f;
+  targetBase->timeEnd = kf->timeEnd;
+  if(targetBase->timeEnd == targetBase->timeStart)targetBase->timeStart -= 0.00001f; // avoid zero-div for overlapping keyframes
+
+  // when advancing by one keyframe, the previous 'next' value is still valid
+  bool isNext = idxOld > 0 && idx == idxOld + 1;
+  if(channelIdx < anim->animRef->channelsQuat) {
+    T3DAnimTargetQuat *target = (T3DAnimTargetQuat*)targetBase;
+    if(isNext) {
+      target->kfCurr = target->kfNext;
+    } else {
+      unpack_quat(kfPrev->data[0], kfPrev->data[1], &target->kfCurr);
+    }
+    unpack_quat(kf->data[0], kf->data[1], &target->kfNext);
+  } else {
+    const T3DAnimChannelMapping *channelMap = &anim->animRef->channelMappings[channelIdx];
+    T3DAnimTargetScalar *target = (T3DAnimTargetScalar*)targetBase;
+    target->kfCurr = isNext ? target->kfNext
+      : (float)kfPrev->data[0] * channelMap->quantScale + channelMap->quantOffset;
+    target->kfNext = (float)kf->data[0] * channelMap->quantScale + channelMap->quantOffset;
+  }
+}
+
+void t3d_anim_set_lod(T3DAnim *anim, uint32_t level) {
+  anim->lodLevel = level > T3D_ANIM_LOD_MAX ? T3D_ANIM_LOD_MAX : level;
+}
+
+T3DAnimStats t3d_anim_get_stats() {
+  return animStats;
+}
+
+void t3d_anim_reset_stats() {
+  animStats = (T3DAnimStats){0};
+}
+
+// Moves the time forward, returns the value for the 'changedFlag' of targets, or 0 if it stopped
+static int32_t anim_advance(T3DAnim *anim, float deltaTime) {
   int32_t updateFlag = 1;
   anim->time += deltaTime * anim->speed;
 
@@ -179,22 +344,66 @@ void t3d_anim_update(T3DAnim *anim, float deltaTime) {
 
     if(!anim->isLooping) {
       anim->isPlaying = 0;
-      return;
+      return 0;
     }
   }
+  return updateFlag;
+}
+
+// Loads the keyframes a channel needs at the current time, returns the interpolation factor between them
+static inline float anim_seek_channel(T3DAnim *anim, uint32_t c, T3DAnimTargetBase *target) {
+  if(anim->resident) {
+    const T3DAnimKFResident *kfs = &anim->resident->keyframes[anim->resident->channelOffsets[c]];
+    uint32_t kfCount = anim->resident->channelOffsets[c+1] - anim->resident->channelOffsets[c];
+    uint32_t idx = target->kfIndex;
+    while(idx < kfCount && anim->time >= (idx ? kfs[idx-1].timeEnd : 0.0f))++idx;
+    if(idx != target->kfIndex)resident_set_keyframe(anim, c, target, idx);
+  } else {
+    while(anim->time >= target->timeEnd) {
+      if(!load_keyframe(anim))break;
+    }
+  }
+
+  float timeDiff = target->timeEnd - target->timeStart;
+  return (anim->time - target->timeStart) / timeDiff;
+}
+
+static inline bool bone_mask_test(const uint8_t *boneMask, uint32_t boneIdx) {
+  return boneMask[boneIdx / 8] & (1 << (boneIdx % 8));
+}
+
+void t3d_anim_update(T3DAnim *anim, float deltaTime) {
+  if(!anim->isPlaying)return;
+
+  // at higher LOD levels only every n-th call does any work, with the time of the skipped ones added up
+  anim->lodTime += deltaTime;
+  uint32_t lodFrame = (uint8_t)(anim->lodFrame++ + anim->lodPhase);
+  if(lodFrame & ((1 << anim->lodLevel) - 1)) {
+    animStats.updatesSkipped++;
+    return;
+  }
+  deltaTime = anim->lodTime;
+  anim->lodTime = 0.0f;
+  animStats.updates++;
+
+  int32_t updateFlag = anim_advance(anim, deltaTime);
+  if(!updateFlag)return;
+
+  // skipped channels are still kept in sync when streaming, since keyframes are read in file order
+  const uint8_t *boneMask = anim->lodLevel >= anim->lodMaskLevel ? anim->boneMask : NULL;
 
   uint32_t channelCount = anim->animRef->channelsScalar + anim->animRef->channelsQuat;
   for(uint32_t c=0; c<channelCount; c++)
   {
-    bool isRot = c < anim->animRef->channelsQuat;
-    T3DAnimTargetBase *target = get_base_target(anim, c, isRot);
-
-    while(anim->time >= target->timeEnd) {
-      if(!load_keyframe(anim))break;
+    if(boneMask && !bone_mask_test(boneMask, anim->animRef->channelMappings[c].targetIdx)) {
+      animStats.channelsSkipped++;
+      continue;
     }
+    animStats.channelsEvaluated++;
 
-    float timeDiff = target->timeEnd - target->timeStart;
-    float interp = (anim->time - target->timeStart) / timeDiff;
+    bool isRot = c < anim->animRef->channelsQuat;
+    T3DAnimTargetBase *target = get_base_target(anim, c, isRot);
+    float interp = anim_seek_channel(anim, c, target);
     *target->changedFlag = updateFlag;
 
     if(isRot) {
@@ -208,16 +417,114 @@ void t3d_anim_update(T3DAnim *anim, float deltaTime) {
   }
 }
 
+void t3d_anim_update_blend(T3DAnim *anim, float deltaTime, const T3DSkeleton *skeleton,
+  const uint8_t *boneMask, float weight, bool additive
+) {
+  if(!anim->isPlaying)return;
+  animStats.updates++;
+
+  // time keeps going even without any influence, so the layer stays in sync once it fades in
+  int32_t updateFlag = anim_advance(anim, deltaTime);
+  if(!updateFlag || weight <= 0.0f)return;
+
+  uint32_t channelCount = anim->animRef->channelsScalar + anim->animRef->channelsQuat;
+  for(uint32_t c=0; c<channelCount; c++)
+  {
+    const T3DAnimChannelMapping *channelMap = &anim->animRef->channelMappings[c];
+    if(boneMask && !bone_mask_test(boneMask, channelMap->targetIdx)) {
+      animStats.channelsSkipped++;
+      continue;
+    }
+    animStats.channelsEvaluated++;
+
+    bool isRot = c < anim->animRef->channelsQuat;
+    T3DAnimTargetBase *target = get_base_target(anim, c, isRot);
+    float interp = anim_seek_channel(anim, c, target);
+    *target->changedFlag = updateFlag;
+
+    // additive layers are stored relative to the rest pose of the skeleton
+    const T3DChunkBone *boneRest = &skeleton->skeletonRef->bones[channelMap->targetIdx];
+
+    // inside 't3d_skeleton_blend_layers', start from the rest pose on the first write to a bone
+    T3DBone *bone = &skeleton->bones[channelMap->targetIdx];
+    if(skeleton->blendGen && bone->blendGen != skeleton->blendGen) {
+      memcpy(bone->scale.v, boneRest->scale.v,
+        sizeof(T3DVec3) + sizeof(T3DQuat) + sizeof(T3DVec3) // copy all 3 vectors (SRT) at once
+      );
+      bone->blendGen = skeleton->blendGen;
+    }
+
+    if(isRot) {
+      T3DAnimTargetQuat *t = (T3DAnimTargetQuat*)target;
+      T3DQuat value;
+      t3d_quat_nlerp(&value, &t->kfCurr, &t->kfNext, interp);
+
+      if(additive) {
+        T3DQuat restInv = {{-boneRest->rotation.v[0], -boneRest->rotation.v[1], -boneRest->rotation.v[2], boneRest->rotation.v[3]}};
+        T3DQuat delta, deltaWeighted, identity, base = *t->targetQuat;
+        t3d_quat_mul(&delta, &restInv, &value);
+        t3d_quat_identity(&identity);
+        t3d_quat_nlerp(&deltaWeighted, &identity, &delta, weight);
+        t3d_quat_mul(t->targetQuat, &base, &deltaWeighted);
+      } else if(weight >= 1.0f) {
+        *t->targetQuat = value;
+      } else {
+        t3d_quat_nlerp(t->targetQuat, t->targetQuat, &value, weight);
+      }
+    } else {
+      T3DAnimTargetScalar *t = (T3DAnimTargetScalar*)target;
+      float value = t3d_lerp(t->kfCurr, t->kfNext, interp);
+
+      if(additive) {
+        float rest = channelMap->targetType == T3D_ANIM_TARGET_TRANSLATION
+          ? boneRest->position.v[channelMap->attributeIdx]
+          : boneRest->scale.v[channelMap->attributeIdx];
+        *t->targetScalar += (value - rest) * weight;
+      } else {
+        *t->targetScalar = weight >= 1.0f ? value : t3d_lerp(*t->targetScalar, value, weight);
+      }
+    }
+  }
+}
+
 void t3d_anim_destroy(T3DAnim *anim) {
   if(anim->targetsQuat)free(anim->targetsQuat); // 'targetsScalar' is part of this memory-block
   if(anim->file)fclose(anim->file);
+  if(anim->resident)resident_release(anim->resident);
   anim->targetsQuat = NULL;
   anim->targetsScalar = NULL;
   anim->file = NULL;
+  anim->resident = NULL;
 }
 
 void t3d_anim_set_time(T3DAnim *anim, float time) {
   if(time > anim->animRef->duration)time = anim->animRef->duration;
+  anim->lodTime = 0.0f;
+
+  if(anim->resident && anim->targetsQuat) {
+    // search the first keyframe of each channel that ends after 'time',
+    // this is the same state the update loop would reach by advancing from the start
+    uint32_t channelCount = anim->animRef->channelsScalar + anim->animRef->channelsQuat;
+    for(uint32_t c=0; c<channelCount; c++) {
+      const T3DAnimKFResident *kfs = &anim->resident->keyframes[anim->resident->channelOffsets[c]];
+      uint32_t kfCount = anim->resident->channelOffsets[c+1] - anim->resident->channelOffsets[c];
+
+      uint32_t low = 0, high = kfCount;
+      while(low < high) {
+        uint32_t mid = (low + high) / 2;
+        if(kfs[mid].timeEnd > time) {
+          high = mid;
+        } else {
+          low = mid + 1;
+        }
+      }
+      uint32_t idx = low < kfCount ? low + 1 : kfCount;
+      resident_set_keyframe(anim, c, get_base_target(anim, c, c < anim->animRef->channelsQuat), idx);
+    }
+    anim->time = time;
+    return;
+  }
+
   if(time < anim->time)rewind_anim(anim);
   anim->time = time;
 }
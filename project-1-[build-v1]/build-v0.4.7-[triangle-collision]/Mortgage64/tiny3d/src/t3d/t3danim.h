@@ -18,10 +18,13 @@ extern "C"
 #define T3D_ANIM_TARGET_SCALE_S     2
 #define T3D_ANIM_TARGET_ROTATION    3
 
+#define T3D_ANIM_LOD_MAX 3 // highest LOD level, updates every 8th frame
+
 typedef struct {
   float timeStart;
   float timeEnd;
   int32_t* changedFlag; // flag to increment when target is changed
+  uint32_t kfIndex; // keyframes loaded so far in this channel (resident mode only)
 } T3DAnimTargetBase;
 
 typedef struct {
@@ -38,7 +41,21 @@ typedef struct {
   float kfNext;
 } T3DAnimTargetScalar;
 
+// Keyframe of a resident animation, the stream is decoded into these once and grouped by channel
+typedef struct {
+  float timeEnd; // time (seconds) the channel reaches once this keyframe is loaded
+  uint16_t data[2]; // packed value, same as in the streamed file (scalars only use the first)
+} T3DAnimKFResident;
+
+// Decoded keyframes of an animation, shared by all instances created with 't3d_anim_create_resident'
 typedef struct {
+  char* filePath; // stream-data this was loaded from (owned copy), used to share it
+  uint32_t refCount;
+  uint32_t *channelOffsets; // index of the first keyframe of each channel, 'channelCount+1' entries
+  T3DAnimKFResident *keyframes;
+} T3DAnimResident;
+
+typedef struct T3DAnim {
   T3DChunkAnim *animRef;
   T3DAnimTargetQuat *targetsQuat;
   T3DAnimTargetScalar *targetsScalar;
@@ -46,12 +63,29 @@ typedef struct {
   float speed;
   float time;
 
-  FILE *file;
+  FILE *file; // streaming mode only
+  T3DAnimResident *resident; // resident mode only
   int nextKfSize;
   uint8_t isPlaying;
   uint8_t isLooping;
+
+  // level-of-detail, see 't3d_anim_set_lod'
+  const uint8_t *boneMask; // bones to animate at 'lodMaskLevel' and above, NULL for all
+  float lodTime; // time accumulated in skipped updates
+  uint8_t lodLevel; // updates every '2^lodLevel' frames
+  uint8_t lodMaskLevel;
+  uint8_t lodPhase; // frame offset of the updates, spreads instances with the same level across frames
+  uint8_t lodFrame;
 } T3DAnim;
 
+// Counters of all animation updates, see 't3d_anim_get_stats'
+typedef struct {
+  uint32_t updates; // calls to 't3d_anim_update' that evaluated channels
+  uint32_t updatesSkipped; // calls skipped due to the LOD level
+  uint32_t channelsEvaluated; // channels decoded and interpolated
+  uint32_t channelsSkipped; // channels skipped due to the bone mask
+} T3DAnimStats;
+
 /**
  * Creates an animation instance from a model's animation definition
  * @param model The model to create the animation from
@@ -60,6 +94,22 @@ typedef struct {
  */
 T3DAnim t3d_anim_create(const T3DModel *model, const char* name);
 
+/**
+ * Creates an animation instance that uses resident keyframes instead of streaming them.
+ * The keyframe stream is loaded (and decompressed) only once and decoded into memory,
+ * all instances of the same animation then share it, even across different model instances.
+ * It is freed again once the last instance is destroyed.
+ *
+ * This avoids any file I/O during playback and makes 't3d_anim_set_time' cheap,
+ * at the cost of keeping all keyframes in memory (~8 bytes each).
+ * Useful when the same animation plays on many instances at once (e.g. crowds).
+ *
+ * @param model The model to create the animation from
+ * @param name The name of the animation to create
+ * @return The created animation
+ */
+T3DAnim t3d_anim_create_resident(const T3DModel *model, const char* name);
+
 /**
  * Attaches an animation to a skeleton.
  * @param anim The animation to attach
@@ -107,14 +157,83 @@ void t3d_anim_attach_scale(T3DAnim* anim, uint32_t targetIdx, T3DVec3* target, i
  */
 void t3d_anim_update(T3DAnim* anim, float deltaTime);
 
+/**
+ * Updates an animation and blends the result into the bones it is attached to, instead of overwriting them.
+ * This is the building block of 't3d_skeleton_blend_layers', which should be preferred.
+ * The animation must be attached to 'skeleton'. The LOD update rate of the animation is not used here.
+ *
+ * @param anim animation to update
+ * @param deltaTime time since last update (seconds)
+ * @param skeleton skeleton the animation is attached to, its rest pose is the reference for additive blending
+ * @param boneMask bit 'n%8' of byte 'n/8' set to blend bone 'n', NULL for all bones
+ * @param weight 0.0-1.0, how much the animation replaces (or adds to) the current pose
+ * @param additive if true, the difference of the animation to the rest pose is added on top of the current pose
+ */
+void t3d_anim_update_blend(T3DAnim* anim, float deltaTime, const T3DSkeleton *skeleton,
+  const uint8_t *boneMask, float weight, bool additive
+);
+
 /**
  * Sets the animation to a specific time.
- * Note: this may cause some work internally due to potential DMAs.
+ * Note: in streaming mode, this may cause some work internally due to potential DMAs.
+ * In resident mode, this is a binary search per channel without any I/O.
  * @param anim animation to set time for
  * @param time time in seconds
  */
 void t3d_anim_set_time(T3DAnim* anim, float time);
 
+/**
+ * Sets the level-of-detail of an animation, meant for instances far away from the camera.
+ * At level 'n' the animation only updates every '2^n' frames, the time in between is accumulated,
+ * so the playback speed stays the same, just with less steps.
+ * Each instance gets a different frame offset on creation, so a crowd at the same level
+ * doesn't update all at once in the same frame.
+ *
+ * @param anim animation to set the level for
+ * @param level 0 (every frame) to 'T3D_ANIM_LOD_MAX' (every 8th frame)
+ */
+void t3d_anim_set_lod(T3DAnim* anim, uint32_t level);
+
+/**
+ * Picks a LOD level by distance, each time the distance doubles the update rate halves.
+ * @param distance distance to the camera
+ * @param fullRateDistance distance up to which the animation updates every frame
+ * @return level, see 't3d_anim_set_lod'
+ */
+inline static uint32_t t3d_anim_lod_from_distance(float distance, float fullRateDistance) {
+  uint32_t level = 0;
+  while(level < T3D_ANIM_LOD_MAX && distance >= fullRateDistance) {
+    fullRateDistance *= 2.0f;
+    ++level;
+  }
+  return level;
+}
+
+/**
+ * Limits which bones are animated at higher LOD levels (e.g. skipping fingers and face at a distance).
+ * Channels of bones not in the mask are not evaluated, the bone keeps its last pose.
+ * The mask is not copied and must stay valid, it can be shared by all instances of a model.
+ *
+ * @param anim animation to set the mask for
+ * @param boneMask bit 'n%8' of byte 'n/8' set to animate bone 'n', NULL to animate all bones
+ * @param minLevel LOD level from which on the mask is used, 0 to always use it
+ */
+inline static void t3d_anim_set_bone_mask(T3DAnim* anim, const uint8_t *boneMask, uint32_t minLevel) {
+  anim->boneMask = boneMask;
+  anim->lodMaskLevel = minLevel;
+}
+
+/**
+ * Returns counters of all animation updates since the last reset.
+ * Call 't3d_anim_reset_stats' once per frame to get per-frame values.
+ */
+T3DAnimStats t3d_anim_get_stats();
+
+/**
+ * Resets the counters returned by 't3d_anim_get_stats'.
+ */
+void t3d_anim_reset_stats();
+
 /**
  * Sets the speed of the animation.
  * Note: reverse playback (speed < 0) is currently not supported.
@@ -147,6 +266,7 @@ inline static void t3d_anim_set_looping(T3DAnim* anim, bool loop) {
 
 /**
  * Frees data allocated in the animation struct.
+ * For resident animations, the shared keyframes are freed with the last instance.
  * @param anim
  */
 void t3d_anim_destroy(T3DAnim *anim);
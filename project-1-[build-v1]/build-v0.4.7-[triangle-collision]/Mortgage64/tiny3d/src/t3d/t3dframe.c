@@ -0,0 +1,94 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#include "t3dframe.h"
+
+T3DFrameArena t3d_frame_arena_create(uint32_t size) {
+  size &= ~(T3D_FRAME_ARENA_ALIGN - 1);
+  assertf(size > 0, "Frame arena is too small");
+  return (T3DFrameArena){
+    .buffer = malloc_uncached(size),
+    .size = size,
+  };
+}
+
+// frees the oldest frame, returns false if there is none
+static bool frame_reclaim(T3DFrameArena *arena, bool wait) {
+  if(arena->frameCount == 0)return false;
+  T3DFrameArenaFrame *frame = &arena->frames[arena->frameFirst];
+
+  if(!rspq_syncpoint_check(frame->sync)) {
+    if(!wait)return false;
+    ++arena->stats.waits;
+    rspq_syncpoint_wait(frame->sync);
+  }
+
+  arena->tail = frame->end;
+  arena->stats.usedBytes -= frame->bytes;
+  arena->frameFirst = (arena->frameFirst + 1) % T3D_FRAME_ARENA_MAX_FRAMES;
+  --arena->frameCount;
+  return true;
+}
+
+// returns the bytes needed to place 'size' at the head (incl. padding at the wrap-around), or 0 if it doesn't fit
+static uint32_t frame_fit(const T3DFrameArena *arena, uint32_t size) {
+  if(arena->stats.usedBytes == 0)return size <= arena->size ? size : 0;
+  if(arena->head > arena->tail) {
+    if(arena->size - arena->head >= size)return size;
+    if(arena->tail >= size)return (arena->size - arena->head) + size;
+    return 0;
+  }
+  return (arena->tail - arena->head >= size) ? size : 0;
+}
+
+void* t3d_frame_arena_alloc(T3DFrameArena *arena, uint32_t size) {
+  size = (size + T3D_FRAME_ARENA_ALIGN - 1) & ~(T3D_FRAME_ARENA_ALIGN - 1);
+
+  uint32_t needed;
+  while((needed = frame_fit(arena, size)) == 0) {
+    bool freed = frame_reclaim(arena, true);
+    assertf(freed, "Frame arena too small: %lu bytes in this frame, %lu requested (size: %lu)",
+      arena->stats.frameBytes, size, arena->size);
+  }
+
+  if(arena->stats.usedBytes == 0)arena->head = arena->tail = 0;
+  if(needed != size)arena->head = 0; // wrapped around, the rest at the end is padding
+  void *res = arena->buffer + arena->head;
+  arena->head += size;
+  if(arena->head == arena->size)arena->head = 0;
+
+  arena->stats.usedBytes += needed;
+  arena->stats.frameBytes += needed;
+  if(arena->stats.usedBytes > arena->stats.highWater)arena->stats.highWater = arena->stats.usedBytes;
+  if(arena->stats.frameBytes > arena->stats.frameHighWater)arena->stats.frameHighWater = arena->stats.frameBytes;
+  return res;
+}
+
+void t3d_frame_arena_next_frame(T3DFrameArena *arena) {
+  while(frame_reclaim(arena, false)) {}
+
+  if(arena->stats.frameBytes != 0) {
+    if(arena->frameCount == T3D_FRAME_ARENA_MAX_FRAMES)frame_reclaim(arena, true);
+
+    uint32_t idx = (arena->frameFirst + arena->frameCount) % T3D_FRAME_ARENA_MAX_FRAMES;
+    arena->frames[idx] = (T3DFrameArenaFrame){
+      .sync = rspq_syncpoint_new(),
+      .end = arena->head,
+      .bytes = arena->stats.frameBytes,
+    };
+    ++arena->frameCount;
+  }
+  arena->stats.frameBytes = 0;
+}
+
+void t3d_frame_arena_destroy(T3DFrameArena *arena) {
+  if(arena->buffer == NULL)return;
+
+  // the current frame has no syncpoint yet, so wait for everything issued so far
+  rspq_syncpoint_wait(rspq_syncpoint_new());
+  free_uncached(arena->buffer);
+  arena->buffer = NULL;
+  arena->frameCount = 0;
+  arena->stats.usedBytes = 0;
+}
@@ -0,0 +1,99 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#ifndef TINY3D_T3DFRAME_H
+#define TINY3D_T3DFRAME_H
+
+#include "t3d.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define T3D_FRAME_ARENA_MAX_FRAMES 4 // frames that can be in flight at once before waiting for the RSP
+#define T3D_FRAME_ARENA_ALIGN 16
+
+typedef struct {
+  rspq_syncpoint_t sync; // reached once the RSP is done with all commands of the frame
+  uint32_t end; // write position after the frame
+  uint32_t bytes; // bytes used by the frame, incl. padding at the wrap-around
+} T3DFrameArenaFrame;
+
+typedef struct {
+  uint32_t frameBytes; // bytes allocated in the current frame so far
+  uint32_t frameHighWater; // max. bytes allocated in a single frame
+  uint32_t usedBytes; // bytes in use by all frames still in flight
+  uint32_t highWater; // max. of 'usedBytes', use this to size the arena
+  uint32_t waits; // how often the CPU had to wait for the RSP to free up space
+} T3DFrameArenaStats;
+
+/**
+ * Ring-buffer allocator for data that is only needed for a single frame (matrices, bone palettes, vertices).
+ * Allocations are never freed individually, instead the memory of an entire frame is reused
+ * once the RSP has processed all commands issued until the end of that frame.
+ * Memory is uncached, so data can be written directly without any cache flushes.
+ */
+typedef struct {
+  uint8_t *buffer;
+  uint32_t size;
+  uint32_t head; // next free byte
+  uint32_t tail; // first byte still in use by an older frame
+  T3DFrameArenaFrame frames[T3D_FRAME_ARENA_MAX_FRAMES]; // finished frames still in flight, oldest first
+  uint8_t frameFirst;
+  uint8_t frameCount;
+  T3DFrameArenaStats stats;
+} T3DFrameArena;
+
+/**
+ * Creates a frame arena.
+ * The size should fit all allocations of the frames in flight, see 'stats.highWater'.
+ * If it runs full, allocations will wait for the RSP instead of failing.
+ *
+ * @param size size in bytes
+ * @return arena, free it with 't3d_frame_arena_destroy'
+ */
+T3DFrameArena t3d_frame_arena_create(uint32_t size);
+
+/**
+ * Allocates memory for the current frame, this is only valid until the end of the frame.
+ * The returned pointer is uncached and aligned to 'T3D_FRAME_ARENA_ALIGN' bytes.
+ * Note: a single frame can never use more than the entire arena.
+ *
+ * @param arena arena
+ * @param size size in bytes
+ * @return pointer to the memory
+ */
+void* t3d_frame_arena_alloc(T3DFrameArena *arena, uint32_t size);
+
+/**
+ * Allocates fixed-point matrices for the current frame, e.g. for 't3d_matrix_set'.
+ * @param arena arena
+ * @param count number of matrices
+ * @return pointer to the first matrix
+ */
+static inline T3DMat4FP* t3d_frame_arena_alloc_mat4fp(T3DFrameArena *arena, uint32_t count) {
+  return (T3DMat4FP*)t3d_frame_arena_alloc(arena, sizeof(T3DMat4FP) * count);
+}
+
+/**
+ * Ends the current frame and starts a new one.
+ * Call this once per frame, after all commands using memory of the frame were issued (e.g. after 'rdpq_detach_show').
+ * Memory of older frames the RSP is done with is reclaimed here, without waiting.
+ *
+ * @param arena arena
+ */
+void t3d_frame_arena_next_frame(T3DFrameArena *arena);
+
+/**
+ * Frees the arena, this waits until the RSP no longer uses any of its memory.
+ * @param arena
+ */
+void t3d_frame_arena_destroy(T3DFrameArena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TINY3D_T3DFRAME_H
@@ -287,6 +287,65 @@ void t3d_mat4fp_from_srt(T3DMat4FP *mat, const float scale[3], const float rotQu
   t3d_mat4_to_fixed_3x4(mat, &matF);
 }
 
+void t3d_mat4fp_from_srt_mul(T3DMat4FP *matOutFP, T3DMat4 *matOut, const T3DMat4 *parent, const T3DSRT *srt)
+{
+  const float *quat = srt->rotation.v;
+  const float *scale = srt->scale.v;
+  float qxx = quat[0] * quat[0];
+  float qyy = quat[1] * quat[1];
+  float qzz = quat[2] * quat[2];
+  float qxz = quat[0] * quat[2];
+  float qxy = quat[0] * quat[1];
+  float qyz = quat[1] * quat[2];
+  float qwx = quat[3] * quat[0];
+  float qwy = quat[3] * quat[1];
+  float qwz = quat[3] * quat[2];
+
+  // local matrix without the last row, which is always {0,0,0,1}
+  float local[4][3] = {
+    {(1.0f - 2.0f * (qyy + qzz)) * scale[0],        2.0f * (qxy + qwz)  * scale[0],        2.0f * (qxz - qwy)  * scale[0]},
+    {       2.0f * (qxy - qwz)  * scale[1], (1.0f - 2.0f * (qxx + qzz)) * scale[1],        2.0f * (qyz + qwx)  * scale[1]},
+    {       2.0f * (qxz + qwy)  * scale[2],        2.0f * (qyz - qwx)  * scale[2], (1.0f - 2.0f * (qxx + qyy)) * scale[2]},
+    {srt->position.v[0], srt->position.v[1], srt->position.v[2]}
+  };
+
+  if(parent) {
+    // 3x4 multiplication, the local matrix has 0 in the last row for rotation/scale and 1 for translation
+    for(uint32_t j=0; j<4; ++j) {
+      for(uint32_t i=0; i<3; ++i) {
+        matOut->m[j][i] = parent->m[0][i] * local[j][0] +
+                          parent->m[1][i] * local[j][1] +
+                          parent->m[2][i] * local[j][2];
+      }
+      matOut->m[j][3] = 0.0f;
+    }
+    matOut->m[3][0] += parent->m[3][0];
+    matOut->m[3][1] += parent->m[3][1];
+    matOut->m[3][2] += parent->m[3][2];
+    matOut->m[3][3] = 1.0f;
+  } else {
+    for(uint32_t j=0; j<4; ++j) {
+      matOut->m[j][0] = local[j][0];
+      matOut->m[j][1] = local[j][1];
+      matOut->m[j][2] = local[j][2];
+      matOut->m[j][3] = j == 3 ? 1.0f : 0.0f;
+    }
+  }
+
+  t3d_mat4_to_fixed_3x4(matOutFP, matOut);
+}
+
+void t3d_mat4fp_from_srt_hierarchy(
+  T3DMat4FP *matsOutFP, T3DMat4 *matsOut,
+  const T3DSRT *srt, const uint16_t *parentIdx, uint32_t count
+) {
+  for(uint32_t i=0; i<count; ++i) {
+    uint16_t parent = parentIdx[i];
+    assertf(parent == 0xFFFF || parent < i, "Parent %d of transform %d must come before it", parent, (int)i);
+    t3d_mat4fp_from_srt_mul(&matsOutFP[i], &matsOut[i], parent == 0xFFFF ? NULL : &matsOut[parent], &srt[i]);
+  }
+}
+
 void t3d_mat4_rotate(T3DMat4 *mat, const T3DVec3* axis, float angleRad)
 {
   float s, c;
@@ -38,6 +38,13 @@ typedef struct {
   T3DVec4 planes[6];
 } T3DFrustum;
 
+// Scale, rotation and translation of a transform, same layout as in 'T3DBone'
+typedef struct {
+  T3DVec3 scale;
+  T3DQuat rotation;
+  T3DVec3 position;
+} T3DSRT;
+
 /// @brief Converts a 16.16 fixed-point number to a float
 inline static float s1616_to_float(int16_t partI, uint16_t partF)
 {
@@ -356,6 +363,33 @@ void t3d_mat4fp_from_srt_euler(T3DMat4FP *mat, const float scale[3], const float
  */
 void t3d_mat4fp_from_srt(T3DMat4FP *mat, const float scale[3], const float rotQuat[4], const float translate[3]);
 
+/**
+ * Constructs a matrix from an SRT transform and multiplies it with a parent matrix ('parent * srt').
+ * This is the same as 't3d_mat4_from_srt' + 't3d_mat4_mul' + 't3d_mat4_to_fixed' with identical results,
+ * but skips the parts of the math that are known to be 0/1 for affine matrices.
+ *
+ * @param matOutFP result as a fixed-point matrix
+ * @param matOut result as a float matrix (needed as the parent of other transforms)
+ * @param parent parent matrix, must be affine (last row {0,0,0,1}), NULL if it has no parent
+ * @param srt transform
+ */
+void t3d_mat4fp_from_srt_mul(T3DMat4FP *matOutFP, T3DMat4 *matOut, const T3DMat4 *parent, const T3DSRT *srt);
+
+/**
+ * Constructs a fixed-point matrix palette for a hierarchy of SRT transforms (e.g. bones) in one pass.
+ * Each transform is relative to its parent, parents must come before their children.
+ *
+ * @param matsOutFP resulting fixed-point matrices, 'count' entries
+ * @param matsOut resulting float matrices (model space), 'count' entries
+ * @param srt transforms relative to the parent, 'count' entries
+ * @param parentIdx index of the parent for each transform, 0xFFFF for roots
+ * @param count number of transforms
+ */
+void t3d_mat4fp_from_srt_hierarchy(
+  T3DMat4FP *matsOutFP, T3DMat4 *matsOut,
+  const T3DSRT *srt, const uint16_t *parentIdx, uint32_t count
+);
+
 /**
  * @brief Sets a value in a fixed-point matrix
  * @param mat matrix to be changed
@@ -5,7 +5,7 @@
 
 #include "t3dmodel.h"
 
-#define T3DM_VERSION 0x03
+#define T3DM_VERSION 0x04
 
 static inline void* patch_pointer(void *ptr, uint32_t offset) {
   return (void*)(offset + (int32_t)ptr);
@@ -23,83 +23,247 @@ typedef struct {
   uint16_t objectPtr;
 } T3DBvhData;
 
+#define TEX_CACHE_INVALID      (-1)
+#define TEX_CACHE_MIN_CAPACITY 32
+
 typedef struct {
   uint32_t hash;
-  sprite_t *texture;
-  uint32_t count;
+  sprite_t *texture; // NULL if the entry is unused
+  uint32_t size; // bytes used by the sprite
+  uint32_t refCount; // materials using it, unreferenced textures are in the LRU list
+  int32_t next; // next entry in the same bucket (or in the free-list)
+  int32_t lruPrev;
+  int32_t lruNext;
 } T3DTextureEntry;
 
-static uint32_t textureCacheSize = 0;
-static T3DTextureEntry *textureCache = NULL;
+// Textures shared across all models, looked up by the hash of their path.
+// Unreferenced textures stay loaded (oldest evicted first) as long as the budget allows it.
+static struct {
+  T3DTextureEntry *entries;
+  int32_t *buckets; // same count as 'capacity', always a power of two
+  uint32_t capacity;
+  uint32_t count;
+  int32_t freeHead;
+  int32_t lruHead; // least recently used
+  int32_t lruTail;
+  uint32_t bytesUsed;
+  uint32_t bytesBudget;
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t evictions;
+} texCache = {
+  .freeHead = TEX_CACHE_INVALID,
+  .lruHead = TEX_CACHE_INVALID,
+  .lruTail = TEX_CACHE_INVALID,
+};
+
+// Blocks recorded by 't3d_model_draw_cached', kept outside the model as its header is part of the file
+typedef struct {
+  const T3DModel *model;
+  rspq_block_t *block;
+  // all inputs that affect the recorded commands:
+  T3DModelDrawConf conf;
+  uint16_t *objKeys; // per object: 0 = filtered, otherwise LOD + 1 (only with 'filterCb' or 'lodConf')
+  uint32_t objCount;
+} T3DDrawCacheEntry;
+
+static T3DDrawCacheEntry *drawCache = NULL;
+static uint32_t drawCacheCount = 0;
+
 static T3DModelState dummyState;
 
-static sprite_t* texture_cache_get(uint32_t hash) {
-  for(uint32_t i = 0; i < textureCacheSize; i++) {
-    if(textureCache[i].hash == hash) {
-      textureCache[i].count++;
-      return textureCache[i].texture;
-    }
+// same as 'stringHash' in the gltf_importer, used for 'T3DMaterialTexture.textureHash'
+static uint32_t texture_path_hash(const char *path) {
+  uint32_t hash = 0x7E81C0E9;
+  for(; *path; ++path) {
+    hash = (hash >> 8) ^ (hash << 24) ^ (uint32_t)(int32_t)(int8_t)*path;
   }
-  return NULL;
+  return hash;
 }
 
-static void texture_cache_add(uint32_t hash, sprite_t *texture) {
-  T3DTextureEntry *cacheEntry = NULL;
-  for(uint32_t i = 0; i < textureCacheSize; i++) {
-    if(textureCache[i].hash == 0) {
-      cacheEntry = &textureCache[i];
-      break;
-    }
+static inline uint32_t texture_cache_bucket(uint32_t hash) {
+  return (hash ^ (hash >> 16)) & (texCache.capacity - 1);
+}
+
+static int32_t texture_cache_find(uint32_t hash) {
+  if(texCache.count == 0)return TEX_CACHE_INVALID;
+  int32_t idx = texCache.buckets[texture_cache_bucket(hash)];
+  while(idx != TEX_CACHE_INVALID && texCache.entries[idx].hash != hash) {
+    idx = texCache.entries[idx].next;
   }
+  return idx;
+}
 
-  if(cacheEntry == NULL) {
-    textureCacheSize++;
-    if(textureCache == NULL) {
-      textureCache = malloc(sizeof(T3DTextureEntry));
-    } else {
-      textureCache = realloc(textureCache, sizeof(T3DTextureEntry) * textureCacheSize);
-    }
-    cacheEntry = &textureCache[textureCacheSize-1];
+static void texture_cache_lru_remove(int32_t idx) {
+  T3DTextureEntry *entry = &texCache.entries[idx];
+  if(entry->lruPrev != TEX_CACHE_INVALID)texCache.entries[entry->lruPrev].lruNext = entry->lruNext;
+  else texCache.lruHead = entry->lruNext;
+  if(entry->lruNext != TEX_CACHE_INVALID)texCache.entries[entry->lruNext].lruPrev = entry->lruPrev;
+  else texCache.lruTail = entry->lruPrev;
+}
+
+static void texture_cache_lru_push(int32_t idx) {
+  T3DTextureEntry *entry = &texCache.entries[idx];
+  entry->lruPrev = texCache.lruTail;
+  entry->lruNext = TEX_CACHE_INVALID;
+  if(texCache.lruTail != TEX_CACHE_INVALID)texCache.entries[texCache.lruTail].lruNext = idx;
+  else texCache.lruHead = idx;
+  texCache.lruTail = idx;
+}
+
+static void texture_cache_grow() {
+  uint32_t oldCapacity = texCache.capacity;
+  texCache.capacity = oldCapacity ? oldCapacity * 2 : TEX_CACHE_MIN_CAPACITY;
+  texCache.entries = realloc(texCache.entries, sizeof(T3DTextureEntry) * texCache.capacity);
+  free(texCache.buckets);
+  texCache.buckets = malloc(sizeof(int32_t) * texCache.capacity);
+
+  for(uint32_t i = 0; i < texCache.capacity; i++) {
+    texCache.buckets[i] = TEX_CACHE_INVALID;
   }
+  for(uint32_t i = oldCapacity; i < texCache.capacity; i++) {
+    texCache.entries[i].texture = NULL;
+    texCache.entries[i].next = i+1 < texCache.capacity ? (int32_t)(i+1) : texCache.freeHead;
+  }
+  texCache.freeHead = oldCapacity;
 
-  cacheEntry->hash = hash;
-  cacheEntry->texture = texture;
-  cacheEntry->count = 1;
+  // re-hash existing entries, the bucket count changed
+  for(uint32_t i = 0; i < oldCapacity; i++) {
+    uint32_t bucket = texture_cache_bucket(texCache.entries[i].hash);
+    texCache.entries[i].next = texCache.buckets[bucket];
+    texCache.buckets[bucket] = i;
+  }
 }
 
-static void texture_cache_free(uint32_t hash)
-{
-  for(uint32_t i = 0; i < textureCacheSize; i++) {
-    if(textureCache[i].hash == hash) {
-      textureCache[i].count--;
-      //debugf("Free Texture: %08lX, count=%lu\n", hash, textureCache[i].count);
-      if(textureCache[i].count == 0) {
-        sprite_free(textureCache[i].texture);
-        textureCache[i].hash = 0;
-      }
-      return;
-    }
+static int32_t texture_cache_insert(uint32_t hash, sprite_t *texture, uint32_t size) {
+  if(texCache.freeHead == TEX_CACHE_INVALID)texture_cache_grow();
+
+  int32_t idx = texCache.freeHead;
+  T3DTextureEntry *entry = &texCache.entries[idx];
+  texCache.freeHead = entry->next;
+
+  uint32_t bucket = texture_cache_bucket(hash);
+  *entry = (T3DTextureEntry){
+    .hash = hash,
+    .texture = texture,
+    .size = size,
+    .refCount = 0,
+    .next = texCache.buckets[bucket],
+    .lruPrev = TEX_CACHE_INVALID,
+    .lruNext = TEX_CACHE_INVALID,
+  };
+  texCache.buckets[bucket] = idx;
+  texCache.bytesUsed += size;
+  texCache.count++;
+  return idx;
+}
+
+// frees an unreferenced texture, releasing all memory of the cache once it is empty
+static void texture_cache_remove(int32_t idx) {
+  T3DTextureEntry *entry = &texCache.entries[idx];
+  texture_cache_lru_remove(idx);
+
+  int32_t *link = &texCache.buckets[texture_cache_bucket(entry->hash)];
+  while(*link != idx)link = &texCache.entries[*link].next;
+  *link = entry->next;
+
+  //debugf("Free Texture: %08lX\n", entry->hash);
+  sprite_free(entry->texture);
+  texCache.bytesUsed -= entry->size;
+  entry->texture = NULL;
+  entry->next = texCache.freeHead;
+  texCache.freeHead = idx;
+
+  if(--texCache.count == 0) {
+    free(texCache.entries);
+    free(texCache.buckets);
+    texCache.entries = NULL;
+    texCache.buckets = NULL;
+    texCache.capacity = 0;
+    texCache.freeHead = TEX_CACHE_INVALID;
+  }
+}
+
+static void texture_cache_evict() {
+  while(texCache.bytesUsed > texCache.bytesBudget && texCache.lruHead != TEX_CACHE_INVALID) {
+    texture_cache_remove(texCache.lruHead);
+    texCache.evictions++;
   }
 }
 
-static void texture_cache_free_mem()
+// returns the index of a texture, loading it if needed (unreferenced and in the LRU list if new)
+static int32_t texture_cache_load(uint32_t hash, const char *path) {
+  int32_t idx = texture_cache_find(hash);
+  if(idx != TEX_CACHE_INVALID) {
+    texCache.hits++;
+    return idx;
+  }
+
+  //debugf("Not in cache, load %s (%08lX)\n", path, hash);
+  int size = 0;
+  void *buff = asset_load(path, &size);
+  sprite_t *texture = sprite_load_buf(buff, size);
+  texture->flags |= SPRITE_FLAGS_OWNEDBUFFER;
+
+  texCache.misses++;
+  idx = texture_cache_insert(hash, texture, size);
+  texture_cache_lru_push(idx);
+  return idx;
+}
+
+static sprite_t* texture_cache_acquire(uint32_t hash, const char *path) {
+  int32_t idx = texture_cache_load(hash, path);
+  T3DTextureEntry *entry = &texCache.entries[idx];
+  if(entry->refCount++ == 0)texture_cache_lru_remove(idx);
+  texture_cache_evict(); // a new texture may have pushed the cache over budget
+  return texCache.entries[idx].texture;
+}
+
+static void texture_cache_release(uint32_t hash)
 {
-  uint32_t emptyEntries = 0;
+  int32_t idx = texture_cache_find(hash);
+  if(idx == TEX_CACHE_INVALID)return;
 
-  for(uint32_t i = 0; i < textureCacheSize; i++) {
-    if(textureCache[i].hash == 0) {
-      emptyEntries++;
-    }
+  //debugf("Release Texture: %08lX, count=%lu\n", hash, texCache.entries[idx].refCount);
+  if(--texCache.entries[idx].refCount == 0) {
+    texture_cache_lru_push(idx);
+    texture_cache_evict();
   }
+}
 
-  if(textureCache && emptyEntries == textureCacheSize)
-  {
-    free(textureCache);
-    textureCache = NULL;
-    textureCacheSize = 0;
+void t3d_texture_cache_set_budget(uint32_t bytes) {
+  texCache.bytesBudget = bytes;
+  texture_cache_evict();
+}
+
+void t3d_texture_prefetch(const char *path) {
+  int32_t idx = texture_cache_load(texture_path_hash(path), path);
+  // refresh its position if it is unreferenced, so it's the last one to be evicted
+  if(texCache.entries[idx].refCount == 0) {
+    texture_cache_lru_remove(idx);
+    texture_cache_lru_push(idx);
+  }
+  texture_cache_evict();
+}
+
+void t3d_texture_cache_flush() {
+  while(texCache.lruHead != TEX_CACHE_INVALID) {
+    texture_cache_remove(texCache.lruHead);
+    texCache.evictions++;
   }
 }
 
+T3DTextureCacheStats t3d_texture_cache_get_stats() {
+  return (T3DTextureCacheStats){
+    .hits = texCache.hits,
+    .misses = texCache.misses,
+    .evictions = texCache.evictions,
+    .textureCount = texCache.count,
+    .bytesUsed = texCache.bytesUsed,
+    .bytesBudget = texCache.bytesBudget,
+  };
+}
+
 static void set_texture(T3DMaterial *mat, rdpq_tile_t tile, T3DModelDrawConf *conf)
 {
   T3DMaterialTexture *tex = tile == TILE0 ? &mat->textureA : &mat->textureB;
@@ -107,14 +271,7 @@ static void set_texture(T3DMaterial *mat, rdpq_tile_t tile, T3DModelDrawConf *co
   {
     //debugf("Load Texture: %s (%08lX)\n", tex->texPath, tex->textureHash);
     if(tex->texPath && !tex->texture) {
-      tex->texture = texture_cache_get(tex->textureHash);
-      if(tex->texture == NULL) {
-        //debugf("Not in cache, load %s (%08lX)\n", tex->texPath, tex->textureHash);
-        tex->texture = sprite_load(tex->texPath);
-        //const char* formatName = tex_format_name(sprite_get_format(mat->texture));
-        //debugf(" -> %s\n", formatName);
-        texture_cache_add(tex->textureHash, tex->texture);
-      }
+      tex->texture = texture_cache_acquire(tex->textureHash, tex->texPath);
     }
 
     rdpq_texparms_t texParam = (rdpq_texparms_t){};
@@ -182,14 +339,34 @@ static bool handle_bone_matrix(const T3DObjectPart *part, const T3DMat4FP* matSt
   return hadMatrixPush;
 }
 
+static void patch_parts(T3DObjectPart *parts, uint32_t numParts, void* basePtrIndices, void* basePtrVertices)
+{
+  for(uint32_t j = 0; j < numParts; j++) {
+    T3DObjectPart *part = &parts[j];
+    part->indices = patch_pointer(part->indices, (uint32_t)basePtrIndices);
+    part->vert = patch_pointer(part->vert, (uint32_t)basePtrVertices);
+
+    uint8_t *stripPtr = align_pointer(part->indices + part->numIndices, 8);
+    for(int s=0; s<4; ++s) {
+      if(part->numStripIndices[s] == 0)break;
+      t3d_indexbuffer_convert((int16_t*)stripPtr, part->numStripIndices[s]);
+      stripPtr = (uint8_t*)align_pointer(stripPtr + part->numStripIndices[s]*2, 8);
+    }
+  }
+}
+
 T3DModel *t3d_model_load(const char *path) {
   int size = 0;
-  T3DModel* model = asset_load(path, &size);
+  void* buffer = asset_load(path, &size);
+  assertf(memcmp(buffer, "T3M", 3) == 0, "Invalid T3D model file: %s", path);
+  return t3d_model_load_buffer(buffer, size);
+}
+
+T3DModel *t3d_model_load_buffer(void *buffer, uint32_t size) {
+  T3DModel* model = (T3DModel*)buffer;
   int32_t ptrOffset = (int32_t)(void*)model;
 
-  if(memcmp(model->magic, "T3M", 3) != 0) {
-    assertf(false, "Invalid T3D model file: %s", path);
-  }
+  assertf(memcmp(model->magic, "T3M", 3) == 0, "Invalid T3D model data");
   assertf(model->magic[3] == T3DM_VERSION,
     "Invalid T3D model version: %d != %d\n"
     "Please make a clean build of t3d and your project",
@@ -214,17 +391,12 @@ T3DModel *t3d_model_load(const char *path) {
       uint32_t matIdx = model->chunkIdxMaterials + (uint32_t)obj->material;
       obj->material = (T3DMaterial*)((char*)model + (model->chunkOffsets[matIdx].offset & 0xFFFFFF));
 
-      for(uint32_t j = 0; j < obj->numParts; j++) {
-        T3DObjectPart *part = &obj->parts[j];
-        part->indices = patch_pointer(part->indices, (uint32_t)basePtrIndices);
-        part->vert = patch_pointer(part->vert, (uint32_t)basePtrVertices);
+      patch_parts(obj->parts, obj->numParts, basePtrIndices, basePtrVertices);
 
-        uint8_t *stripPtr = align_pointer(part->indices + part->numIndices, 8);
-        for(int s=0; s<4; ++s) {
-          if(part->numStripIndices[s] == 0)break;
-          t3d_indexbuffer_convert((int16_t*)stripPtr, part->numStripIndices[s]);
-          stripPtr = (uint8_t*)align_pointer(stripPtr + part->numStripIndices[s]*2, 8);
-        }
+      T3DObjectLod *lods = t3d_model_object_get_lods(obj);
+      for(uint32_t l = 0; l < obj->lodCount; l++) {
+        lods[l].parts = patch_pointer(lods[l].parts, (uint32_t)obj);
+        patch_parts(lods[l].parts, lods[l].numParts, basePtrIndices, basePtrVertices);
       }
     }
 
@@ -250,6 +422,14 @@ T3DModel *t3d_model_load(const char *path) {
       anim->filePath = patch_pointer(anim->filePath, (uint32_t)model->stringTablePtr);
     }
 
+    if(chunkType == T3D_CHUNK_TYPE_MORPH) {
+      T3DChunkMorph *morph = (T3DChunkMorph*)((char*)model + offset);
+      morph->object = t3d_model_get_object_by_index(model, (uint32_t)morph->object);
+      for(int t = 0; t < morph->targetCount; t++) {
+        morph->targets[t].name = patch_pointer(morph->targets[t].name, (uint32_t)model->stringTablePtr);
+      }
+    }
+
     if(chunkType == T3D_CHUNK_TYPE_BVH) {
       // node leafs are stored as indices to the objects, we convert that to an relative address
       // to the actual object, shifted by 2 since it's 4 byte aligned (and nodes use 16bit indices)
@@ -286,22 +466,127 @@ void t3d_model_draw_custom(const T3DModel* model, T3DModelDrawConf conf)
     if(it.object->material) {
       t3d_model_draw_material(it.object->material, &state);
     }
-    t3d_model_draw_object(it.object, conf.matrices);
+
+    if(conf.lodConf && it.object->lodCount) {
+      uint32_t lod = t3d_model_object_select_lod(it.object, conf.lodConf);
+      t3d_model_draw_object_lod(it.object, lod, conf.matrices);
+    } else {
+      t3d_model_draw_object(it.object, conf.matrices);
+    }
   }
 
   if(state.lastVertFXFunc != T3D_VERTEX_FX_NONE)t3d_state_set_vertex_fx(T3D_VERTEX_FX_NONE, 0, 0);
 }
 
-void t3d_model_draw_object(const T3DObject *object, const T3DMat4FP *boneMatrices)
+// same decisions as in 't3d_model_draw_custom', the rest of the recording only depends on the model
+static uint16_t draw_cache_get_obj_key(const T3DObject *object, const T3DModelDrawConf *conf)
+{
+  if(conf->filterCb && !conf->filterCb(conf->userData, object))return 0;
+  if(conf->lodConf && object->lodCount) {
+    return 1 + t3d_model_object_select_lod(object, conf->lodConf);
+  }
+  return 1;
+}
+
+static bool draw_cache_matches(const T3DDrawCacheEntry *entry, const T3DModel *model, const T3DModelDrawConf *conf)
+{
+  if(entry->conf.userData != conf->userData || entry->conf.tileCb != conf->tileCb ||
+     entry->conf.filterCb != conf->filterCb || entry->conf.dynTextureCb != conf->dynTextureCb ||
+     entry->conf.matrices != conf->matrices || entry->conf.lodConf != conf->lodConf) {
+    return false;
+  }
+  if(!conf->filterCb && !conf->lodConf)return true;
+
+  uint32_t i = 0;
+  T3DModelIter it = t3d_model_iter_create(model, T3D_CHUNK_TYPE_OBJECT);
+  while(t3d_model_iter_next(&it)) {
+    if(i >= entry->objCount || entry->objKeys[i++] != draw_cache_get_obj_key(it.object, conf))return false;
+  }
+  return i == entry->objCount;
+}
+
+static void draw_cache_set_key(T3DDrawCacheEntry *entry, const T3DModel *model, const T3DModelDrawConf *conf)
+{
+  entry->conf = *conf;
+  entry->objCount = 0;
+  if(!conf->filterCb && !conf->lodConf)return;
+
+  T3DModelIter it = t3d_model_iter_create(model, T3D_CHUNK_TYPE_OBJECT);
+  while(t3d_model_iter_next(&it)) {
+    entry->objKeys = realloc(entry->objKeys, sizeof(uint16_t) * (entry->objCount + 1));
+    entry->objKeys[entry->objCount++] = draw_cache_get_obj_key(it.object, conf);
+  }
+}
+
+static T3DDrawCacheEntry* draw_cache_find(const T3DModel *model) {
+  for(uint32_t i = 0; i < drawCacheCount; i++) {
+    if(drawCache[i].model == model)return &drawCache[i];
+  }
+  return NULL;
+}
+
+// frees the block once both RSP and RDP are done with it, it may have been run in the current frame
+static void draw_cache_free_block(void *block) {
+  rspq_block_free((rspq_block_t*)block);
+}
+
+void t3d_model_draw_cached(const T3DModel* model, T3DModelDrawConf conf)
+{
+  T3DDrawCacheEntry *entry = draw_cache_find(model);
+
+  if(!entry) {
+    drawCache = realloc(drawCache, sizeof(T3DDrawCacheEntry) * (drawCacheCount + 1));
+    entry = &drawCache[drawCacheCount++];
+    entry->model = model;
+    entry->block = NULL;
+    entry->objKeys = NULL;
+    entry->objCount = 0;
+  }
+
+  if(!entry->block || !draw_cache_matches(entry, model, &conf)) {
+    if(entry->block)rdpq_call_deferred(draw_cache_free_block, entry->block);
+    rspq_block_begin();
+      t3d_model_draw_custom(model, conf);
+    entry->block = rspq_block_end();
+    draw_cache_set_key(entry, model, &conf);
+  }
+
+  rspq_block_run(entry->block);
+}
+
+void t3d_model_draw_cached_invalidate(const T3DModel* model) {
+  T3DDrawCacheEntry *entry = draw_cache_find(model);
+  if(entry && entry->block) {
+    rdpq_call_deferred(draw_cache_free_block, entry->block);
+    entry->block = NULL;
+  }
+}
+
+// called when freeing a model, at this point the RSP must no longer use it anyway
+static void draw_cache_remove(const T3DModel *model) {
+  T3DDrawCacheEntry *entry = draw_cache_find(model);
+  if(!entry)return;
+
+  if(entry->block)rspq_block_free(entry->block);
+  free(entry->objKeys);
+  *entry = drawCache[--drawCacheCount];
+  if(drawCacheCount == 0) {
+    free(drawCache);
+    drawCache = NULL;
+  }
+}
+
+// 'vertOffset' is added to the vertex pointer of each part, used to redirect loads into a copy of the vertices
+static void draw_parts(const T3DObjectPart *parts, uint32_t numParts, const T3DMat4FP *boneMatrices, int32_t vertOffset)
 {
   bool hadMatrixPush = false;
-  for(uint32_t p = 0; p < object->numParts; p++)
+  for(uint32_t p = 0; p < numParts; p++)
   {
-    const T3DObjectPart *part = &object->parts[p];
+    const T3DObjectPart *part = &parts[p];
     hadMatrixPush = handle_bone_matrix(part, boneMatrices, hadMatrixPush);
 
     // load vertices, this will already do T&L (so matrices/fog/lighting must be set before)
-    t3d_vert_load(part->vert, part->vertDestOffset, part->vertLoadCount);
+    t3d_vert_load((T3DVertPacked*)((char*)part->vert + vertOffset), part->vertDestOffset, part->vertLoadCount);
     //debugf("Load Vertices[%d]: %d, %d | bone: %d\n", p, part->vertDestOffset, part->vertLoadCount, part->matrixIdx);
     if(part->numIndices == 0 && part->numStripIndices[0] == 0)continue; // partial-load, last chunk of a sequence will both indices & material data
 
@@ -330,6 +615,51 @@ void t3d_model_draw_object(const T3DObject *object, const T3DMat4FP *boneMatrice
   if(hadMatrixPush)t3d_matrix_pop(1);
 }
 
+void t3d_model_draw_object(const T3DObject *object, const T3DMat4FP *boneMatrices)
+{
+  draw_parts(object->parts, object->numParts, boneMatrices, 0);
+}
+
+void t3d_model_draw_object_vertices(const T3DObject *object, const T3DVertPacked *vertices, const T3DMat4FP *boneMatrices)
+{
+  int32_t vertOffset = (int32_t)vertices - (int32_t)t3d_model_object_get_vertices(object);
+  draw_parts(object->parts, object->numParts, boneMatrices, vertOffset);
+}
+
+void t3d_model_draw_object_lod(const T3DObject *object, uint32_t lod, const T3DMat4FP *boneMatrices)
+{
+  if(lod == 0 || lod > object->lodCount) {
+    draw_parts(object->parts, object->numParts, boneMatrices, 0);
+    return;
+  }
+  const T3DObjectLod *lodData = &t3d_model_object_get_lods(object)[lod-1];
+  draw_parts(lodData->parts, lodData->numParts, boneMatrices, 0);
+}
+
+uint32_t t3d_model_object_select_lod(const T3DObject *object, const T3DModelLodConf *conf)
+{
+  // distance to the closest point of the AABB, zero if inside
+  float dist2 = 0.0f;
+  for(int i=0; i<3; ++i) {
+    float pos = conf->camPos.v[i];
+    float d = fmaxf(fmaxf(object->aabbMin[i] - pos, pos - object->aabbMax[i]), 0.0f);
+    dist2 += d * d;
+  }
+
+  // compare 'error * scale / dist > maxError' without a division or sqrt
+  float maxErrorDist2 = conf->maxError * conf->maxError * dist2;
+  float scale2 = conf->errorScale * conf->errorScale;
+
+  const T3DObjectLod *lods = t3d_model_object_get_lods(object);
+  uint32_t lod = 0;
+  while(lod < object->lodCount) {
+    float error = lods[lod].error;
+    if(error * error * scale2 > maxErrorDist2)break;
+    ++lod;
+  }
+  return lod;
+}
+
 void t3d_model_draw_material(T3DMaterial *mat, T3DModelState *state)
 {
   if(!state) {
@@ -419,25 +749,18 @@ void t3d_model_draw_material(T3DMaterial *mat, T3DModelState *state)
 }
 
 void t3d_model_free(T3DModel *model) {
-  bool txtErased = false;
-
   if(model->userBlock) {
     rspq_block_free(model->userBlock);
   }
+  draw_cache_remove(model);
 
   for(uint32_t c = 0; c < model->chunkCount; c++)
   {
     char chunkType = model->chunkOffsets[c].type;
     if(chunkType == T3D_CHUNK_TYPE_MATERIAL) {
       T3DMaterial *mat = (T3DMaterial*)((char*)model + (model->chunkOffsets[c].offset & 0x00FFFFFF));
-      if(mat->textureA.texture) {
-        texture_cache_free(mat->textureA.textureHash);
-        txtErased = true;
-      }
-      if(mat->textureB.texture) {
-        texture_cache_free(mat->textureB.textureHash);
-        txtErased = true;
-      }
+      if(mat->textureA.texture)texture_cache_release(mat->textureA.textureHash);
+      if(mat->textureB.texture)texture_cache_release(mat->textureB.textureHash);
     }
     if(chunkType == T3D_CHUNK_TYPE_OBJECT) {
       T3DObject *obj = (T3DObject*)((char*)model + (model->chunkOffsets[c].offset & 0x00FFFFFF));
@@ -445,7 +768,6 @@ void t3d_model_free(T3DModel *model) {
     }
   }
   free(model);
-  if(txtErased) texture_cache_free_mem();
 }
 
 T3DChunkAnim *t3d_model_get_animation(const T3DModel *model, const char *name) {
@@ -504,36 +826,774 @@ bool t3d_model_iter_next(T3DModelIter *iter) {
   return false;
 }
 
-// context for functions below, this avoids blowing up the stack-sie
-static const T3DFrustum *ctxFrustum;
-static const T3DBvhData *ctxData;
-static uint32_t ctxBasePtr;
+#define BVH_STACK_SIZE     64
+#define BVH_MASK_ALL       0b111111 // all 6 planes need to be tested
+#define BVH_MASK_CULLED    0x80
+#define BVH_PLANE_NORM_MAX 8191 // largest normal component in fixed-point, keeps dot-products within 31 bits
+#define BVH_PLANE_W_MAX    (1 << 30)
+// max. error from rounding the normal (3 axis * 0.5 * max. s16 coordinate), added to keep culling conservative
+#define BVH_PLANE_MARGIN   (3 * 32768 / 2 + 1)
+
+// Frustum plane in fixed-point, with separate offsets to test if an AABB is outside or fully inside
+typedef struct {
+  int32_t n[3];
+  int32_t wOut;
+  int32_t wIn;
+  uint8_t posMask; // axis with a positive normal component, selects min/max for the nearest/farthest corner
+} T3DPlaneFP;
+
+typedef struct {
+  T3DPlaneFP planes[6];
+} T3DFrustumFP;
+
+typedef struct {
+  uint16_t nodeIdx;
+  uint32_t masks; // plane mask per frustum (8 bits each), see 'BVH_MASK_xxx'
+} T3DBvhStackEntry;
+
+static int32_t bvh_plane_w_to_fp(float w) {
+  if(w >= BVH_PLANE_W_MAX)return BVH_PLANE_W_MAX;
+  if(w <= -BVH_PLANE_W_MAX)return -BVH_PLANE_W_MAX;
+  return (int32_t)w;
+}
+
+static void bvh_frustum_to_fp(T3DFrustumFP *res, const T3DFrustum *frustum) {
+  for(int p=0; p<6; ++p) {
+    const T3DVec4 *plane = &frustum->planes[p];
+    T3DPlaneFP *planeFP = &res->planes[p];
 
-static void bvh_query_node(const T3DBvhNode *node) {
-  int dataCount = node->value & 0b1111;
-  int offset = (int16_t)node->value >> 4;
+    // planes can be scaled freely, only the sign of the distance matters
+    float maxComp = fmaxf(fmaxf(fabsf(plane->v[0]), fabsf(plane->v[1])), fabsf(plane->v[2]));
+    float scale = maxComp > 0.0f ? BVH_PLANE_NORM_MAX / maxComp : 0.0f;
 
-  if(dataCount == 0) {
-    if(t3d_frustum_vs_aabb_s16(ctxFrustum, node->aabbMin, node->aabbMax)) {
-      bvh_query_node(&node[offset]);
-      bvh_query_node(&node[offset + 1]);
+    planeFP->posMask = 0;
+    for(int i=0; i<3; ++i) {
+      planeFP->n[i] = (int32_t)roundf(plane->v[i] * scale);
+      if(planeFP->n[i] > 0)planeFP->posMask |= 1 << i;
     }
-    return;
+    float w = plane->v[3] * scale;
+    planeFP->wOut = bvh_plane_w_to_fp(w + BVH_PLANE_MARGIN);
+    planeFP->wIn = bvh_plane_w_to_fp(w - BVH_PLANE_MARGIN);
+  }
+}
+
+// returns true if the AABB is fully behind the plane
+static inline bool bvh_plane_outside(const T3DPlaneFP *plane, const int16_t min[3], const int16_t max[3]) {
+  int32_t dist = plane->wOut;
+  dist += plane->n[0] * ((plane->posMask & 0b001) ? max[0] : min[0]);
+  dist += plane->n[1] * ((plane->posMask & 0b010) ? max[1] : min[1]);
+  dist += plane->n[2] * ((plane->posMask & 0b100) ? max[2] : min[2]);
+  return dist <= 0;
+}
+
+// returns true if the AABB is fully in front of the plane
+static inline bool bvh_plane_inside(const T3DPlaneFP *plane, const int16_t min[3], const int16_t max[3]) {
+  int32_t dist = plane->wIn;
+  dist += plane->n[0] * ((plane->posMask & 0b001) ? min[0] : max[0]);
+  dist += plane->n[1] * ((plane->posMask & 0b010) ? min[1] : max[1]);
+  dist += plane->n[2] * ((plane->posMask & 0b100) ? min[2] : max[2]);
+  return dist > 0;
+}
+
+/**
+ * Tests an AABB against the planes set in 'mask', starting with the one that culled it last time.
+ * Returns the mask for any children (planes the AABB is fully inside of are removed), or BVH_MASK_CULLED.
+ */
+static uint8_t bvh_frustum_test(const T3DFrustumFP *frustum, const int16_t min[3], const int16_t max[3], uint8_t mask, uint8_t *lastPlane)
+{
+  if(lastPlane && (mask & (1 << *lastPlane))) {
+    if(bvh_plane_outside(&frustum->planes[*lastPlane], min, max))return BVH_MASK_CULLED;
   }
 
-  int offsetEnd = offset + dataCount;
-  while(offset < offsetEnd) {
-    T3DObject* obj = (T3DObject*)(ctxBasePtr - (ctxData[offset++].objectPtr << 2));
-    if(t3d_frustum_vs_aabb_s16(ctxFrustum, obj->aabbMin, obj->aabbMax)) {
-      obj->isVisible = true;
+  for(int p=0; p<6; ++p) {
+    if(!(mask & (1 << p)))continue;
+    const T3DPlaneFP *plane = &frustum->planes[p];
+    if(bvh_plane_outside(plane, min, max)) {
+      if(lastPlane)*lastPlane = p;
+      return BVH_MASK_CULLED;
     }
+    if(bvh_plane_inside(plane, min, max))mask &= ~(1 << p);
   }
+  return mask;
 }
 
-void t3d_model_bvh_query_frustum(const T3DBvh *bvh, const T3DFrustum *frustum) {
+// tests an AABB against all frusta still active in 'masks', returns the new masks
+static inline uint32_t bvh_frusta_test(
+  const T3DFrustumFP *frusta, uint32_t frustumCount,
+  const int16_t min[3], const int16_t max[3], uint32_t masks, uint8_t *lastPlanes
+) {
+  for(uint32_t f=0; f<frustumCount; ++f) {
+    uint8_t mask = (masks >> (f*8)) & 0xFF;
+    if(mask == 0 || (mask & BVH_MASK_CULLED))continue; // fully inside or already culled by a parent
+    mask = bvh_frustum_test(&frusta[f], min, max, mask, lastPlanes ? &lastPlanes[f] : NULL);
+    masks = (masks & ~(0xFFu << (f*8))) | ((uint32_t)mask << (f*8));
+  }
+  return masks;
+}
+
+T3DBvhQueryCache t3d_model_bvh_query_cache_create(const T3DBvh *bvh) {
+  uint32_t size = (bvh->nodeCount + bvh->dataCount) * T3D_BVH_MAX_FRUSTA;
+  T3DBvhQueryCache cache = {
+    .bvh = bvh,
+    .lastPlane = malloc(size),
+  };
+  memset(cache.lastPlane, 0, size);
+  return cache;
+}
+
+void t3d_model_bvh_query_cache_destroy(T3DBvhQueryCache *cache) {
+  free(cache->lastPlane);
+  cache->lastPlane = NULL;
+  cache->bvh = NULL;
+}
+
+void t3d_model_bvh_query_frusta(const T3DBvh *bvh, const T3DFrustum *frusta, uint32_t frustumCount, T3DBvhQueryCache *cache)
+{
+  assertf(frustumCount > 0 && frustumCount <= T3D_BVH_MAX_FRUSTA, "Invalid frustum count: %lu", frustumCount);
+  assertf(!cache || cache->bvh == bvh, "Query cache belongs to a different BVH");
+
   const T3DBvhData *data = (T3DBvhData*)&bvh->nodes[bvh->nodeCount]; // data starts right after nodes
-  ctxFrustum = frustum;
-  ctxData = data;
-  ctxBasePtr = (uint32_t)(char*)bvh;
-  bvh_query_node(bvh->nodes);
+  uint32_t basePtr = (uint32_t)(char*)bvh;
+
+  T3DFrustumFP frustaFP[T3D_BVH_MAX_FRUSTA];
+  uint32_t masksCulled = 0;
+  uint32_t masksAll = 0;
+  for(uint32_t f=0; f<frustumCount; ++f) {
+    bvh_frustum_to_fp(&frustaFP[f], &frusta[f]);
+    masksCulled |= (uint32_t)BVH_MASK_CULLED << (f*8);
+    masksAll |= (uint32_t)BVH_MASK_ALL << (f*8);
+  }
+
+  T3DBvhStackEntry stack[BVH_STACK_SIZE];
+  uint32_t stackSize = 0;
+  stack[stackSize++] = (T3DBvhStackEntry){0, masksAll};
+
+  while(stackSize)
+  {
+    T3DBvhStackEntry entry = stack[--stackSize];
+    const T3DBvhNode *node = &bvh->nodes[entry.nodeIdx];
+    uint8_t *lastPlanes = cache ? &cache->lastPlane[entry.nodeIdx * T3D_BVH_MAX_FRUSTA] : NULL;
+
+    uint32_t masks = bvh_frusta_test(frustaFP, frustumCount, node->aabbMin, node->aabbMax, entry.masks, lastPlanes);
+    if((masks & masksCulled) == masksCulled)continue;
+
+    int dataCount = node->value & 0b1111;
+    int offset = (int16_t)node->value >> 4;
+
+    if(dataCount == 0) {
+      assertf(stackSize + 2 <= BVH_STACK_SIZE, "BVH too deep");
+      stack[stackSize++] = (T3DBvhStackEntry){entry.nodeIdx + offset + 1, masks};
+      stack[stackSize++] = (T3DBvhStackEntry){entry.nodeIdx + offset, masks};
+      continue;
+    }
+
+    int offsetEnd = offset + dataCount;
+    for(; offset < offsetEnd; ++offset) {
+      T3DObject* obj = (T3DObject*)(basePtr - (data[offset].objectPtr << 2));
+      uint8_t *lastPlanesObj = cache ? &cache->lastPlane[(bvh->nodeCount + offset) * T3D_BVH_MAX_FRUSTA] : NULL;
+      uint32_t masksObj = bvh_frusta_test(frustaFP, frustumCount, obj->aabbMin, obj->aabbMax, masks, lastPlanesObj);
+
+      for(uint32_t f=0; f<frustumCount; ++f) {
+        if(!(masksObj & ((uint32_t)BVH_MASK_CULLED << (f*8))))obj->isVisible |= 1 << f;
+      }
+    }
+  }
+}
+
+void t3d_model_bvh_query_frustum(const T3DBvh *bvh, const T3DFrustum *frustum) {
+  t3d_model_bvh_query_frusta(bvh, frustum, 1, NULL);
+}
+
+// PVS
+
+const uint8_t* t3d_model_pvs_get_set(const T3DPvs *pvs, const T3DVec3 *pos)
+{
+  uint32_t cellIdx = 0;
+  uint32_t stride = 1;
+  for(int i=0; i<3; ++i) {
+    float cell = (pos->v[i] - pvs->gridMin[i]) / pvs->cellSize;
+    if(cell < 0.0f || cell >= pvs->gridSize[i])return NULL;
+    cellIdx += (uint32_t)cell * stride;
+    stride *= pvs->gridSize[i];
+  }
+
+  const uint8_t *sets = (const uint8_t*)&pvs->cellSets[stride];
+  return &sets[pvs->cellSets[cellIdx] * pvs->setSize];
+}
+
+void t3d_model_pvs_query(const T3DModel *model, const T3DPvs *pvs, const T3DVec3 *camPos, const T3DFrustum *frustum)
+{
+  const uint8_t *set = t3d_model_pvs_get_set(pvs, camPos);
+  uint32_t objIdx = 0;
+
+  T3DModelIter it = t3d_model_iter_create(model, T3D_CHUNK_TYPE_OBJECT);
+  while(t3d_model_iter_next(&it))
+  {
+    bool visible = !set || objIdx >= pvs->objectCount || (set[objIdx / 8] & (1 << (objIdx % 8)));
+    if(visible && frustum) {
+      visible = t3d_frustum_vs_aabb_s16(frustum, it.object->aabbMin, it.object->aabbMax);
+    }
+    it.object->isVisible = visible;
+    ++objIdx;
+  }
+}
+
+// Collision
+
+#define COLL_SHAPE_RAY     0
+#define COLL_SHAPE_SPHERE  1
+#define COLL_SHAPE_CAPSULE 2
+
+typedef struct {
+  T3DVec3 origin; // ray origin, sphere center or first capsule point
+  T3DVec3 posB; // second capsule point
+  T3DVec3 dir;
+  float radius;
+  float extMin[3]; // bounds of the shape relative to 'origin', used to grow node AABBs
+  float extMax[3];
+  uint8_t shape;
+} T3DCollQuery;
+
+/// @brief Sets 'res' to 'a + b * s'
+static inline void coll_vec3_madd(T3DVec3 *res, const T3DVec3 *a, const T3DVec3 *b, float s) {
+  res->v[0] = a->v[0] + b->v[0] * s;
+  res->v[1] = a->v[1] + b->v[1] * s;
+  res->v[2] = a->v[2] + b->v[2] * s;
+}
+
+static inline void coll_closest_pt_segment(T3DVec3 *res, const T3DVec3 *p, const T3DVec3 *a, const T3DVec3 *b) {
+  T3DVec3 ab, ap;
+  t3d_vec3_diff(&ab, b, a);
+  t3d_vec3_diff(&ap, p, a);
+  float len2 = t3d_vec3_len2(&ab);
+  float t = len2 > 0.0f ? (t3d_vec3_dot(&ap, &ab) / len2) : 0.0f;
+  t = fminf(fmaxf(t, 0.0f), 1.0f);
+  coll_vec3_madd(res, a, &ab, t);
+}
+
+// Closest point on a triangle to a point, see: "Real-Time Collision Detection" (Christer Ericson), 5.1.5
+static void coll_closest_pt_tri(T3DVec3 *res, const T3DVec3 *p, const T3DVec3 v[3])
+{
+  T3DVec3 ab, ac, ap, bp, cp;
+  t3d_vec3_diff(&ab, &v[1], &v[0]);
+  t3d_vec3_diff(&ac, &v[2], &v[0]);
+  t3d_vec3_diff(&ap, p, &v[0]);
+
+  float d1 = t3d_vec3_dot(&ab, &ap);
+  float d2 = t3d_vec3_dot(&ac, &ap);
+  if(d1 <= 0.0f && d2 <= 0.0f) { *res = v[0]; return; }
+
+  t3d_vec3_diff(&bp, p, &v[1]);
+  float d3 = t3d_vec3_dot(&ab, &bp);
+  float d4 = t3d_vec3_dot(&ac, &bp);
+  if(d3 >= 0.0f && d4 <= d3) { *res = v[1]; return; }
+
+  float vc = d1*d4 - d3*d2;
+  if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+    coll_vec3_madd(res, &v[0], &ab, d1 / (d1 - d3));
+    return;
+  }
+
+  t3d_vec3_diff(&cp, p, &v[2]);
+  float d5 = t3d_vec3_dot(&ab, &cp);
+  float d6 = t3d_vec3_dot(&ac, &cp);
+  if(d6 >= 0.0f && d5 <= d6) { *res = v[2]; return; }
+
+  float vb = d5*d2 - d1*d6;
+  if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+    coll_vec3_madd(res, &v[0], &ac, d2 / (d2 - d6));
+    return;
+  }
+
+  float va = d3*d6 - d5*d4;
+  if(va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+    T3DVec3 bc;
+    t3d_vec3_diff(&bc, &v[2], &v[1]);
+    coll_vec3_madd(res, &v[1], &bc, (d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    return;
+  }
+
+  float denom = 1.0f / (va + vb + vc);
+  coll_vec3_madd(res, &v[0], &ab, vb * denom);
+  coll_vec3_madd(res, res, &ac, vc * denom);
+}
+
+// Closest points between two segments, see: "Real-Time Collision Detection" (Christer Ericson), 5.1.9
+static float coll_closest_pt_segments(
+  T3DVec3 *resA, T3DVec3 *resB,
+  const T3DVec3 *p1, const T3DVec3 *q1, const T3DVec3 *p2, const T3DVec3 *q2
+) {
+  T3DVec3 d1, d2, r;
+  t3d_vec3_diff(&d1, q1, p1);
+  t3d_vec3_diff(&d2, q2, p2);
+  t3d_vec3_diff(&r, p1, p2);
+  float a = t3d_vec3_len2(&d1);
+  float e = t3d_vec3_len2(&d2);
+  float f = t3d_vec3_dot(&d2, &r);
+  float s = 0.0f, t = 0.0f;
+
+  if(a <= 0.0001f && e <= 0.0001f) {
+    // both degenerate, keep s = t = 0
+  } else if(a <= 0.0001f) {
+    t = fminf(fmaxf(f / e, 0.0f), 1.0f);
+  } else {
+    float c = t3d_vec3_dot(&d1, &r);
+    if(e <= 0.0001f) {
+      s = fminf(fmaxf(-c / a, 0.0f), 1.0f);
+    } else {
+      float b = t3d_vec3_dot(&d1, &d2);
+      float denom = a*e - b*b;
+      s = denom != 0.0f ? fminf(fmaxf((b*f - c*e) / denom, 0.0f), 1.0f) : 0.0f;
+      t = (b*s + f) / e;
+      if(t < 0.0f) {
+        t = 0.0f;
+        s = fminf(fmaxf(-c / a, 0.0f), 1.0f);
+      } else if(t > 1.0f) {
+        t = 1.0f;
+        s = fminf(fmaxf((b - c) / a, 0.0f), 1.0f);
+      }
+    }
+  }
+
+  coll_vec3_madd(resA, p1, &d1, s);
+  coll_vec3_madd(resB, p2, &d2, t);
+  return t3d_vec3_distance2(resA, resB);
+}
+
+// Ray vs. triangle (double-sided), 'dir' doesn't need to be normalized
+static bool coll_ray_tri(const T3DVec3 *origin, const T3DVec3 *dir, const T3DVec3 v[3], float *tOut)
+{
+  T3DVec3 e1, e2, p, s, q;
+  t3d_vec3_diff(&e1, &v[1], &v[0]);
+  t3d_vec3_diff(&e2, &v[2], &v[0]);
+  t3d_vec3_cross(&p, dir, &e2);
+
+  float det = t3d_vec3_dot(&e1, &p);
+  if(fabsf(det) < 0.000001f)return false;
+  float invDet = 1.0f / det;
+
+  t3d_vec3_diff(&s, origin, &v[0]);
+  float u = t3d_vec3_dot(&s, &p) * invDet;
+  if(u < 0.0f || u > 1.0f)return false;
+
+  t3d_vec3_cross(&q, &s, &e1);
+  float w = t3d_vec3_dot(dir, &q) * invDet;
+  if(w < 0.0f || u + w > 1.0f)return false;
+
+  *tOut = t3d_vec3_dot(&e2, &q) * invDet;
+  return *tOut >= 0.0f;
+}
+
+static bool coll_ray_sphere(const T3DVec3 *origin, const T3DVec3 *dir, const T3DVec3 *center, float radius, float *tOut)
+{
+  T3DVec3 m;
+  t3d_vec3_diff(&m, origin, center);
+  float b = t3d_vec3_dot(&m, dir);
+  float c = t3d_vec3_len2(&m) - radius * radius;
+  if(c > 0.0f && b > 0.0f)return false;
+
+  float disc = b*b - c;
+  if(disc < 0.0f)return false;
+  *tOut = fmaxf(-b - sqrtf(disc), 0.0f);
+  return true;
+}
+
+// Ray vs. capsule (cylinder + spheres at both ends), 'origin' must be outside of it
+static bool coll_ray_capsule(
+  const T3DVec3 *origin, const T3DVec3 *dir, const T3DVec3 *a, const T3DVec3 *b, float radius, float *tOut
+) {
+  T3DVec3 ab, ao;
+  t3d_vec3_diff(&ab, b, a);
+  t3d_vec3_diff(&ao, origin, a);
+
+  float ab2 = t3d_vec3_len2(&ab);
+  float abDir = t3d_vec3_dot(&ab, dir);
+  float abAo = t3d_vec3_dot(&ab, &ao);
+  float tBest = INFINITY;
+
+  float qa = ab2 - abDir*abDir;
+  if(qa > 0.000001f * ab2) { // otherwise parallel to the axis, only the ends can be hit
+    float qb = ab2 * t3d_vec3_dot(&ao, dir) - abAo * abDir;
+    float qc = ab2 * t3d_vec3_len2(&ao) - abAo*abAo - radius*radius*ab2;
+    float disc = qb*qb - qa*qc;
+    if(disc >= 0.0f) {
+      float t = (-qb - sqrtf(disc)) / qa;
+      float s = abAo + t * abDir;
+      if(t >= 0.0f && s >= 0.0f && s <= ab2)tBest = t;
+    }
+  }
+
+  float t;
+  if(coll_ray_sphere(origin, dir, a, radius, &t) && t < tBest)tBest = t;
+  if(coll_ray_sphere(origin, dir, b, radius, &t) && t < tBest)tBest = t;
+
+  *tOut = tBest;
+  return tBest != INFINITY;
+}
+
+static void coll_tri_normal(T3DVec3 *res, const T3DVec3 v[3], const T3DVec3 *dir) {
+  T3DVec3 e1, e2;
+  t3d_vec3_diff(&e1, &v[1], &v[0]);
+  t3d_vec3_diff(&e2, &v[2], &v[0]);
+  t3d_vec3_cross(res, &e1, &e2);
+  t3d_vec3_norm(res);
+  if(t3d_vec3_dot(res, dir) > 0.0f)t3d_vec3_scale(res, res, -1.0f);
+}
+
+// Sets the normal for a contact at a distance of 0, falls back to the triangle normal if the points overlap
+static void coll_overlap_normal(T3DVec3 *res, const T3DVec3 *posShape, const T3DVec3 *posTri, const T3DVec3 v[3], const T3DVec3 *dir) {
+  t3d_vec3_diff(res, posShape, posTri);
+  if(t3d_vec3_len2(res) > 0.000001f) {
+    t3d_vec3_norm(res);
+  } else {
+    coll_tri_normal(res, v, dir);
+  }
+}
+
+static bool coll_sphere_tri(
+  const T3DVec3 *center, float radius, const T3DVec3 *dir, const T3DVec3 v[3], float maxDist, T3DCollisionHit *hit
+) {
+  // already overlapping at the start
+  T3DVec3 closest;
+  coll_closest_pt_tri(&closest, center, v);
+  if(t3d_vec3_distance2(center, &closest) <= radius * radius) {
+    hit->dist = 0.0f;
+    hit->point = closest;
+    coll_overlap_normal(&hit->normal, center, &closest, v, dir);
+    return true;
+  }
+
+  // face, if the contact point is inside the triangle nothing else can be hit earlier
+  T3DVec3 e1, e2, n, toCenter;
+  t3d_vec3_diff(&e1, &v[1], &v[0]);
+  t3d_vec3_diff(&e2, &v[2], &v[0]);
+  t3d_vec3_cross(&n, &e1, &e2);
+  float nLen2 = t3d_vec3_len2(&n);
+
+  if(nLen2 > 0.000001f) {
+    t3d_vec3_scale(&n, &n, 1.0f / sqrtf(nLen2));
+    t3d_vec3_diff(&toCenter, center, &v[0]);
+    float distPlane = t3d_vec3_dot(&n, &toCenter);
+    if(distPlane < 0.0f) {
+      t3d_vec3_scale(&n, &n, -1.0f);
+      distPlane = -distPlane;
+    }
+
+    float speed = -t3d_vec3_dot(&n, dir);
+    if(speed > 0.0f) {
+      float t = (distPlane - radius) / speed;
+      if(t >= 0.0f && t <= maxDist) {
+        T3DVec3 p, vp;
+        coll_vec3_madd(&p, center, dir, t);
+        coll_vec3_madd(&p, &p, &n, -radius);
+
+        // barycentric check
+        t3d_vec3_diff(&vp, &p, &v[0]);
+        float d00 = t3d_vec3_dot(&e1, &e1);
+        float d01 = t3d_vec3_dot(&e1, &e2);
+        float d11 = t3d_vec3_dot(&e2, &e2);
+        float d20 = t3d_vec3_dot(&vp, &e1);
+        float d21 = t3d_vec3_dot(&vp, &e2);
+        float denom = d00 * d11 - d01 * d01;
+        float bv = (d11 * d20 - d01 * d21);
+        float bw = (d00 * d21 - d01 * d20);
+        if(bv >= 0.0f && bw >= 0.0f && (bv + bw) <= denom) {
+          hit->dist = t;
+          hit->point = p;
+          hit->normal = n;
+          return true;
+        }
+      }
+    }
+  }
+
+  // edges and vertices
+  bool found = false;
+  for(int i=0; i<3; ++i) {
+    const T3DVec3 *a = &v[i];
+    const T3DVec3 *b = &v[(i+1) % 3];
+    float t;
+    if(coll_ray_capsule(center, dir, a, b, radius, &t) && t <= maxDist) {
+      T3DVec3 pos;
+      coll_vec3_madd(&pos, center, dir, t);
+      coll_closest_pt_segment(&hit->point, &pos, a, b);
+      coll_overlap_normal(&hit->normal, &pos, &hit->point, v, dir);
+      hit->dist = maxDist = t;
+      found = true;
+    }
+  }
+  return found;
+}
+
+static bool coll_capsule_tri(
+  const T3DVec3 *posA, const T3DVec3 *posB, float radius, const T3DVec3 *dir,
+  const T3DVec3 v[3], float maxDist, T3DCollisionHit *hit
+) {
+  // already overlapping at the start, check the closest distance between axis and triangle
+  T3DVec3 axis, ptAxis, ptTri, tmpAxis, tmpTri;
+  t3d_vec3_diff(&axis, posB, posA);
+
+  float t;
+  if(coll_ray_tri(posA, &axis, v, &t) && t <= 1.0f) {
+    hit->dist = 0.0f;
+    coll_vec3_madd(&hit->point, posA, &axis, t);
+    coll_tri_normal(&hit->normal, v, dir);
+    return true;
+  }
+
+  coll_closest_pt_tri(&ptTri, posA, v);
+  ptAxis = *posA;
+  float minDist2 = t3d_vec3_distance2(posA, &ptTri);
+
+  coll_closest_pt_tri(&tmpTri, posB, v);
+  float dist2 = t3d_vec3_distance2(posB, &tmpTri);
+  if(dist2 < minDist2) {
+    minDist2 = dist2; ptAxis = *posB; ptTri = tmpTri;
+  }
+
+  for(int i=0; i<3; ++i) {
+    dist2 = coll_closest_pt_segments(&tmpAxis, &tmpTri, posA, posB, &v[i], &v[(i+1) % 3]);
+    if(dist2 < minDist2) {
+      minDist2 = dist2; ptAxis = tmpAxis; ptTri = tmpTri;
+    }
+  }
+
+  if(minDist2 <= radius * radius) {
+    hit->dist = 0.0f;
+    hit->point = ptTri;
+    coll_overlap_normal(&hit->normal, &ptAxis, &ptTri, v, dir);
+    return true;
+  }
+
+  // The first contact is always between a pair of features:
+  // - end-sphere vs. triangle (face, edge, vertex)
+  // - axis vs. vertex
+  // - axis vs. edge
+  // A contact between the axis and the face only happens if they are parallel,
+  // in which case the end-spheres touch it at the same time.
+  bool found = false;
+  T3DCollisionHit tmpHit;
+  if(coll_sphere_tri(posA, radius, dir, v, maxDist, &tmpHit)) {
+    *hit = tmpHit;
+    maxDist = tmpHit.dist;
+    found = true;
+  }
+  if(coll_sphere_tri(posB, radius, dir, v, maxDist, &tmpHit) && tmpHit.dist <= maxDist) {
+    *hit = tmpHit;
+    maxDist = tmpHit.dist;
+    found = true;
+  }
+
+  T3DVec3 dirInv;
+  t3d_vec3_scale(&dirInv, dir, -1.0f);
+  for(int i=0; i<3; ++i) {
+    // vertex moving towards the static capsule (relative motion)
+    if(coll_ray_capsule(&v[i], &dirInv, posA, posB, radius, &t) && t <= maxDist) {
+      T3DVec3 contactA, contactB, ptOnAxis;
+      coll_vec3_madd(&contactA, posA, dir, t);
+      coll_vec3_madd(&contactB, posB, dir, t);
+      coll_closest_pt_segment(&ptOnAxis, &v[i], &contactA, &contactB);
+      hit->dist = maxDist = t;
+      hit->point = v[i];
+      coll_overlap_normal(&hit->normal, &ptOnAxis, &v[i], v, dir);
+      found = true;
+    }
+
+    // edge vs. axis, contact is along the common perpendicular
+    const T3DVec3 *e0 = &v[i];
+    T3DVec3 edge, n, w;
+    t3d_vec3_diff(&edge, &v[(i+1) % 3], e0);
+    t3d_vec3_cross(&n, &axis, &edge);
+    float nLen2 = t3d_vec3_len2(&n);
+    if(nLen2 < 0.000001f)continue; // parallel, handled by the end-spheres/vertices
+    t3d_vec3_scale(&n, &n, 1.0f / sqrtf(nLen2));
+
+    t3d_vec3_diff(&w, posA, e0);
+    float distStart = t3d_vec3_dot(&n, &w);
+    if(distStart < 0.0f) {
+      t3d_vec3_scale(&n, &n, -1.0f);
+      distStart = -distStart;
+    }
+    float speed = -t3d_vec3_dot(&n, dir);
+    if(speed <= 0.0f)continue;
+
+    t = (distStart - radius) / speed;
+    if(t < 0.0f || t > maxDist)continue;
+
+    // 'w' is in the plane of both segments at the time of contact, solve for their parameters
+    coll_vec3_madd(&w, &w, dir, t);
+    coll_vec3_madd(&w, &w, &n, -radius);
+    float axis2 = t3d_vec3_len2(&axis);
+    float edge2 = t3d_vec3_len2(&edge);
+    float axisEdge = t3d_vec3_dot(&axis, &edge);
+    float wAxis = t3d_vec3_dot(&w, &axis);
+    float wEdge = t3d_vec3_dot(&w, &edge);
+    float det = axisEdge * axisEdge - axis2 * edge2;
+    float u = (wAxis * edge2 - axisEdge * wEdge) / det;
+    float s = (axisEdge * wAxis - axis2 * wEdge) / det;
+    if(u < 0.0f || u > 1.0f || s < 0.0f || s > 1.0f)continue;
+
+    hit->dist = maxDist = t;
+    coll_vec3_madd(&hit->point, e0, &edge, s);
+    hit->normal = n;
+    found = true;
+  }
+  return found;
+}
+
+// Returns the distance at which the moving query shape enters a node, or -1 if it misses it
+static inline float coll_node_enter(const T3DCollQuery *q, const T3DCollisionNode *node, float maxDist)
+{
+  float tMin = 0.0f;
+  float tMax = maxDist;
+  for(int i=0; i<3; ++i) {
+    float boxMin = (float)node->aabbMin[i] - q->extMax[i];
+    float boxMax = (float)node->aabbMax[i] - q->extMin[i];
+    float pos = q->origin.v[i];
+
+    if(q->dir.v[i] == 0.0f) {
+      if(pos < boxMin || pos > boxMax)return -1.0f;
+      continue;
+    }
+
+    float invDir = 1.0f / q->dir.v[i];
+    float t0 = (boxMin - pos) * invDir;
+    float t1 = (boxMax - pos) * invDir;
+    if(t0 > t1) { float tmp = t0; t0 = t1; t1 = tmp; }
+    tMin = fmaxf(tMin, t0);
+    tMax = fminf(tMax, t1);
+    if(tMin > tMax)return -1.0f;
+  }
+  return tMin;
+}
+
+static bool coll_query(const T3DCollision *coll, const T3DCollQuery *q, float maxDist, T3DCollisionHit *hit)
+{
+  assertf(coll->depth <= T3D_COLLISION_STACK_SIZE, "Collision-mesh too deep: %d", coll->depth);
+  if(coll->nodeCount == 0)return false;
+
+  const T3DCollisionTri *tris = t3d_model_collision_get_tris(coll);
+  const int16_t *verts = t3d_model_collision_get_verts(coll);
+
+  // nodes are visited front to back, with the entry distance to skip ones behind the closest hit
+  uint16_t stackNode[T3D_COLLISION_STACK_SIZE];
+  float stackDist[T3D_COLLISION_STACK_SIZE];
+  int stackSize = 0;
+  bool found = false;
+
+  float dist = coll_node_enter(q, &coll->nodes[0], maxDist);
+  if(dist < 0.0f)return false;
+  stackNode[0] = 0;
+  stackDist[0] = dist;
+  stackSize = 1;
+
+  while(stackSize > 0)
+  {
+    --stackSize;
+    if(stackDist[stackSize] > maxDist)continue;
+    const T3DCollisionNode *node = &coll->nodes[stackNode[stackSize]];
+
+    if(node->triCount == 0) {
+      float distA = coll_node_enter(q, &coll->nodes[node->index], maxDist);
+      float distB = coll_node_enter(q, &coll->nodes[node->index + 1], maxDist);
+      uint16_t idxNear = node->index;
+      uint16_t idxFar = node->index + 1;
+      if(distB >= 0.0f && (distA < 0.0f || distB < distA)) {
+        float tmp = distA; distA = distB; distB = tmp;
+        idxNear = idxFar; idxFar = node->index;
+      }
+      if(distB >= 0.0f) {
+        stackNode[stackSize] = idxFar;
+        stackDist[stackSize++] = distB;
+      }
+      if(distA >= 0.0f) {
+        stackNode[stackSize] = idxNear;
+        stackDist[stackSize++] = distA;
+      }
+      continue;
+    }
+
+    for(uint16_t i = node->index; i < node->index + node->triCount; ++i)
+    {
+      const T3DCollisionTri *tri = &tris[i];
+      T3DVec3 v[3];
+      for(int j=0; j<3; ++j) {
+        const int16_t *pos = &verts[tri->vertIdx[j] * 3];
+        v[j] = (T3DVec3){{pos[0], pos[1], pos[2]}};
+      }
+
+      T3DCollisionHit triHit;
+      bool isHit = false;
+      switch(q->shape) {
+        case COLL_SHAPE_RAY:
+          isHit = coll_ray_tri(&q->origin, &q->dir, v, &triHit.dist) && triHit.dist <= maxDist;
+          if(isHit) {
+            coll_vec3_madd(&triHit.point, &q->origin, &q->dir, triHit.dist);
+            coll_tri_normal(&triHit.normal, v, &q->dir);
+          }
+        break;
+        case COLL_SHAPE_SPHERE:
+          isHit = coll_sphere_tri(&q->origin, q->radius, &q->dir, v, maxDist, &triHit);
+        break;
+        case COLL_SHAPE_CAPSULE:
+          isHit = coll_capsule_tri(&q->origin, &q->posB, q->radius, &q->dir, v, maxDist, &triHit);
+        break;
+      }
+
+      if(isHit && (!found || triHit.dist < maxDist)) {
+        triHit.triIdx = i;
+        triHit.materialIdx = tri->materialIdx;
+        *hit = triHit;
+        maxDist = triHit.dist;
+        found = true;
+        if(maxDist <= 0.0f)return true; // can't get any closer
+      }
+    }
+  }
+  return found;
+}
+
+bool t3d_model_collision_raycast(
+  const T3DCollision *coll, const T3DVec3 *origin, const T3DVec3 *dir, float maxDist, T3DCollisionHit *hit
+) {
+  T3DCollQuery q = {
+    .origin = *origin,
+    .dir = *dir,
+    .shape = COLL_SHAPE_RAY
+  };
+  return coll_query(coll, &q, maxDist, hit);
+}
+
+bool t3d_model_collision_sweep_sphere(
+  const T3DCollision *coll, const T3DVec3 *center, float radius,
+  const T3DVec3 *dir, float maxDist, T3DCollisionHit *hit
+) {
+  T3DCollQuery q = {
+    .origin = *center,
+    .dir = *dir,
+    .radius = radius,
+    .extMin = {-radius, -radius, -radius},
+    .extMax = {radius, radius, radius},
+    .shape = COLL_SHAPE_SPHERE
+  };
+  return coll_query(coll, &q, maxDist, hit);
+}
+
+bool t3d_model_collision_sweep_capsule(
+  const T3DCollision *coll, const T3DVec3 *posA, const T3DVec3 *posB, float radius,
+  const T3DVec3 *dir, float maxDist, T3DCollisionHit *hit
+) {
+  T3DCollQuery q = {
+    .origin = *posA,
+    .posB = *posB,
+    .dir = *dir,
+    .radius = radius,
+    .shape = COLL_SHAPE_CAPSULE
+  };
+  for(int i=0; i<3; ++i) {
+    float offset = posB->v[i] - posA->v[i];
+    q.extMin[i] = fminf(offset, 0.0f) - radius;
+    q.extMax[i] = fmaxf(offset, 0.0f) + radius;
+  }
+  return coll_query(coll, &q, maxDist, hit);
 }
@@ -83,13 +83,22 @@ typedef struct {
   // can be used freely by the user for recording, will be freed automatically by t3d
   rspq_block_t *userBlock;
   uint8_t isVisible; // set by culling checks, otherwise no effect on rendering
-  uint8_t _padding[3];
+  uint8_t lodCount; // levels-of-detail in addition to the full-detail parts, see 't3d_model_object_get_lods'
+  uint8_t _padding[2];
   int16_t aabbMin[3];
   int16_t aabbMax[3];
 
   T3DObjectPart parts[]; // real array
+  // T3DObjectLod lods[lodCount]; // after the parts, each with its own set of parts
 } T3DObject;
 
+typedef struct {
+  T3DObjectPart *parts;
+  uint16_t numParts;
+  uint16_t triCount;
+  float error; // max. deviation from the full-detail mesh, in model-space units
+} T3DObjectLod;
+
 typedef struct {
   int16_t aabbMin[3];
   int16_t aabbMax[3];
@@ -103,6 +112,77 @@ typedef struct {
   // uint16_t data[]; // T3DObject pointer, shifted by 3, relative to 'objectBasePtr'
 } T3DBvh;
 
+#define T3D_BVH_MAX_FRUSTA 4
+
+// State kept across BVH queries, see 't3d_model_bvh_query_cache_create'
+typedef struct {
+  const T3DBvh *bvh;
+  uint8_t *lastPlane; // plane that culled a node/object last time, per frustum
+} T3DBvhQueryCache;
+
+typedef struct {
+  int16_t gridMin[3];
+  uint16_t gridSize[3]; // cells per axis
+  float cellSize;
+  uint16_t objectCount;
+  uint16_t setSize; // bytes per set, one bit per object
+  uint16_t setCount;
+  uint16_t _reserved;
+  uint16_t cellSets[]; // set index per cell, x-major
+  // uint8_t sets[setCount][setSize]; // bit 'n%8' of byte 'n/8' is set if object 'n' is visible
+} T3DPvs;
+
+typedef struct {
+  int16_t aabbMin[3];
+  int16_t aabbMax[3];
+  uint16_t index; // inner-node: index of the first child (second one follows), leaf: first triangle
+  uint16_t triCount; // 0 for inner-nodes
+} T3DCollisionNode;
+
+typedef struct {
+  uint16_t vertIdx[3];
+  uint16_t materialIdx; // index of the material, relative to 'chunkIdxMaterials'
+} T3DCollisionTri;
+
+typedef struct {
+  uint16_t nodeCount;
+  uint16_t triCount;
+  uint16_t vertCount;
+  uint16_t depth; // max. depth of the tree
+  T3DCollisionNode nodes[];
+  // T3DCollisionTri tris[triCount]; // sorted by leaf
+  // int16_t verts[vertCount][3];
+} T3DCollision;
+
+typedef struct {
+  float dist; // distance along the direction until the first contact
+  T3DVec3 point; // contact point on the triangle
+  T3DVec3 normal; // normalized, points from the triangle towards the query shape
+  uint16_t triIdx;
+  uint16_t materialIdx; // see 'T3DCollisionTri'
+} T3DCollisionHit;
+
+typedef struct {
+  uint16_t pairStart; // first vertex-pair, relative to the first full-detail vertex of the object
+  uint16_t pairCount;
+} T3DMorphRange;
+
+typedef struct {
+  char* name;
+  uint16_t rangeCount;
+  uint8_t shift; // deltas are quantized, the actual offset is 'delta << shift'
+  uint8_t _padding;
+  uint32_t dataOffset; // ranges + deltas, relative to the chunk, see 't3d_model_morph_get_ranges'
+} T3DMorphTarget;
+
+typedef struct {
+  T3DObject *object; // object the deltas apply to
+  uint16_t targetCount;
+  uint16_t vertCount; // full-detail vertices of the object
+  T3DMorphTarget targets[];
+  // per target: T3DMorphRange ranges[rangeCount]; int8_t deltas[pairs][2][3]; // posA, posB
+} T3DChunkMorph;
+
 typedef struct {
   char* name;
   uint16_t parentIdx;
@@ -169,6 +249,7 @@ typedef struct {
     T3DMaterial *material;
     T3DChunkSkeleton *skeleton;
     T3DChunkAnim *anim;
+    T3DChunkMorph *morph;
   };
 
   const T3DModel *_model;
@@ -184,9 +265,15 @@ enum T3DModelChunkType {
   T3D_CHUNK_TYPE_OBJECT   = 'O',
   T3D_CHUNK_TYPE_SKELETON = 'S',
   T3D_CHUNK_TYPE_ANIM     = 'A',
-  T3D_CHUNK_TYPE_BVH      = 'B'
+  T3D_CHUNK_TYPE_BVH      = 'B',
+  T3D_CHUNK_TYPE_COLLISION = 'C',
+  T3D_CHUNK_TYPE_PVS      = 'P',
+  T3D_CHUNK_TYPE_MORPH    = 'D'
 };
 
+// Max. depth of a collision-mesh, this is the stack size used for traversal
+#define T3D_COLLISION_STACK_SIZE 64
+
 /**
  * Loads a model from a file.
  * If you no longer need the model, call 't3d_model_free'
@@ -196,6 +283,17 @@ enum T3DModelChunkType {
  */
 T3DModel* t3d_model_load(const char *path);
 
+/**
+ * Loads a model from a buffer holding the contents of a .t3dm file (e.g. read in manually).
+ * The buffer is patched in place and must be 16-byte aligned.
+ * It is owned by the model afterwards and freed in 't3d_model_free'.
+ *
+ * @param buffer file data, allocated with 'malloc'/'memalign'
+ * @param size size of the data in bytes
+ * @return pointer to the model (same as 'buffer')
+ */
+T3DModel* t3d_model_load_buffer(void *buffer, uint32_t size);
+
 // callback for custom drawing, this hooks into the tile-setting section
 typedef void (*T3DModelTileCb)(void* userData, rdpq_texparms_t *tileParams, rdpq_tile_t tile);
 typedef bool (*T3DModelFilterCb)(void* userData, const T3DObject *obj);
@@ -203,6 +301,13 @@ typedef void (*T3DModelDynTextureCb)(
   void* userData, const T3DMaterial *material, rdpq_texparms_t *tileParams, rdpq_tile_t tile
 );
 
+// Settings to select a level-of-detail, see 't3d_model_lod_conf_create'
+typedef struct {
+  T3DVec3 camPos; // camera position in model space
+  float errorScale; // converts 'error / distance' into pixels, 1.0 to use ratios instead
+  float maxError; // max. allowed error, in pixels (or the ratio) at which a lower detail level is used
+} T3DModelLodConf;
+
 // Defines settings and callbacks for custom drawing
 typedef struct {
   void* userData;
@@ -210,6 +315,7 @@ typedef struct {
   T3DModelFilterCb filterCb; // callback to filter parts
   T3DModelDynTextureCb dynTextureCb; // callback to set dynamic textures, aka "Texture Reference" in fast64
   const T3DMat4FP *matrices;
+  const T3DModelLodConf *lodConf; // if set, selects a level-of-detail per object (if it has any)
 } T3DModelDrawConf;
 
 /**
@@ -252,6 +358,45 @@ static inline T3DModelState t3d_model_state_create() {
  */
 void t3d_model_free(T3DModel* model);
 
+// Counters of the texture cache, see 't3d_texture_cache_get_stats'
+typedef struct {
+  uint32_t hits; // lookups that found the texture already loaded
+  uint32_t misses; // textures loaded from ROM
+  uint32_t evictions; // unreferenced textures freed to stay in budget
+  uint32_t textureCount; // textures currently loaded (incl. unreferenced ones)
+  uint32_t bytesUsed; // memory of all loaded textures
+  uint32_t bytesBudget;
+} T3DTextureCacheStats;
+
+/**
+ * Sets the memory budget of the texture cache.
+ * Textures no longer used by any model stay loaded until this budget is exceeded,
+ * after which the least recently used ones are freed first.
+ * Textures used by a model are never freed, so the budget can be exceeded by those.
+ * The default is 0, meaning textures are freed as soon as their last model is freed.
+ *
+ * @param bytes budget in bytes
+ */
+void t3d_texture_cache_set_budget(uint32_t bytes);
+
+/**
+ * Loads a texture into the cache without a model using it (e.g. for the next area/level).
+ * Models referencing the same path later on will use it without loading it again.
+ * Note: with a budget too small to hold it, it gets freed again right away.
+ * @param path ROM path of the texture, as stored in the model (e.g. "rom:/tex.sprite")
+ */
+void t3d_texture_prefetch(const char *path);
+
+/**
+ * Frees all textures in the cache that are no longer used by any model.
+ */
+void t3d_texture_cache_flush();
+
+/**
+ * Returns counters of the texture cache, hit/miss/eviction counts are accumulated since boot.
+ */
+T3DTextureCacheStats t3d_texture_cache_get_stats();
+
 /**
  * Draws a model with a custom configuration.
  * This call can be recorded into a display list.
@@ -273,6 +418,31 @@ static inline void t3d_model_draw(const T3DModel* model) {
   });
 }
 
+/**
+ * Same as 't3d_model_draw_custom', but records the commands into a block on first use
+ * and only replays it afterwards, removing the per-frame CPU cost of static models.
+ *
+ * The block is re-recorded automatically if any of the following changed since the last call:
+ * - the callbacks, 'userData', 'matrices' or 'lodConf' pointers in 'conf'
+ * - the result of 'conf.filterCb' for any object
+ * - the selected level-of-detail of any object
+ *
+ * Callbacks (e.g. 'tileCb', 'dynTextureCb') are only called while recording,
+ * so their output must stay the same until then (e.g. dyn. textures from a fixed surface).
+ * Otherwise call 't3d_model_draw_cached_invalidate' whenever it changes.
+ * Note: this can't be called while recording another block.
+ *
+ * @param model model to draw
+ * @param conf custom configuration
+ */
+void t3d_model_draw_cached(const T3DModel* model, T3DModelDrawConf conf);
+
+/**
+ * Discards the block recorded by 't3d_model_draw_cached', the next call will record it again.
+ * @param model
+ */
+void t3d_model_draw_cached_invalidate(const T3DModel* model);
+
 /**
  * Draws an object in a model directly.\n
  * This will only handle the mesh part, and not any material or texture settings.\n
@@ -285,6 +455,76 @@ static inline void t3d_model_draw(const T3DModel* model) {
  */
 void t3d_model_draw_object(const T3DObject *object, const T3DMat4FP *boneMatrices);
 
+/**
+ * Same as 't3d_model_draw_object', but loads the vertices from a different buffer.
+ * This must have the same layout as the full-detail vertices of the object,
+ * e.g. a modified copy (see 't3d_model_object_get_vertices' and 't3dmorph.h').
+ *
+ * @param object object to draw
+ * @param vertices replacement for the object's vertices
+ * @param boneMatrices matrices in the case of skinned meshes, set to NULL for non-skinned
+ */
+void t3d_model_draw_object_vertices(const T3DObject *object, const T3DVertPacked *vertices, const T3DMat4FP *boneMatrices);
+
+/**
+ * Returns the first full-detail vertex of an object.
+ * These are stored in one block inside the model's vertex buffer, LODs follow after it.
+ * @param object object
+ * @return pointer to the first vertex (-pair)
+ */
+static inline T3DVertPacked* t3d_model_object_get_vertices(const T3DObject *object) {
+  T3DVertPacked *res = object->parts[0].vert;
+  for(uint32_t p = 1; p < object->numParts; p++) {
+    if(object->parts[p].vert < res)res = object->parts[p].vert;
+  }
+  return res;
+}
+
+/**
+ * Returns the levels-of-detail of an object, 'object->lodCount' entries.
+ * Levels are sorted from the highest to lowest detail, the full-detail mesh is not included.
+ * To create them, pass '--lod=levels,ratio' to the gltf importer.
+ * @param object object
+ * @return pointer to the first level, invalid if 'lodCount' is zero
+ */
+static inline T3DObjectLod* t3d_model_object_get_lods(const T3DObject *object) {
+  return (T3DObjectLod*)&object->parts[object->numParts];
+}
+
+/**
+ * Creates a LOD config based on the projection of a viewport.
+ * With this, 'maxError' is in pixels on screen.
+ *
+ * @param viewport viewport with a perspective projection already set
+ * @param camPos camera position in model space
+ * @param maxPixelError max. error in pixels, e.g. 1.0
+ */
+static inline T3DModelLodConf t3d_model_lod_conf_create(const T3DViewport *viewport, const T3DVec3 *camPos, float maxPixelError) {
+  return (T3DModelLodConf){
+    .camPos = *camPos,
+    .errorScale = viewport->size[1] * 0.5f * viewport->matProj.m[1][1],
+    .maxError = maxPixelError
+  };
+}
+
+/**
+ * Selects the level-of-detail for an object.
+ * The lowest detail whose error (projected by the distance to the object's AABB) stays below the limit is used.
+ *
+ * @param object object
+ * @param conf LOD config
+ * @return 0 for the full-detail mesh, otherwise the level (index + 1 in 't3d_model_object_get_lods')
+ */
+uint32_t t3d_model_object_select_lod(const T3DObject *object, const T3DModelLodConf *conf);
+
+/**
+ * Same as 't3d_model_draw_object', but draws a specific level-of-detail.
+ * @param object object to draw
+ * @param lod level, 0 for the full-detail mesh (see 't3d_model_object_select_lod')
+ * @param boneMatrices matrices in the case of skinned meshes, set to NULL for non-skinned
+ */
+void t3d_model_draw_object_lod(const T3DObject *object, uint32_t lod, const T3DMat4FP *boneMatrices);
+
 /**
  * Draws/Applies a material of an object. This can be called before 't3d_model_draw_object'.\n
  * This will set up the texture, CC, and other RDP and t3d settings of the material.\n
@@ -464,6 +704,201 @@ static inline const T3DBvh* t3d_model_bvh_get(const T3DModel *model) {
  */
 void t3d_model_bvh_query_frustum(const T3DBvh *bvh, const T3DFrustum *frustum);
 
+/**
+ * Creates a cache for repeated queries of the same BVH, see 't3d_model_bvh_query_frusta'.
+ * For each node it stores the plane that culled it, which is then tested first in the next query.
+ * Since the camera moves little between frames, this usually rejects a node with a single plane test.
+ *
+ * @param bvh BVH the cache is used with
+ * @return cache, free it with 't3d_model_bvh_query_cache_destroy'
+ */
+T3DBvhQueryCache t3d_model_bvh_query_cache_create(const T3DBvh *bvh);
+
+/**
+ * Frees a cache created with 't3d_model_bvh_query_cache_create'.
+ * @param cache
+ */
+void t3d_model_bvh_query_cache_destroy(T3DBvhQueryCache *cache);
+
+/**
+ * Queries the BVH of a model with multiple frusta at once (e.g. split-screen or shadow views).
+ * The BVH is only traversed once, a subtree is skipped only if it's outside of all frusta.
+ * Objects visible in frustum 'n' get bit 'n' set in their 'isVisible' flag,
+ * so with a single frustum this matches 't3d_model_bvh_query_frustum'.
+ * Note that you need to first set all to false before calling this.
+ *
+ * Tests are done in fixed-point against the s16 bounding boxes and are slightly conservative.
+ * Once a node is fully inside a plane, the plane is no longer tested for anything below it.
+ *
+ * @param bvh BVH to check
+ * @param frusta frusta to check against, in model space
+ * @param frustumCount number of frusta, 1 to 'T3D_BVH_MAX_FRUSTA'
+ * @param cache optional cache (see 't3d_model_bvh_query_cache_create'), can be NULL
+ */
+void t3d_model_bvh_query_frusta(const T3DBvh *bvh, const T3DFrustum *frusta, uint32_t frustumCount, T3DBvhQueryCache *cache);
+
+/**
+ * Returns the morph-targets of an object.
+ * Note that this is optional and may return NULL.
+ * These are imported from glTF morph-targets (aka. shape-keys), see 't3dmorph.h' to apply them.
+ * @param model model
+ * @param object object in the model
+ * @return pointer to the morph-target chunk or NULL if not found
+ */
+static inline const T3DChunkMorph* t3d_model_morph_get(const T3DModel *model, const T3DObject *object) {
+  for(uint32_t i = 0; i < model->chunkCount; i++) {
+    if(model->chunkOffsets[i].type == T3D_CHUNK_TYPE_MORPH) {
+      uint32_t offset = model->chunkOffsets[i].offset & 0x00FFFFFF;
+      const T3DChunkMorph *morph = (T3DChunkMorph*)((char*)model + offset);
+      if(morph->object == object)return morph;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Returns the vertex ranges a morph-target modifies, 'target->rangeCount' entries.
+ * The deltas directly follow the last range, 6 per pair (posA, posB).
+ * @param morph morph-target chunk
+ * @param target target in the chunk
+ * @return pointer to the first range
+ */
+static inline const T3DMorphRange* t3d_model_morph_get_ranges(const T3DChunkMorph *morph, const T3DMorphTarget *target) {
+  return (const T3DMorphRange*)((const char*)morph + target->dataOffset);
+}
+
+/**
+ * Returns the potentially-visible-set (PVS) of a model.
+ * Note that this is optional and may return NULL.
+ * To create one, pass '--pvs=size' to the gltf importer, with 'size' being the cell size.
+ * @param model model
+ * @return pointer to the PVS or NULL if not found
+ */
+static inline const T3DPvs* t3d_model_pvs_get(const T3DModel *model) {
+  for(uint32_t i = 0; i < model->chunkCount; i++) {
+    if(model->chunkOffsets[i].type == T3D_CHUNK_TYPE_PVS) {
+      uint32_t offset = model->chunkOffsets[i].offset & 0x00FFFFFF;
+      return (T3DPvs*)((char*)model + offset);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Returns the visibility bitset of the cell containing a position.
+ * Objects are numbered in the order they appear in the model (see 't3d_model_iter_create'),
+ * object 'n' is visible if bit 'n%8' of byte 'n/8' is set.
+ *
+ * @param pvs PVS, see 't3d_model_pvs_get'
+ * @param pos position in model space
+ * @return bitset of 'pvs->setSize' bytes, or NULL if the position is outside the grid
+ */
+const uint8_t* t3d_model_pvs_get_set(const T3DPvs *pvs, const T3DVec3 *pos);
+
+/**
+ * Marks all objects potentially visible from a position via the 'isVisible' flag.
+ * This is a lookup of the cell the camera is in, the data was precomputed by the importer.
+ * Objects are additionally checked against a frustum if one is given,
+ * so this can be used instead of 't3d_model_bvh_query_frustum'.
+ * Unlike the BVH query, this sets 'isVisible' of every object, no reset is needed before.
+ * Outside the grid all objects count as potentially visible.
+ *
+ * @param model model the PVS belongs to
+ * @param pvs PVS, see 't3d_model_pvs_get'
+ * @param camPos camera position in model space
+ * @param frustum optional frustum in model space, can be NULL
+ */
+void t3d_model_pvs_query(const T3DModel *model, const T3DPvs *pvs, const T3DVec3 *camPos, const T3DFrustum *frustum);
+
+/**
+ * Returns the collision-mesh of a model.
+ * Note that this is optional and may return NULL.
+ * To create one, pass '--collision' to the gltf importer, or '--collision=tag'
+ * to only include objects which have 'tag' in their object or material name.
+ * Skinned meshes are never included.
+ *
+ * @param model model
+ * @return pointer to the collision-mesh or NULL if not found
+ */
+static inline const T3DCollision* t3d_model_collision_get(const T3DModel *model) {
+  for(uint32_t i = 0; i < model->chunkCount; i++) {
+    if(model->chunkOffsets[i].type == T3D_CHUNK_TYPE_COLLISION) {
+      uint32_t offset = model->chunkOffsets[i].offset & 0x00FFFFFF;
+      return (T3DCollision*)((char*)model + offset);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Returns the triangles of a collision-mesh, indices as used in 'T3DCollisionHit'.
+ * @param coll collision-mesh
+ */
+static inline const T3DCollisionTri* t3d_model_collision_get_tris(const T3DCollision *coll) {
+  return (const T3DCollisionTri*)&coll->nodes[coll->nodeCount];
+}
+
+/**
+ * Returns the vertex positions of a collision-mesh (3 values per vertex).
+ * @param coll collision-mesh
+ */
+static inline const int16_t* t3d_model_collision_get_verts(const T3DCollision *coll) {
+  return (const int16_t*)&t3d_model_collision_get_tris(coll)[coll->triCount];
+}
+
+/**
+ * Casts a ray against a collision-mesh and returns the closest hit.
+ * Triangles are double-sided.
+ * Note that the mesh is in model space, so the ray may need to be transformed before.
+ *
+ * @param coll collision-mesh, see 't3d_model_collision_get'
+ * @param origin start of the ray
+ * @param dir normalized direction
+ * @param maxDist max. distance to check
+ * @param hit result, only written to if something was hit
+ * @return true if something was hit
+ */
+bool t3d_model_collision_raycast(
+  const T3DCollision *coll, const T3DVec3 *origin, const T3DVec3 *dir, float maxDist, T3DCollisionHit *hit
+);
+
+/**
+ * Moves a sphere along a direction and returns the first contact with a collision-mesh.
+ * If the sphere already overlaps a triangle at the start, the hit has a distance of 0.
+ * Note that the mesh is in model space, so positions may need to be transformed before.
+ *
+ * @param coll collision-mesh, see 't3d_model_collision_get'
+ * @param center start position of the sphere
+ * @param radius sphere radius
+ * @param dir normalized direction
+ * @param maxDist distance to move
+ * @param hit result, only written to if something was hit
+ * @return true if something was hit
+ */
+bool t3d_model_collision_sweep_sphere(
+  const T3DCollision *coll, const T3DVec3 *center, float radius,
+  const T3DVec3 *dir, float maxDist, T3DCollisionHit *hit
+);
+
+/**
+ * Moves a capsule along a direction and returns the first contact with a collision-mesh.
+ * If the capsule already overlaps a triangle at the start, the hit has a distance of 0.
+ * Note that the mesh is in model space, so positions may need to be transformed before.
+ *
+ * @param coll collision-mesh, see 't3d_model_collision_get'
+ * @param posA start position of the first point of the capsule axis
+ * @param posB start position of the second point of the capsule axis
+ * @param radius capsule radius
+ * @param dir normalized direction
+ * @param maxDist distance to move
+ * @param hit result, only written to if something was hit
+ * @return true if something was hit
+ */
+bool t3d_model_collision_sweep_capsule(
+  const T3DCollision *coll, const T3DVec3 *posA, const T3DVec3 *posB, float radius,
+  const T3DVec3 *dir, float maxDist, T3DCollisionHit *hit
+);
+
 #ifdef __cplusplus
 }
 #endif
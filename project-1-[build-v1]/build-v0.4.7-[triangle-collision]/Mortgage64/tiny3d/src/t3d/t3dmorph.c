@@ -0,0 +1,114 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#include "t3dmorph.h"
+#include <malloc.h>
+
+T3DMorph t3d_morph_create(const T3DModel *model, const T3DObject *object) {
+  const T3DChunkMorph *morphRef = t3d_model_morph_get(model, object);
+  assertf(morphRef != NULL, "Object has no morph-targets: %s", object->name ? object->name : "?");
+
+  uint32_t pairCount = morphRef->vertCount / 2;
+  uint32_t bufferSize = sizeof(T3DVertPacked) * pairCount;
+  T3DMorph morph = (T3DMorph){
+    .morphRef = morphRef,
+    .baseVerts = t3d_model_object_get_vertices(object),
+    .buffers = memalign(16, bufferSize * 2),
+    .weights = malloc(sizeof(float) * morphRef->targetCount * 3),
+    .currentBufferIdx = 0,
+  };
+  morph.bufferWeights = morph.weights + morphRef->targetCount;
+  memset(morph.weights, 0, sizeof(float) * morphRef->targetCount * 3);
+
+  // everything except positions of modified ranges stays the same from here on
+  memcpy(morph.buffers, morph.baseVerts, bufferSize);
+  memcpy(morph.buffers + pairCount, morph.baseVerts, bufferSize);
+  data_cache_hit_writeback(morph.buffers, bufferSize * 2);
+  return morph;
+}
+
+int t3d_morph_get_target_index(const T3DMorph *morph, const char *name) {
+  for(int i = 0; i < morph->morphRef->targetCount; i++) {
+    if(strcmp(morph->morphRef->targets[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static inline bool target_is_used(const T3DMorph *morph, const float *lastWeights, uint32_t t) {
+  return morph->weights[t] != 0.0f || lastWeights[t] != 0.0f;
+}
+
+void t3d_morph_update(T3DMorph *morph) {
+  const T3DChunkMorph *morphRef = morph->morphRef;
+  morph->currentBufferIdx ^= 1;
+  T3DVertPacked *verts = (T3DVertPacked*)t3d_morph_get_vertices(morph);
+  float *lastWeights = morph->bufferWeights + morph->currentBufferIdx * morphRef->targetCount;
+
+  // restore the base positions of everything this buffer had applied before, or will apply now
+  for(uint32_t t = 0; t < morphRef->targetCount; t++) {
+    if(!target_is_used(morph, lastWeights, t))continue;
+    const T3DMorphTarget *target = &morphRef->targets[t];
+    const T3DMorphRange *ranges = t3d_model_morph_get_ranges(morphRef, target);
+
+    for(uint32_t r = 0; r < target->rangeCount; r++) {
+      uint32_t end = ranges[r].pairStart + ranges[r].pairCount;
+      for(uint32_t p = ranges[r].pairStart; p < end; p++) {
+        memcpy(verts[p].posA, morph->baseVerts[p].posA, sizeof(int16_t) * 3);
+        memcpy(verts[p].posB, morph->baseVerts[p].posB, sizeof(int16_t) * 3);
+      }
+    }
+  }
+
+  // add the deltas on top, weights are converted to 8.8 fixed-point (incl. the target's quantization)
+  for(uint32_t t = 0; t < morphRef->targetCount; t++) {
+    if(morph->weights[t] == 0.0f)continue;
+    const T3DMorphTarget *target = &morphRef->targets[t];
+    const T3DMorphRange *ranges = t3d_model_morph_get_ranges(morphRef, target);
+    const int8_t *deltas = (const int8_t*)&ranges[target->rangeCount];
+    int32_t weight = (int32_t)(morph->weights[t] * 256.0f) * (1 << target->shift);
+
+    for(uint32_t r = 0; r < target->rangeCount; r++) {
+      uint32_t end = ranges[r].pairStart + ranges[r].pairCount;
+      for(uint32_t p = ranges[r].pairStart; p < end; p++) {
+        verts[p].posA[0] += (deltas[0] * weight) >> 8;
+        verts[p].posA[1] += (deltas[1] * weight) >> 8;
+        verts[p].posA[2] += (deltas[2] * weight) >> 8;
+        verts[p].posB[0] += (deltas[3] * weight) >> 8;
+        verts[p].posB[1] += (deltas[4] * weight) >> 8;
+        verts[p].posB[2] += (deltas[5] * weight) >> 8;
+        deltas += 6;
+      }
+    }
+  }
+
+  // the RSP reads from RDRAM, so flush exactly the ranges that were modified
+  morph->pairsUpdated = 0;
+  for(uint32_t t = 0; t < morphRef->targetCount; t++) {
+    if(!target_is_used(morph, lastWeights, t))continue;
+    const T3DMorphTarget *target = &morphRef->targets[t];
+    const T3DMorphRange *ranges = t3d_model_morph_get_ranges(morphRef, target);
+
+    for(uint32_t r = 0; r < target->rangeCount; r++) {
+      data_cache_hit_writeback(&verts[ranges[r].pairStart], sizeof(T3DVertPacked) * ranges[r].pairCount);
+      morph->pairsUpdated += ranges[r].pairCount;
+    }
+  }
+
+  memcpy(lastWeights, morph->weights, sizeof(float) * morphRef->targetCount);
+}
+
+void t3d_morph_destroy(T3DMorph *morph) {
+  if(morph->buffers != NULL) {
+    free(morph->buffers);
+    morph->buffers = NULL;
+  }
+  if(morph->weights != NULL) {
+    free(morph->weights);
+    morph->weights = NULL;
+    morph->bufferWeights = NULL;
+  }
+  morph->morphRef = NULL;
+}
@@ -0,0 +1,99 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#ifndef TINY3D_T3DMORPH_H
+#define TINY3D_T3DMORPH_H
+
+#include "t3dmodel.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * Morph-target instance of an object (aka. shape-keys / blend-shapes).
+ * Holds two copies of the object's vertices, one is modified while the other one may still be drawn.
+ * Only positions are affected, normals keep the values of the base mesh.
+ */
+typedef struct {
+  const T3DChunkMorph *morphRef; // reference to the model, defines targets and deltas
+  const T3DVertPacked *baseVerts; // full-detail vertices of the object inside the model
+  T3DVertPacked *buffers; // two copies of the vertices, alternated by each update
+  float *weights; // current weight per target, see 't3d_morph_set_weight'
+  float *bufferWeights; // weights each buffer was last updated with, 'targetCount' per buffer
+  uint8_t currentBufferIdx;
+  uint16_t pairsUpdated; // vertex-pairs written by the last update, for debugging
+} T3DMorph;
+
+/**
+ * Creates a morph instance for an object, all weights start at zero.
+ * To create morph-targets, export shape-keys into the glTF file, they are imported automatically.
+ * Note that objects with morph-targets don't get any LODs from the importer.
+ *
+ * @param model model containing the object
+ * @param object object to morph, must have morph-targets (see 't3d_model_morph_get')
+ * @return morph instance, free it with 't3d_morph_destroy'
+ */
+T3DMorph t3d_morph_create(const T3DModel *model, const T3DObject *object);
+
+/**
+ * Returns the index of a target by name.
+ * @param morph morph instance
+ * @param name name of the target
+ * @return index or -1 if not found
+ */
+int t3d_morph_get_target_index(const T3DMorph *morph, const char *name);
+
+/**
+ * Sets the weight of a target, this is only applied in the next 't3d_morph_update'.
+ * @param morph morph instance
+ * @param targetIdx index of the target
+ * @param weight 0.0-1.0, you are allowed to go beyond these values to exaggerate a target
+ */
+static inline void t3d_morph_set_weight(T3DMorph *morph, uint32_t targetIdx, float weight) {
+  assertf(targetIdx < morph->morphRef->targetCount, "Invalid morph-target index: %d", (int)targetIdx);
+  morph->weights[targetIdx] = weight;
+}
+
+/**
+ * Applies the current weights into the next vertex buffer and makes it the active one.
+ * Only the vertex ranges of targets that have a weight now, or had one when the buffer was last updated, are touched.
+ * Since the buffer drawn in the previous frame is left alone, call this at most once per frame.
+ *
+ * @param morph morph instance
+ */
+void t3d_morph_update(T3DMorph *morph);
+
+/**
+ * Returns the vertices of the last update, same layout as 't3d_model_object_get_vertices'.
+ * @param morph morph instance
+ * @return pointer to the first vertex (-pair)
+ */
+static inline const T3DVertPacked* t3d_morph_get_vertices(const T3DMorph *morph) {
+  return morph->buffers + morph->currentBufferIdx * (morph->morphRef->vertCount / 2);
+}
+
+/**
+ * Draws the object with the morphed vertices, same as 't3d_model_draw_object' otherwise.
+ * NOTE: the vertex buffer changes with each update, so this must not be recorded into a block.
+ *
+ * @param morph morph instance
+ * @param boneMatrices matrices in the case of skinned meshes, set to NULL for non-skinned
+ */
+static inline void t3d_morph_draw(const T3DMorph *morph, const T3DMat4FP *boneMatrices) {
+  t3d_model_draw_object_vertices(morph->morphRef->object, t3d_morph_get_vertices(morph), boneMatrices);
+}
+
+/**
+ * Frees the memory of a morph instance.
+ * @param morph
+ */
+void t3d_morph_destroy(T3DMorph *morph);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TINY3D_T3DMORPH_H
@@ -0,0 +1,107 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+
+#include "t3d/t3dpose.h"
+#include <malloc.h>
+
+T3DPoseCache t3d_pose_cache_create(const T3DModel *model, float timeStep, int bufferCount) {
+  T3DPoseCache cache = (T3DPoseCache){
+    .model = model,
+    .skeleton = t3d_skeleton_create(model),
+    .entries = NULL,
+    .entryCount = 0,
+    .anims = NULL,
+    .animCount = 0,
+    .timeStep = timeStep,
+    .frame = bufferCount, // lets new entries be evictable right away
+    .bufferCount = bufferCount,
+  };
+
+  // matrices are written directly into the cache entries
+  free_uncached(cache.skeleton.boneMatricesFP);
+  cache.skeleton.boneMatricesFP = NULL;
+  return cache;
+}
+
+static T3DAnim* get_anim(T3DPoseCache *cache, const T3DChunkAnim *animRef) {
+  for(uint32_t i = 0; i < cache->animCount; i++) {
+    if(cache->anims[i].animRef == animRef)return &cache->anims[i].anim;
+  }
+
+  cache->anims = realloc(cache->anims, sizeof(T3DPoseCacheAnim) * (cache->animCount + 1));
+  T3DPoseCacheAnim *res = &cache->anims[cache->animCount++];
+  res->animRef = animRef;
+  res->anim = t3d_anim_create_resident(cache->model, animRef->name);
+  t3d_anim_attach(&res->anim, &cache->skeleton);
+  return &res->anim;
+}
+
+static void evaluate_pose(T3DPoseCache *cache, T3DPoseCacheEntry *entry) {
+  T3DAnim *anim = get_anim(cache, entry->animRef);
+
+  // start from the resting pose, other animations may have changed bones this one doesn't touch.
+  // This also marks all bones as changed, so the full set of matrices is written
+  t3d_skeleton_reset(&cache->skeleton);
+  t3d_anim_set_time(anim, (float)entry->timeTick * cache->timeStep);
+  t3d_anim_update(anim, 0.0f);
+
+  cache->skeleton.boneMatricesFP = entry->matrices;
+  t3d_skeleton_update(&cache->skeleton);
+  cache->skeleton.boneMatricesFP = NULL;
+}
+
+const T3DMat4FP* t3d_pose_cache_get(T3DPoseCache *cache, const T3DChunkAnim *animRef, float time) {
+  if(time >= animRef->duration)time = fmodf(time, animRef->duration);
+  if(time < 0.0f)time = 0.0f;
+  uint32_t timeTick = (uint32_t)(time / cache->timeStep);
+
+  // look for the pose, and at the same time for the least recently used entry that can be replaced
+  T3DPoseCacheEntry *entryFree = NULL;
+  for(uint32_t i = 0; i < cache->entryCount; i++) {
+    T3DPoseCacheEntry *entry = &cache->entries[i];
+    if(entry->animRef == animRef && entry->timeTick == timeTick) {
+      entry->lastFrame = cache->frame;
+      cache->hits++;
+      return entry->matrices;
+    }
+
+    // entries used in the last few frames may still be read by the RSP
+    if(entry->lastFrame + cache->bufferCount <= cache->frame) {
+      if(!entryFree || entry->lastFrame < entryFree->lastFrame)entryFree = entry;
+    }
+  }
+
+  cache->misses++;
+  if(!entryFree) {
+    cache->entries = realloc(cache->entries, sizeof(T3DPoseCacheEntry) * (cache->entryCount + 1));
+    entryFree = &cache->entries[cache->entryCount++];
+    entryFree->matrices = malloc_uncached(sizeof(T3DMat4FP) * cache->skeleton.skeletonRef->boneCount);
+  }
+
+  entryFree->animRef = animRef;
+  entryFree->timeTick = timeTick;
+  entryFree->lastFrame = cache->frame;
+  evaluate_pose(cache, entryFree);
+  return entryFree->matrices;
+}
+
+void t3d_pose_cache_destroy(T3DPoseCache *cache) {
+  rspq_wait();
+
+  for(uint32_t i = 0; i < cache->entryCount; i++) {
+    free_uncached(cache->entries[i].matrices);
+  }
+  for(uint32_t i = 0; i < cache->animCount; i++) {
+    t3d_anim_destroy(&cache->anims[i].anim);
+  }
+  free(cache->entries);
+  free(cache->anims);
+  t3d_skeleton_destroy(&cache->skeleton);
+
+  cache->entries = NULL;
+  cache->anims = NULL;
+  cache->entryCount = 0;
+  cache->animCount = 0;
+}
@@ -0,0 +1,108 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#ifndef TINY3D_T3DPOSE_H
+#define TINY3D_T3DPOSE_H
+
+#include "t3dmodel.h"
+#include "t3dskeleton.h"
+#include "t3danim.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct {
+  const T3DChunkAnim *animRef;
+  uint32_t timeTick; // quantized time, see 'T3DPoseCache.timeStep'
+  uint32_t lastFrame; // frame this was last used in
+  T3DMat4FP *matrices; // bone matrices, shared by all users of this pose
+} T3DPoseCacheEntry;
+
+typedef struct {
+  const T3DChunkAnim *animRef;
+  T3DAnim anim; // resident instance, used to evaluate poses
+} T3DPoseCacheAnim;
+
+/**
+ * Cache of evaluated skeleton poses, keyed by animation and quantized time.
+ * Instances playing the same animation at (almost) the same time share one set of bone matrices,
+ * so the cost of skinning no longer scales with the instance count.
+ */
+typedef struct {
+  const T3DModel *model;
+  T3DSkeleton skeleton; // used to evaluate poses, matrices point into the entries
+  T3DPoseCacheEntry *entries;
+  uint32_t entryCount;
+  T3DPoseCacheAnim *anims;
+  uint32_t animCount;
+
+  float timeStep; // time quantization in seconds
+  uint32_t frame;
+  uint8_t bufferCount; // frames an entry stays untouched after being used
+
+  uint32_t hits;
+  uint32_t misses;
+} T3DPoseCache;
+
+/**
+ * Creates a pose cache for a skinned model.
+ * @param model model with a skeleton, the animations used must be part of it
+ * @param timeStep time quantization in seconds, e.g. '1.0f / 30.0f'
+ * @param bufferCount frames a pose may still be used by the RSP, should match the frame-buffer count
+ * @return pose cache, free it with 't3d_pose_cache_destroy'
+ */
+T3DPoseCache t3d_pose_cache_create(const T3DModel *model, float timeStep, int bufferCount);
+
+/**
+ * Marks the start of a new frame, call this once per frame before any 't3d_pose_cache_get'.
+ * Poses not used in the last 'bufferCount' frames may then be re-used for other poses.
+ * @param cache
+ */
+static inline void t3d_pose_cache_new_frame(T3DPoseCache *cache) {
+  cache->frame++;
+}
+
+/**
+ * Returns the bone matrices of an animation at a given time.
+ * The time is quantized to 'timeStep', on a miss the pose is evaluated once and stored.
+ * The result can be used for drawing via 'T3DModelDrawConf.matrices' (see 't3d_model_draw_pose'),
+ * and stays valid until 'bufferCount' frames after the last use.
+ *
+ * Note: blended or otherwise modified poses can't be cached, use a regular skeleton for those.
+ *
+ * @param cache pose cache
+ * @param animRef animation, see 't3d_model_get_animation'
+ * @param time time in seconds
+ * @return fixed-point bone matrices
+ */
+const T3DMat4FP* t3d_pose_cache_get(T3DPoseCache *cache, const T3DChunkAnim *animRef, float time);
+
+/**
+ * Draws a skinned model with bone matrices from a pose cache.
+ * @param model model to draw
+ * @param matrices bone matrices, see 't3d_pose_cache_get'
+ */
+static inline void t3d_model_draw_pose(const T3DModel* model, const T3DMat4FP *matrices) {
+  t3d_model_draw_custom(model, (T3DModelDrawConf){
+    .userData = NULL,
+    .tileCb = NULL,
+    .filterCb = NULL,
+    .matrices = matrices
+  });
+}
+
+/**
+ * Frees all poses and the internal animations.
+ * Note: this waits for the RSP to be idle.
+ * @param cache
+ */
+void t3d_pose_cache_destroy(T3DPoseCache *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TINY3D_T3DPOSE_H
@@ -0,0 +1,185 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+
+#include "t3d/t3drenderqueue.h"
+#include <malloc.h>
+
+T3DRenderQueue t3d_render_queue_create(uint32_t capacity) {
+  if(capacity == 0)capacity = 16;
+  return (T3DRenderQueue){
+    .entries = malloc(sizeof(T3DRenderQueueEntry) * capacity),
+    .count = 0,
+    .capacity = capacity,
+  };
+}
+
+// same classification as the sorting in the gltf_importer
+static uint8_t material_get_layer(const T3DMaterial *mat) {
+  if(mat->blendMode == RDPQ_BLENDER_MULTIPLY)return T3D_RENDER_LAYER_TRANSPARENT;
+  if((mat->otherModeValue & SOM_ZMODE_MASK) == SOM_ZMODE_DECAL)return T3D_RENDER_LAYER_DECAL;
+  return T3D_RENDER_LAYER_OPAQUE;
+}
+
+// only used to group equal states next to each other, collisions just cost a few extra state changes
+static uint32_t material_get_state_key(const T3DMaterial *mat) {
+  uint32_t key = (uint32_t)mat->colorCombiner ^ (uint32_t)(mat->colorCombiner >> 32);
+  key = key * 0x9E3779B1 ^ (uint32_t)mat->otherModeValue ^ (uint32_t)(mat->otherModeValue >> 32);
+  key = key * 0x9E3779B1 ^ mat->blendMode;
+  key = key * 0x9E3779B1 ^ mat->renderFlags ^ ((uint32_t)mat->vertexFxFunc << 24);
+  return key;
+}
+
+void t3d_render_queue_add(
+  T3DRenderQueue *queue, const T3DModel *model, const T3DObject *object,
+  const T3DMat4FP *matrix, const T3DMat4FP *boneMatrices, float depth
+) {
+  if(queue->count == queue->capacity) {
+    queue->capacity *= 2;
+    queue->entries = realloc(queue->entries, sizeof(T3DRenderQueueEntry) * queue->capacity);
+  }
+
+  T3DRenderQueueEntry *entry = &queue->entries[queue->count];
+  *entry = (T3DRenderQueueEntry){
+    .model = model,
+    .object = object,
+    .matrix = matrix,
+    .boneMatrices = boneMatrices,
+    .depth = depth,
+    .order = queue->count,
+    .layer = T3D_RENDER_LAYER_OPAQUE,
+  };
+
+  const T3DMaterial *mat = object->material;
+  if(mat) {
+    entry->textureHashA = mat->textureA.textureHash;
+    entry->textureHashB = mat->textureB.textureHash;
+    entry->stateKey = material_get_state_key(mat);
+    entry->layer = material_get_layer(mat);
+  }
+  ++queue->count;
+}
+
+void t3d_render_queue_add_model(
+  T3DRenderQueue *queue, const T3DModel *model,
+  const T3DMat4FP *matrix, const T3DMat4FP *boneMatrices, float depth
+) {
+  T3DModelIter it = t3d_model_iter_create(model, T3D_CHUNK_TYPE_OBJECT);
+  while(t3d_model_iter_next(&it)) {
+    t3d_render_queue_add(queue, model, it.object, matrix, boneMatrices, depth);
+  }
+}
+
+static int entry_compare(const void *a, const void *b) {
+  const T3DRenderQueueEntry *entA = (const T3DRenderQueueEntry*)a;
+  const T3DRenderQueueEntry *entB = (const T3DRenderQueueEntry*)b;
+
+  if(entA->layer != entB->layer)return entA->layer < entB->layer ? -1 : 1;
+
+  // transparent objects need to be blended in order, materials only matter for equal depths
+  if(entA->layer == T3D_RENDER_LAYER_TRANSPARENT && entA->depth != entB->depth) {
+    return entA->depth > entB->depth ? -1 : 1;
+  }
+
+  if(entA->textureHashA != entB->textureHashA)return entA->textureHashA < entB->textureHashA ? -1 : 1;
+  if(entA->textureHashB != entB->textureHashB)return entA->textureHashB < entB->textureHashB ? -1 : 1;
+  if(entA->stateKey != entB->stateKey)return entA->stateKey < entB->stateKey ? -1 : 1;
+  if(entA->object->material != entB->object->material) {
+    return (uint32_t)entA->object->material < (uint32_t)entB->object->material ? -1 : 1;
+  }
+
+  // front-to-back within the same material, lets the z-buffer reject more pixels
+  if(entA->depth != entB->depth)return entA->depth < entB->depth ? -1 : 1;
+  if(entA->matrix != entB->matrix)return (uint32_t)entA->matrix < (uint32_t)entB->matrix ? -1 : 1;
+  return entA->order < entB->order ? -1 : (entA->order > entB->order ? 1 : 0);
+}
+
+static inline bool material_needs_upload(const T3DMaterial *mat, uint32_t lastHashA, uint32_t lastHashB) {
+  return mat->colorCombiner && (mat->textureA.textureHash != lastHashA || mat->textureB.textureHash != lastHashB);
+}
+
+// counts the state changes of drawing each model separately in submission order (see 't3d_model_draw_custom')
+static T3DRenderQueueStats count_unsorted(const T3DRenderQueue *queue) {
+  T3DRenderQueueStats stats = {0};
+  const T3DModel *lastModel = NULL;
+  const T3DMat4FP *lastMatrix = NULL;
+  uint32_t lastHashA = 0;
+  uint32_t lastHashB = 0;
+
+  for(uint32_t i = 0; i < queue->count; i++) {
+    const T3DRenderQueueEntry *entry = &queue->entries[i];
+    if(i == 0 || entry->model != lastModel || entry->matrix != lastMatrix) {
+      lastModel = entry->model;
+      lastMatrix = entry->matrix;
+      lastHashA = 0;
+      lastHashB = 0;
+      stats.matrixLoads++;
+    }
+
+    const T3DMaterial *mat = entry->object->material;
+    if(!mat)continue;
+    stats.materialChanges++;
+    if(material_needs_upload(mat, lastHashA, lastHashB)) {
+      lastHashA = mat->textureA.textureHash;
+      lastHashB = mat->textureB.textureHash;
+      stats.textureUploads++;
+    }
+  }
+  return stats;
+}
+
+static inline uint32_t count_saved(uint32_t before, uint32_t after) {
+  return before > after ? before - after : 0;
+}
+
+void t3d_render_queue_flush(T3DRenderQueue *queue, T3DModelDrawConf *conf) {
+  T3DRenderQueueStats unsorted = count_unsorted(queue);
+  qsort(queue->entries, queue->count, sizeof(T3DRenderQueueEntry), entry_compare);
+
+  T3DModelState state = t3d_model_state_create();
+  state.drawConf = conf;
+
+  T3DRenderQueueStats stats = {.entryCount = queue->count};
+  const T3DMaterial *lastMat = NULL;
+  const T3DMat4FP *lastMatrix = NULL;
+
+  // all entries share one stack slot, each matrix is set relative to the one below
+  if(queue->count)t3d_matrix_push_pos(1);
+
+  for(uint32_t i = 0; i < queue->count; i++) {
+    const T3DRenderQueueEntry *entry = &queue->entries[i];
+    T3DMaterial *mat = entry->object->material;
+
+    if(mat && mat != lastMat) {
+      if(material_needs_upload(mat, state.lastTextureHashA, state.lastTextureHashB))stats.textureUploads++;
+      t3d_model_draw_material(mat, &state);
+      stats.materialChanges++;
+      lastMat = mat;
+    }
+
+    if(entry->matrix != lastMatrix) {
+      t3d_matrix_set(entry->matrix, true);
+      lastMatrix = entry->matrix;
+      stats.matrixLoads++;
+    }
+
+    t3d_model_draw_object(entry->object, entry->boneMatrices);
+  }
+
+  if(queue->count)t3d_matrix_pop(1);
+  if(state.lastVertFXFunc != T3D_VERTEX_FX_NONE)t3d_state_set_vertex_fx(T3D_VERTEX_FX_NONE, 0, 0);
+
+  stats.materialChangesSaved = count_saved(unsorted.materialChanges, stats.materialChanges);
+  stats.textureUploadsSaved = count_saved(unsorted.textureUploads, stats.textureUploads);
+  stats.matrixLoadsSaved = count_saved(unsorted.matrixLoads, stats.matrixLoads);
+  queue->stats = stats;
+  queue->count = 0;
+}
+
+void t3d_render_queue_destroy(T3DRenderQueue *queue) {
+  free(queue->entries);
+  queue->entries = NULL;
+  queue->count = 0;
+  queue->capacity = 0;
+}
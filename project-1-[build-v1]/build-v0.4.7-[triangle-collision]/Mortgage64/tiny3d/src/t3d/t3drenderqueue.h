@@ -0,0 +1,117 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#ifndef TINY3D_T3DRENDERQUEUE_H
+#define TINY3D_T3DRENDERQUEUE_H
+
+#include "t3dmodel.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define T3D_RENDER_LAYER_OPAQUE      0
+#define T3D_RENDER_LAYER_DECAL       1
+#define T3D_RENDER_LAYER_TRANSPARENT 2 // drawn back-to-front, after everything else
+
+typedef struct {
+  const T3DModel *model;
+  const T3DObject *object;
+  const T3DMat4FP *matrix;
+  const T3DMat4FP *boneMatrices; // NULL if not skinned
+
+  // sort keys, taken from the material when added
+  uint32_t textureHashA;
+  uint32_t textureHashB;
+  uint32_t stateKey; // hash of the remaining RDP state (combiner, other-modes, blender)
+  float depth;
+  uint32_t order; // submission order, keeps the sort stable
+  uint8_t layer; // see T3D_RENDER_LAYER_xxx
+  uint8_t _padding[3];
+} T3DRenderQueueEntry;
+
+typedef struct {
+  uint32_t entryCount;
+  uint32_t materialChanges; // calls to 't3d_model_draw_material'
+  uint32_t textureUploads;
+  uint32_t matrixLoads;
+
+  // state changes avoided compared to drawing the same entries in submission order,
+  // with a fresh state per model (same as 't3d_model_draw_custom' per model)
+  uint32_t materialChangesSaved;
+  uint32_t textureUploadsSaved;
+  uint32_t matrixLoadsSaved;
+} T3DRenderQueueStats;
+
+/**
+ * Collects objects of multiple models across a frame,
+ * to then draw them sorted by layer, material and depth with a shared material state.
+ */
+typedef struct {
+  T3DRenderQueueEntry *entries;
+  uint32_t count;
+  uint32_t capacity;
+  T3DRenderQueueStats stats; // stats of the last flush
+} T3DRenderQueue;
+
+/**
+ * Creates an empty render queue.
+ * @param capacity initial amount of entries, grows automatically if exceeded
+ * @return queue, free it with 't3d_render_queue_destroy'
+ */
+T3DRenderQueue t3d_render_queue_create(uint32_t capacity);
+
+/**
+ * Adds a single object to the queue.
+ * The model, object and matrices must stay valid until 't3d_render_queue_flush' is called.
+ *
+ * @param queue queue to add to
+ * @param model model the object belongs to
+ * @param object object to draw
+ * @param matrix model matrix, multiplied with the matrix on the stack at the time of the flush
+ * @param boneMatrices bone matrices for skinned models, NULL otherwise
+ * @param depth distance to the camera, used to sort objects in the same layer
+ */
+void t3d_render_queue_add(
+  T3DRenderQueue *queue, const T3DModel *model, const T3DObject *object,
+  const T3DMat4FP *matrix, const T3DMat4FP *boneMatrices, float depth
+);
+
+/**
+ * Adds all objects of a model to the queue, see 't3d_render_queue_add'.
+ * @param queue queue to add to
+ * @param model model to draw
+ * @param matrix model matrix
+ * @param boneMatrices bone matrices for skinned models, NULL otherwise
+ * @param depth distance to the camera, used for all objects
+ */
+void t3d_render_queue_add_model(
+  T3DRenderQueue *queue, const T3DModel *model,
+  const T3DMat4FP *matrix, const T3DMat4FP *boneMatrices, float depth
+);
+
+/**
+ * Sorts and draws all entries, then clears the queue.
+ * Entries are ordered by layer (opaque, decal, transparent), then by texture and material state.
+ * Opaque objects with the same material are drawn front-to-back, transparent ones back-to-front.
+ * The material state is kept across models, and consecutive entries with the same matrix only load it once.
+ * This call can be recorded into a display list.
+ *
+ * @param queue queue to draw
+ * @param conf optional draw settings (tile/dyn.-texture callbacks), filter and LOD settings are ignored
+ */
+void t3d_render_queue_flush(T3DRenderQueue *queue, T3DModelDrawConf *conf);
+
+/**
+ * Frees the memory of the queue.
+ * @param queue
+ */
+void t3d_render_queue_destroy(T3DRenderQueue *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TINY3D_T3DRENDERQUEUE_H
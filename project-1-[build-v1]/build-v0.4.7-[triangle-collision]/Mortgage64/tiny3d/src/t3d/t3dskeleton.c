@@ -3,6 +3,7 @@
 * @license MIT
 */
 #include "t3dskeleton.h"
+#include "t3danim.h"
 
 T3DSkeleton t3d_skeleton_create_buffered(const T3DModel *model, int bufferCount) {
   const T3DChunkSkeleton *skelRef = t3d_model_get_skeleton(model);
@@ -10,10 +11,11 @@ T3DSkeleton t3d_skeleton_create_buffered(const T3DModel *model, int bufferCount)
 
   T3DSkeleton skel = (T3DSkeleton){
     .bones = malloc(sizeof(T3DBone) * skelRef->boneCount),
-    .boneMatricesFP = malloc_uncached(sizeof(T3DMat4FP) * skelRef->boneCount * bufferCount),
+    .boneMatricesFP = bufferCount > 0 ? malloc_uncached(sizeof(T3DMat4FP) * skelRef->boneCount * bufferCount) : NULL,
     .skeletonRef = skelRef,
     .bufferCount = bufferCount,
     .currentBufferIdx = 0,
+    .blendGen = 0,
   };
 
   t3d_skeleton_reset(&skel);
@@ -25,13 +27,15 @@ T3DSkeleton t3d_skeleton_clone(const T3DSkeleton *skel, bool useMatrices) {
     .bones = malloc(sizeof(T3DBone) * skel->skeletonRef->boneCount),
     .boneMatricesFP = NULL,
     .skeletonRef = skel->skeletonRef,
+    .bufferCount = 0, // without own matrices the clone uses the frame arena
   };
   memcpy(result.bones, skel->bones, sizeof(T3DBone) * skel->skeletonRef->boneCount);
 
-  if(useMatrices) {
+  if(useMatrices && skel->bufferCount > 0) {
     size_t copySize = sizeof(T3DMat4FP) * skel->skeletonRef->boneCount * skel->bufferCount;
     result.boneMatricesFP = malloc_uncached(copySize);
     memcpy(result.boneMatricesFP, skel->boneMatricesFP, copySize);
+    result.bufferCount = skel->bufferCount;
   }
   return result;
 }
@@ -43,6 +47,7 @@ void t3d_skeleton_reset(T3DSkeleton *skeleton) {
       sizeof(T3DVec3) + sizeof(T3DQuat) + sizeof(T3DVec3) // copy all 3 vectors (SRT) at once
     );
     skeleton->bones[i].hasChanged = true;
+    skeleton->bones[i].blendGen = 0;
   }
 }
 
@@ -58,14 +63,26 @@ void t3d_skeleton_blend(const T3DSkeleton *skelRes, const T3DSkeleton *skelA, co
   }
 }
 
-void t3d_skeleton_update(T3DSkeleton *skeleton)
+void t3d_skeleton_blend_layers(T3DSkeleton *skeleton, const T3DSkeletonLayer *layers, uint32_t layerCount, float deltaTime) {
+  // while 'blendGen' is set, 't3d_anim_update_blend' brings each bone back to the rest pose before its first write,
+  // so layers don't build up across frames. Bones no playing layer writes to keep their pose.
+  static uint32_t blendGenCounter = 0;
+  if(++blendGenCounter == 0)++blendGenCounter;
+  skeleton->blendGen = blendGenCounter;
+
+  for(uint32_t l = 0; l < layerCount; l++) {
+    const T3DSkeletonLayer *layer = &layers[l];
+    t3d_anim_update_blend(layer->anim, deltaTime, skeleton, layer->boneMask, layer->weight, layer->additive);
+  }
+  skeleton->blendGen = 0;
+}
+
+// 'convertAll' also writes the matrices of unchanged bones, needed if 'matStackFP' has no previous content
+static void skeleton_update_matrices(T3DSkeleton *skeleton, T3DMat4FP *matStackFP, bool convertAll)
 {
   int updateLevel = -1;
   bool forceUpdate = false;
 
-  skeleton->currentBufferIdx = (skeleton->currentBufferIdx + 1) % skeleton->bufferCount;
-  T3DMat4FP* matStackFP = &skeleton->boneMatricesFP[skeleton->skeletonRef->boneCount * skeleton->currentBufferIdx];
-
   for(int i = 0; i < skeleton->skeletonRef->boneCount; i++)
   {
     T3DBone *bone = &skeleton->bones[i];
@@ -83,20 +100,31 @@ void t3d_skeleton_update(T3DSkeleton *skeleton)
       if(!forceUpdate)updateLevel = boneDef->depth;
       forceUpdate = true;
 
-      if(boneDef->parentIdx != 0xFFFF) {
-        T3DMat4 tmp;
-        t3d_mat4_from_srt(&tmp, bone->scale.v, bone->rotation.v, bone->position.v);
-        t3d_mat4_mul(&bone->matrix, &skeleton->bones[boneDef->parentIdx].matrix, &tmp);
-      } else {
-        t3d_mat4_from_srt(&bone->matrix, bone->scale.v, bone->rotation.v, bone->position.v);
-      }
-
-      t3d_mat4_to_fixed(&matStackFP[i], &bone->matrix);
+      const T3DMat4 *parentMat = boneDef->parentIdx != 0xFFFF ? &skeleton->bones[boneDef->parentIdx].matrix : NULL;
+      // scale, rotation and position are laid out the same as in 'T3DSRT'
+      t3d_mat4fp_from_srt_mul(&matStackFP[i], &bone->matrix, parentMat, (const T3DSRT*)&bone->scale);
       skeleton->bones[i].hasChanged = false;
+    } else if(convertAll) {
+      t3d_mat4_to_fixed(&matStackFP[i], &bone->matrix);
     }
   }
 }
 
+void t3d_skeleton_update(T3DSkeleton *skeleton)
+{
+  assertf(skeleton->bufferCount > 0, "Skeleton has no matrices, use 't3d_skeleton_update_arena'");
+  skeleton->currentBufferIdx = (skeleton->currentBufferIdx + 1) % skeleton->bufferCount;
+  T3DMat4FP* matStackFP = &skeleton->boneMatricesFP[skeleton->skeletonRef->boneCount * skeleton->currentBufferIdx];
+  skeleton_update_matrices(skeleton, matStackFP, false);
+}
+
+void t3d_skeleton_update_arena(T3DSkeleton *skeleton, T3DFrameArena *arena)
+{
+  assertf(skeleton->bufferCount == 0, "Skeleton has its own matrices, use 't3d_skeleton_update'");
+  skeleton->boneMatricesFP = t3d_frame_arena_alloc_mat4fp(arena, skeleton->skeletonRef->boneCount);
+  skeleton_update_matrices(skeleton, skeleton->boneMatricesFP, true);
+}
+
 int t3d_skeleton_find_bone(T3DSkeleton *skeleton, const char *name) {
   for(int i = 0; i < skeleton->skeletonRef->boneCount; i++) {
     if(strcmp(skeleton->skeletonRef->bones[i].name, name) == 0) {
@@ -112,7 +140,7 @@ void t3d_skeleton_destroy(T3DSkeleton *skeleton) {
     skeleton->bones = NULL;
   }
   if(skeleton->boneMatricesFP != NULL) {
-    free_uncached(skeleton->boneMatricesFP);
+    if(skeleton->bufferCount > 0)free_uncached(skeleton->boneMatricesFP);
     skeleton->boneMatricesFP = NULL;
   }
   skeleton->skeletonRef = NULL;
@@ -6,12 +6,15 @@
 #define TINY3D_T3DSKELETON_H
 
 #include "t3dmodel.h"
+#include "t3dframe.h"
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+typedef struct T3DAnim T3DAnim;
+
 /**
  * Bone instance, part of a skeleton.
  * 'matrix' will get updated by the skeleton when calling t3d_skeleton_update,
@@ -23,6 +26,7 @@ typedef struct {
   T3DQuat rotation;
   T3DVec3 position;
   int32_t hasChanged;
+  uint32_t blendGen; // blend in which the bone was last reset, see 't3d_skeleton_blend_layers'
 } T3DBone;
 
 /**
@@ -32,8 +36,9 @@ typedef struct {
 typedef struct {
   T3DBone* bones;
   T3DMat4FP* boneMatricesFP; // fixed point matrix, used for rendering
-  uint8_t bufferCount; // number of matrices buffers
+  uint8_t bufferCount; // number of matrices buffers, 0 if they come from a frame arena
   uint8_t currentBufferIdx;
+  uint32_t blendGen; // non-zero only during 't3d_skeleton_blend_layers'
   const T3DChunkSkeleton* skeletonRef; // reference to the model, defines skeleton structure
 } T3DSkeleton;
 
@@ -44,7 +49,8 @@ typedef struct {
  * Note that only the fixed-point matrices are buffered, the bone data itself is not.
  *
  * @param model The model to create the skeleton from
- * @param bufferCount number of buffers, should match the frame-buffer count
+ * @param bufferCount number of buffers, should match the frame-buffer count.
+ *                    Set to 0 to allocate the matrices each frame instead, see 't3d_skeleton_update_arena'
  * @return The created skeleton
  */
 T3DSkeleton t3d_skeleton_create_buffered(const T3DModel *model, int bufferCount);
@@ -64,7 +70,7 @@ static inline T3DSkeleton t3d_skeleton_create(const T3DModel *model) {
  * @param skel skeleton to use in the next draw
  */
 static inline void t3d_skeleton_use(const T3DSkeleton *skel) {
-  if(skel->bufferCount > 1) {
+  if(skel->bufferCount != 1) {
     void* mat = skel->boneMatricesFP + skel->currentBufferIdx * skel->skeletonRef->boneCount;
     t3d_segment_set(T3D_SEGMENT_SKELETON, mat);
   }
@@ -74,7 +80,8 @@ static inline void t3d_skeleton_use(const T3DSkeleton *skel) {
  * Clones a skeleton instance.
  * This can also be used to create optimized skeletons for blending animations.
  * @param skel Skeleton to clone
- * @param useMatrices If false, no matrices will be allocated, this is useful for blending animations
+ * @param useMatrices If false, no matrices will be allocated, this is useful for blending animations.
+ *                    The clone then has a 'bufferCount' of 0 and can only be updated via 't3d_skeleton_update_arena'
  * @return Cloned skeleton
  */
 T3DSkeleton t3d_skeleton_clone(const T3DSkeleton *skel, bool useMatrices);
@@ -97,6 +104,35 @@ void t3d_skeleton_reset(T3DSkeleton *skeleton);
  */
 void t3d_skeleton_blend(const T3DSkeleton *skelRes, const T3DSkeleton *skelA, const T3DSkeleton *skelB, float factor);
 
+/**
+ * Layer of an animation blend, see 't3d_skeleton_blend_layers'.
+ */
+typedef struct {
+  T3DAnim *anim; // animation attached to the skeleton that is blended into
+  const uint8_t *boneMask; // bit 'n%8' of byte 'n/8' set to use bone 'n', NULL for all bones
+  float weight; // 0.0-1.0, how much this layer replaces (or adds to) the layers before it
+  bool additive; // adds the difference of the animation to the rest pose, e.g. for recoil or breathing
+} T3DSkeletonLayer;
+
+/**
+ * Samples multiple animations directly into a skeleton, in order.
+ * Each layer either replaces the result of the layers before it by its weight,
+ * or is added on top of it (difference to the rest pose, scaled by weight).
+ * E.g. a full-body locomotion layer, then an upper-body layer via a bone mask, then an additive recoil.
+ *
+ * Only bones written by a playing layer (within its mask) are changed, starting from their rest pose.
+ * All other bones are left untouched and keep their 'hasChanged' flag,
+ * so 't3d_skeleton_update' only recalculates what the layers affect.
+ * Paused or finished layers write nothing, so bones only they animate hold their last pose.
+ * No copy of the skeleton is needed, all animations are attached to the skeleton itself.
+ *
+ * @param skeleton skeleton to write to, all layer animations must be attached to it
+ * @param layers layers to apply, in order
+ * @param layerCount number of layers
+ * @param deltaTime time since last update (seconds), advances all layer animations
+ */
+void t3d_skeleton_blend_layers(T3DSkeleton *skeleton, const T3DSkeletonLayer *layers, uint32_t layerCount, float deltaTime);
+
 /**
  * Updates the skeleton's bone matrices if data has changed.
  * Call this after making changes to the bones individual properties (pos/rot/scale).
@@ -105,6 +141,17 @@ void t3d_skeleton_blend(const T3DSkeleton *skelRes, const T3DSkeleton *skelA, co
  */
 void t3d_skeleton_update(T3DSkeleton *skeleton);
 
+/**
+ * Same as 't3d_skeleton_update', but writes the matrices into new memory of the current frame.
+ * This can only be used with skeletons created with a 'bufferCount' of 0.
+ * Instead of keeping multiple buffers per skeleton alive, the memory is recycled by the arena
+ * once the RSP is done with the frame. Bones that didn't change are only converted to fixed-point.
+ *
+ * @param skeleton The skeleton to update
+ * @param arena arena to allocate the matrices from, use 't3d_skeleton_use' before drawing
+ */
+void t3d_skeleton_update_arena(T3DSkeleton *skeleton, T3DFrameArena *arena);
+
 /**
  * Frees data allocated in the skeleton struct.
  * Note: it's safe to call this multiple times, pointers are set to NULL.
@@ -0,0 +1,218 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+
+#include "t3d/t3dstream.h"
+#include <malloc.h>
+
+#define T3DS_VERSION 0x01
+
+static inline void* patch_pointer(void *ptr, uint32_t offset) {
+  return (void*)(offset + (int32_t)ptr);
+}
+
+static float aabb_dist_sq(const T3DStreamCellDef *def, const T3DVec3 *pos) {
+  float distSq = 0.0f;
+  for(int i=0; i<3; ++i) {
+    float d = 0.0f;
+    if(pos->v[i] < def->aabbMin[i])d = def->aabbMin[i] - pos->v[i];
+    else if(pos->v[i] > def->aabbMax[i])d = pos->v[i] - def->aabbMax[i];
+    distSq += d * d;
+  }
+  return distSq;
+}
+
+T3DStream t3d_stream_create(const char *indexPath, T3DStreamConf conf) {
+  int size = 0;
+  T3DStreamIndex *index = asset_load(indexPath, &size);
+
+  assertf(memcmp(index->magic, "T3S", 3) == 0, "Invalid T3D scene index: %s", indexPath);
+  assertf(index->magic[3] == T3DS_VERSION,
+    "Invalid T3D scene index version: %d != %d\n"
+    "Please make a clean build of t3d and your project",
+    T3DS_VERSION, index->magic[3]);
+
+  index->stringTablePtr = patch_pointer(index->stringTablePtr, (uint32_t)index);
+  index->texturePaths = patch_pointer(index->texturePaths, (uint32_t)index);
+  for(uint32_t i = 0; i < index->cellCount; i++) {
+    index->cells[i].path = patch_pointer(index->cells[i].path, (uint32_t)index->stringTablePtr);
+  }
+  for(uint32_t i = 0; i < index->textureCount; i++) {
+    index->texturePaths[i] = patch_pointer(index->texturePaths[i], (uint32_t)index->stringTablePtr);
+  }
+
+  if(conf.unloadRadius < conf.loadRadius)conf.unloadRadius = conf.loadRadius;
+
+  return (T3DStream){
+    .index = index,
+    .cells = calloc(index->cellCount, sizeof(T3DStreamCell)),
+    .conf = conf,
+    .memUsed = 0,
+    .loadFile = NULL,
+    .loadBuffer = NULL,
+    .loadOffset = 0,
+    .loadCellIdx = -1
+  };
+}
+
+static void cell_free_deferred(T3DStreamCell *cell) {
+  cell->state = T3D_STREAM_CELL_FREEING;
+  cell->freeSync = rspq_syncpoint_new();
+}
+
+static void load_abort(T3DStream *stream) {
+  T3DStreamCell *cell = &stream->cells[stream->loadCellIdx];
+  fclose(stream->loadFile);
+  free(stream->loadBuffer);
+  stream->memUsed -= stream->index->cells[stream->loadCellIdx].size;
+  cell->state = T3D_STREAM_CELL_UNLOADED;
+
+  stream->loadFile = NULL;
+  stream->loadBuffer = NULL;
+  stream->loadCellIdx = -1;
+}
+
+static void load_start(T3DStream *stream, uint32_t cellIdx) {
+  const T3DStreamCellDef *def = &stream->index->cells[cellIdx];
+  int size = 0;
+  stream->loadFile = asset_fopen(def->path, &size);
+  assertf(size == def->size, "Cell size mismatch: %s (%d != %lu)", def->path, size, def->size);
+
+  stream->loadBuffer = memalign(16, def->size);
+  stream->loadOffset = 0;
+  stream->loadCellIdx = cellIdx;
+  stream->memUsed += def->size;
+  stream->cells[cellIdx].state = T3D_STREAM_CELL_LOADING;
+}
+
+// reads the next slice of the cell in-flight, returns true once it is fully loaded
+static bool load_continue(T3DStream *stream) {
+  const T3DStreamCellDef *def = &stream->index->cells[stream->loadCellIdx];
+  uint32_t readSize = def->size - stream->loadOffset;
+  if(stream->conf.bytesPerUpdate && readSize > stream->conf.bytesPerUpdate) {
+    readSize = stream->conf.bytesPerUpdate;
+  }
+
+  size_t bytesRead = fread(stream->loadBuffer + stream->loadOffset, 1, readSize, stream->loadFile);
+  assertf(bytesRead > 0, "Cell read failed: %s (%lu/%lu bytes)", def->path, stream->loadOffset, def->size);
+  stream->loadOffset += bytesRead;
+  if(stream->loadOffset < def->size)return false;
+
+  T3DStreamCell *cell = &stream->cells[stream->loadCellIdx];
+  fclose(stream->loadFile);
+  cell->model = t3d_model_load_buffer(stream->loadBuffer, def->size);
+  cell->state = T3D_STREAM_CELL_LOADED;
+
+  stream->loadFile = NULL;
+  stream->loadBuffer = NULL;
+  stream->loadCellIdx = -1;
+  return true;
+}
+
+// returns the next cell to load (nearest one in range), -1 if none
+static int32_t find_next_cell(const T3DStream *stream) {
+  float loadRadiusSq = stream->conf.loadRadius * stream->conf.loadRadius;
+  int32_t nextIdx = -1;
+  for(uint32_t i = 0; i < stream->index->cellCount; i++) {
+    const T3DStreamCell *cell = &stream->cells[i];
+    if(cell->state != T3D_STREAM_CELL_UNLOADED || cell->distSq > loadRadiusSq)continue;
+    if(nextIdx < 0 || cell->distSq < stream->cells[nextIdx].distSq)nextIdx = i;
+  }
+  return nextIdx;
+}
+
+// frees loaded cells further away than 'distSq' (farthest first) until 'size' more bytes fit into the budget
+static bool make_room(T3DStream *stream, uint32_t size, float distSq) {
+  uint32_t memFreeable = 0;
+  for(uint32_t i = 0; i < stream->index->cellCount; i++) {
+    if(stream->cells[i].state == T3D_STREAM_CELL_LOADED && stream->cells[i].distSq > distSq) {
+      memFreeable += stream->index->cells[i].size;
+    }
+  }
+  if(stream->memUsed + size > stream->conf.memBudget + memFreeable)return false;
+
+  uint32_t memAfterFree = stream->memUsed;
+  while(memAfterFree + size > stream->conf.memBudget) {
+    int32_t farIdx = -1;
+    for(uint32_t i = 0; i < stream->index->cellCount; i++) {
+      const T3DStreamCell *cell = &stream->cells[i];
+      if(cell->state != T3D_STREAM_CELL_LOADED || cell->distSq <= distSq)continue;
+      if(farIdx < 0 || cell->distSq > stream->cells[farIdx].distSq)farIdx = i;
+    }
+    memAfterFree -= stream->index->cells[farIdx].size;
+    cell_free_deferred(&stream->cells[farIdx]);
+  }
+  return true;
+}
+
+// returns true if there is nothing more to do for the current camera position
+static bool stream_step(T3DStream *stream, const T3DVec3 *camPos, bool isSync) {
+  float unloadRadiusSq = stream->conf.unloadRadius * stream->conf.unloadRadius;
+
+  for(uint32_t i = 0; i < stream->index->cellCount; i++) {
+    T3DStreamCell *cell = &stream->cells[i];
+    cell->distSq = aabb_dist_sq(&stream->index->cells[i], camPos);
+
+    if(cell->state == T3D_STREAM_CELL_FREEING) {
+      if(isSync)rspq_syncpoint_wait(cell->freeSync);
+      if(rspq_syncpoint_check(cell->freeSync)) {
+        t3d_model_free(cell->model);
+        cell->model = NULL;
+        cell->state = T3D_STREAM_CELL_UNLOADED;
+        stream->memUsed -= stream->index->cells[i].size;
+      }
+    }
+
+    if(cell->distSq > unloadRadiusSq) {
+      if(cell->state == T3D_STREAM_CELL_LOADED)cell_free_deferred(cell);
+      if(cell->state == T3D_STREAM_CELL_LOADING)load_abort(stream);
+    }
+  }
+
+  if(stream->loadCellIdx < 0) {
+    int32_t nextIdx = find_next_cell(stream);
+    if(nextIdx < 0)return true;
+
+    const T3DStreamCellDef *def = &stream->index->cells[nextIdx];
+    if(!make_room(stream, def->size, stream->cells[nextIdx].distSq))return true;
+
+    // memory of evicted cells is only available once the RSP is done with them
+    if(stream->memUsed + def->size > stream->conf.memBudget)return false;
+    load_start(stream, nextIdx);
+  }
+
+  load_continue(stream);
+  return false;
+}
+
+void t3d_stream_update(T3DStream *stream, const T3DVec3 *camPos) {
+  stream_step(stream, camPos, false);
+}
+
+void t3d_stream_update_sync(T3DStream *stream, const T3DVec3 *camPos) {
+  while(!stream_step(stream, camPos, true)) {}
+}
+
+void t3d_stream_draw(const T3DStream *stream, T3DModelDrawConf conf) {
+  for(uint32_t i = 0; i < stream->index->cellCount; i++) {
+    const T3DStreamCell *cell = &stream->cells[i];
+    if(cell->state == T3D_STREAM_CELL_LOADED) {
+      t3d_model_draw_custom(cell->model, conf);
+    }
+  }
+}
+
+void t3d_stream_destroy(T3DStream *stream) {
+  if(stream->loadCellIdx >= 0)load_abort(stream);
+  rspq_wait();
+
+  for(uint32_t i = 0; i < stream->index->cellCount; i++) {
+    if(stream->cells[i].model)t3d_model_free(stream->cells[i].model);
+  }
+  free(stream->cells);
+  free(stream->index);
+  stream->cells = NULL;
+  stream->index = NULL;
+  stream->memUsed = 0;
+}
@@ -0,0 +1,126 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#ifndef TINY3D_T3DSTREAM_H
+#define TINY3D_T3DSTREAM_H
+
+#include "t3dmodel.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define T3D_STREAM_CELL_UNLOADED 0
+#define T3D_STREAM_CELL_LOADING  1
+#define T3D_STREAM_CELL_LOADED   2
+#define T3D_STREAM_CELL_FREEING  3 // waiting for the RSP to no longer use it
+
+// Cell of a tiled scene, as stored in the index file
+typedef struct {
+  int16_t aabbMin[3];
+  int16_t aabbMax[3];
+  int16_t gridPos[2]; // X/Z position in the grid
+  char* path; // .t3dm file of the cell
+  uint32_t size; // file size, this is also the memory needed once loaded (excl. textures)
+  uint16_t triCount;
+  uint16_t objectCount;
+} T3DStreamCellDef;
+
+// Index of a scene split into cells by the gltf_importer ('--tiles=size')
+typedef struct {
+  char magic[4];
+  uint16_t cellCount;
+  uint16_t textureCount;
+  float cellSize;
+  char** texturePaths; // all textures used across cells, 'textureCount' entries
+  char* stringTablePtr;
+  T3DStreamCellDef cells[];
+} T3DStreamIndex;
+
+typedef struct {
+  T3DModel *model; // loaded model, NULL if not (fully) loaded
+  rspq_syncpoint_t freeSync;
+  float distSq; // squared distance to the camera at the last update
+  uint8_t state; // see T3D_STREAM_CELL_xxx
+} T3DStreamCell;
+
+typedef struct {
+  uint32_t memBudget; // max. bytes of all cells loaded (or in-flight) at once
+  float loadRadius; // cells closer than this to the camera get loaded
+  float unloadRadius; // cells further away than this get freed, should be larger than 'loadRadius'
+  uint32_t bytesPerUpdate; // max. bytes read per update, 0 to load an entire cell at once
+} T3DStreamConf;
+
+typedef struct {
+  T3DStreamIndex *index;
+  T3DStreamCell *cells;
+  T3DStreamConf conf;
+  uint32_t memUsed; // bytes used by cells, including ones waiting to be freed
+
+  // cell currently being read in, spread across multiple updates
+  FILE *loadFile;
+  uint8_t *loadBuffer;
+  uint32_t loadOffset;
+  int32_t loadCellIdx; // -1 if idle
+} T3DStream;
+
+/**
+ * Loads the index of a tiled scene and sets up streaming for it.
+ * No cell is loaded yet, this happens in 't3d_stream_update'.
+ *
+ * @param indexPath path to the index file written by the gltf_importer
+ * @param conf memory-budget and distances
+ * @return stream, free it with 't3d_stream_destroy'
+ */
+T3DStream t3d_stream_create(const char *indexPath, T3DStreamConf conf);
+
+/**
+ * Loads and frees cells around the camera, call this once per frame.
+ * Cells are loaded one at a time, nearest first, reading at most 'conf.bytesPerUpdate' per call.
+ * If the memory-budget is reached, cells further away than the next one to load are freed first.
+ * Freed cells are only released once the RSP is done with them.
+ *
+ * @param stream stream to update
+ * @param camPos camera position, in model space of the scene
+ */
+void t3d_stream_update(T3DStream *stream, const T3DVec3 *camPos);
+
+/**
+ * Blocks until all cells within the load-radius are loaded (or the budget is reached).
+ * This is useful for the initial load or after teleporting the camera.
+ *
+ * @param stream stream to update
+ * @param camPos camera position, in model space of the scene
+ */
+void t3d_stream_update_sync(T3DStream *stream, const T3DVec3 *camPos);
+
+/**
+ * Draws all loaded cells with 't3d_model_draw_custom'.
+ * @param stream stream to draw
+ * @param conf draw settings, passed to each cell
+ */
+void t3d_stream_draw(const T3DStream *stream, T3DModelDrawConf conf);
+
+/**
+ * Returns the model of a cell, or NULL if not loaded.
+ * @param stream stream
+ * @param cellIdx index of the cell, see 'stream->index->cells'
+ */
+static inline T3DModel* t3d_stream_get_model(const T3DStream *stream, uint32_t cellIdx) {
+  return stream->cells[cellIdx].state == T3D_STREAM_CELL_LOADED ? stream->cells[cellIdx].model : NULL;
+}
+
+/**
+ * Frees all cells and the index.
+ * Note: this waits for the RSP to be idle.
+ * @param stream
+ */
+void t3d_stream_destroy(T3DStream *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TINY3D_T3DSTREAM_H
@@ -0,0 +1,151 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "binaryFile.h"
+#include "stringTable.h"
+#include "structs.h"
+
+namespace {
+  constexpr uint32_t VERTS_PER_OBJECT = 1024;
+  constexpr uint32_t VERTS_PER_PART = 64;
+  constexpr uint32_t RUNS = 5;
+
+  using Clock = std::chrono::high_resolution_clock;
+
+  double getMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  }
+
+  struct Timings {
+    double verts{};
+    double indices{};
+    double strings{};
+    double total{};
+  };
+
+  Timings writeScene(const std::vector<VertexT3D> &verts, const std::vector<int8_t> &indices, uint32_t &outSize)
+  {
+    Timings res{};
+    auto timeTotal = Clock::now();
+
+    BinaryFile file{};
+    BinaryFile chunkVerts{};
+    BinaryFile chunkIndices{};
+    StringTable stringTable{"S"};
+
+    file.writeChars("T3M", 3);
+    file.write<uint8_t>(T3DM_VERSION);
+    file.skip(64);
+
+    // vertex buffer, same layout as the one in main.cpp (interleaved pairs)
+    auto timeStart = Clock::now();
+    for(size_t v=0; v<verts.size(); v+=2) {
+      const auto &vertA = verts[v];
+      const auto &vertB = verts[v+1];
+      chunkVerts.writeArray(vertA.pos, 3);
+      chunkVerts.write(vertA.norm);
+      chunkVerts.writeArray(vertB.pos, 3);
+      chunkVerts.write(vertB.norm);
+      chunkVerts.write(vertA.rgba);
+      chunkVerts.write(vertB.rgba);
+      chunkVerts.write(vertA.s);
+      chunkVerts.write(vertA.t);
+      chunkVerts.write(vertB.s);
+      chunkVerts.write(vertB.t);
+    }
+    res.verts = getMs(timeStart);
+
+    // parts (header + triangle indices + strips)
+    timeStart = Clock::now();
+    uint32_t partCount = verts.size() / VERTS_PER_PART;
+    uint32_t idxPerPart = indices.size() / partCount;
+    std::vector<uint16_t> strip(idxPerPart / 2);
+    for(uint32_t i=0; i<strip.size(); ++i)strip[i] = (uint16_t)(i * 36);
+
+    for(uint32_t p=0; p<partCount; ++p) {
+      file.write(p * VERTS_PER_PART * VertexT3D::byteSize());
+      file.write<uint16_t>(VERTS_PER_PART);
+      file.write<uint16_t>(0);
+      file.write(chunkIndices.getPos());
+      file.write<uint16_t>(idxPerPart);
+      file.write<uint16_t>(0);
+      file.skip(4);
+
+      chunkIndices.writeArray(indices.data() + p * idxPerPart, idxPerPart);
+      chunkIndices.align(8);
+      chunkIndices.writeArray(strip.data(), strip.size());
+    }
+    res.indices = getMs(timeStart);
+
+    // object, material and texture names, with lots of duplicates
+    timeStart = Clock::now();
+    uint32_t objCount = verts.size() / VERTS_PER_OBJECT;
+    for(uint32_t o=0; o<objCount; ++o) {
+      file.write(stringTable.insert("object_" + std::to_string(o)));
+      file.write(stringTable.insert("material_" + std::to_string(o % 64)));
+      file.write(stringTable.insert("rom:/textures/tex_" + std::to_string(o % 128) + ".sprite"));
+    }
+    res.strings = getMs(timeStart);
+
+    file.align(16);
+    file.writeMemFile(chunkVerts);
+    file.align(4);
+    file.writeMemFile(chunkIndices);
+    file.align(4);
+    file.write(stringTable.getData());
+
+    res.total = getMs(timeTotal);
+    outSize = file.getSize();
+    return res;
+  }
+}
+
+int Bench::writer(uint32_t vertexCount)
+{
+  vertexCount = (std::max(vertexCount, VERTS_PER_PART) + VERTS_PER_PART-1) & ~(VERTS_PER_PART-1);
+
+  // deterministic pseudo-random data, the content itself doesn't matter
+  uint32_t seed = 1;
+  auto rand = [&seed]() { seed = seed * 1664525 + 1013904223; return seed >> 8; };
+
+  std::vector<VertexT3D> verts(vertexCount);
+  for(auto &v : verts) {
+    for(auto &p : v.pos)p = (int16_t)rand();
+    v.norm = (uint16_t)rand();
+    v.rgba = rand();
+    v.s = (int16_t)rand();
+    v.t = (int16_t)rand();
+  }
+
+  std::vector<int8_t> indices(vertexCount * 3 / 2);
+  for(auto &idx : indices)idx = (int8_t)(rand() % VERTS_PER_PART);
+
+  printf("Writer benchmark: %u vertices, %u indices, %u runs\n", vertexCount, (uint32_t)indices.size(), RUNS);
+
+  Timings best{1e9, 1e9, 1e9, 1e9};
+  uint32_t size = 0;
+  for(uint32_t r=0; r<RUNS; ++r) {
+    auto t = writeScene(verts, indices, size);
+    best.verts = std::min(best.verts, t.verts);
+    best.indices = std::min(best.indices, t.indices);
+    best.strings = std::min(best.strings, t.strings);
+    best.total = std::min(best.total, t.total);
+  }
+
+  printf("  Vertices: %8.2fms\n", best.verts);
+  printf("  Indices : %8.2fms\n", best.indices);
+  printf("  Strings : %8.2fms\n", best.strings);
+  printf("  Total   : %8.2fms (%.2f MB, %.1f MB/s)\n",
+    best.total, size / (1024.0 * 1024.0), (size / (1024.0 * 1024.0)) / (best.total / 1000.0)
+  );
+  return 0;
+}
@@ -0,0 +1,17 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+#include <cstdint>
+
+namespace Bench
+{
+  /**
+   * Micro-benchmark of the T3DM writer ('--bench-writer[=vertex-count]').
+   * Writes a synthetic scene with the same layout as a model file into memory,
+   * and prints the time taken for each part of it.
+   */
+  int writer(uint32_t vertexCount);
+}
@@ -4,7 +4,9 @@
 */
 #pragma once
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <unordered_map>
 #include "types.h"
 #include "bit.h"
@@ -18,33 +20,52 @@ class BinaryFile
     uint32_t dataPos{};
     uint32_t dataSize{};
 
-    void writeRaw(const uint8_t* ptr, size_t size) {
-      if(dataPos+size > data.size()) {
-        data.resize(data.size() + size);
-      }
-      for(size_t i=0; i<size; ++i) {
-        data[dataPos++] = ptr[i];
+    /**
+     * Returns a pointer to 'size' bytes at the current position and advances it.
+     * The buffer grows geometrically (and is usually larger than 'dataSize'),
+     * so many small writes stay amortized O(1).
+     */
+    uint8_t* reserveRaw(size_t size) {
+      size_t end = (size_t)dataPos + size;
+      if(end > data.size()) {
+        data.resize(std::max(end, data.size() * 2));
       }
+      uint8_t* res = data.data() + dataPos;
+      dataPos = end;
       dataSize = std::max(dataSize, dataPos);
+      return res;
+    }
+
+    void writeRaw(const uint8_t* ptr, size_t size) {
+      if(size == 0)return;
+      std::memcpy(reserveRaw(size), ptr, size);
+    }
+
+    template<typename T>
+    static auto toBigEndian(T value) {
+      if constexpr (std::is_same_v<T, float>) {
+        return Bit::byteswap(Bit::bit_cast<uint32_t>(value));
+      } else {
+        return Bit::byteswap(value);
+      }
     }
 
   public:
 
+    void reserve(size_t bytes) {
+      if(bytes > data.size())data.resize(bytes);
+    }
+
     void skip(u32 bytes) {
-      for(u32 i=0; i<bytes; ++i) {
-        write<u8>(0);
-      }
+      if(bytes == 0)return;
+      std::memset(reserveRaw(bytes), 0, bytes);
     }
 
     template<typename T>
     void write(T value) {
-      if constexpr (std::is_same_v<T, float>) {
-        uint32_t val = Bit::byteswap(Bit::bit_cast<uint32_t>(value));
-        writeRaw(reinterpret_cast<uint8_t*>(&val), sizeof(T));
-      } else {
-        auto val = Bit::byteswap(value);
-        writeRaw(reinterpret_cast<uint8_t*>(&val), sizeof(T));
-      }
+      auto val = toBigEndian(value);
+      static_assert(sizeof(val) == sizeof(T));
+      writeRaw(reinterpret_cast<uint8_t*>(&val), sizeof(T));
     }
 
     void write(const std::string &str) {
@@ -52,13 +73,24 @@ class BinaryFile
     }
 
     void writeChars(const char* str, size_t len) {
-      for(size_t i=0; i<len; ++i)write<u8>(str[i]);
+      writeRaw(reinterpret_cast<const uint8_t*>(str), len);
     }
 
+    /**
+     * Writes an array of values in big-endian.
+     * The swap is done into the output buffer in a single tight loop which the compiler can vectorize.
+     */
     template<typename T>
     void writeArray(const T* arr, size_t count) {
-      for(size_t i=0; i<count; ++i) {
-        write(arr[i]);
+      if(count == 0)return;
+      uint8_t* dst = reserveRaw(count * sizeof(T));
+      if constexpr (sizeof(T) == 1) {
+        std::memcpy(dst, arr, count);
+      } else {
+        for(size_t i=0; i<count; ++i) {
+          auto val = toBigEndian(arr[i]);
+          std::memcpy(dst + i * sizeof(T), &val, sizeof(T));
+        }
       }
     }
 
@@ -97,10 +129,7 @@ class BinaryFile
       u32 pos = getPos();
       u32 offset = pos % alignment;
       if(offset != 0) {
-        u32 padding = alignment - offset;
-        for(u32 i=0; i<padding; ++i) {
-          write<u8>(0);
-        }
+        skip(alignment - offset);
       }
     }
 
@@ -0,0 +1,179 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#include "cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+#include "hash.h"
+#include "lib/cgltf.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+  constexpr uint64_t HASH_MISSING_FILE = 0;
+
+  std::string hashToString(uint64_t hash) {
+    char buff[17];
+    snprintf(buff, sizeof(buff), "%016llx", (unsigned long long)hash);
+    return buff;
+  }
+
+  uint64_t hashFile(const std::string &path) {
+    std::ifstream file{path, std::ios::binary};
+    if(!file || !fs::is_regular_file(path))return HASH_MISSING_FILE;
+
+    uint64_t hash = dataHash64(nullptr, 0);
+    std::vector<char> buff(1024 * 64);
+    while(file) {
+      file.read(buff.data(), buff.size());
+      hash = dataHash64(buff.data(), file.gcount(), hash);
+    }
+    return hash == HASH_MISSING_FILE ? 1 : hash;
+  }
+
+  template<typename T>
+  uint64_t hashValue(const T &val, uint64_t hash) {
+    return dataHash64(&val, sizeof(val), hash);
+  }
+
+  uint64_t hashString(const std::string &str, uint64_t hash) {
+    hash = hashValue(str.size(), hash);
+    return dataHash64(str.data(), str.size(), hash);
+  }
+
+  // 'argv[0]' may just be a name found via PATH, prefer the actual executable if the OS tells us
+  std::string getExecutablePath(const std::string &toolPath) {
+    std::error_code err{};
+    auto selfPath = fs::read_symlink("/proc/self/exe", err);
+    return err ? toolPath : selfPath.string();
+  }
+
+  fs::path getEntryPath(uint64_t key) {
+    return fs::path{config.cachePath} / hashToString(key);
+  }
+}
+
+uint64_t Cache::calcKey(const std::string &gltfPath, const std::string &t3dmPath, const std::string &toolPath)
+{
+  // any change to the converter changes its binary, this replaces a manually bumped cache version
+  uint64_t toolHash = hashFile(getExecutablePath(toolPath));
+  if(toolHash == HASH_MISSING_FILE)return 0;
+
+  uint64_t hash = hashValue(toolHash, dataHash64(nullptr, 0));
+  hash = hashValue(T3DM_VERSION, hash);
+
+  // anything from the config that affects the output
+  hash = hashValue(config.globalScale, hash);
+  hash = hashValue(config.animSampleRate, hash);
+  hash = hashValue(config.ignoreMaterials, hash);
+  hash = hashValue(config.createBVH, hash);
+  hash = hashValue(config.createCollision, hash);
+  hash = hashString(config.collisionTag, hash);
+  hash = hashValue(config.lodLevels, hash);
+  hash = hashValue(config.lodRatio, hash);
+  hash = hashValue(config.tileSize, hash);
+  hash = hashValue(config.pvsCellSize, hash);
+  hash = hashString(config.assetPath, hash);
+
+  // paths end up in the file (stream-data, textures relative to the working dir)
+  hash = hashString(t3dmPath, hash);
+  hash = hashString(fs::current_path().string(), hash);
+
+  hash = hashValue(hashFile(gltfPath), hash);
+
+  // a .gltf can reference external buffers/images, those have to be part of the key too
+  cgltf_options options{};
+  cgltf_data* data = nullptr;
+  if(cgltf_parse_file(&options, gltfPath.c_str(), &data) == cgltf_result_success) {
+    auto basePath = fs::path{gltfPath}.parent_path();
+    auto addUri = [&](const char* uri) {
+      if(!uri || strncmp(uri, "data:", 5) == 0)return;
+      hash = hashValue(hashFile((basePath / uri).string()), hash);
+    };
+    for(cgltf_size i=0; i<data->buffers_count; ++i)addUri(data->buffers[i].uri);
+    for(cgltf_size i=0; i<data->images_count; ++i)addUri(data->images[i].uri);
+    cgltf_free(data);
+  }
+  return hash == 0 ? 1 : hash;
+}
+
+bool Cache::restore(uint64_t key)
+{
+  // Manifest format, one entry per line:
+  //   'O <path>'        output file, stored in the entry by its index
+  //   'D <hash> <path>' dependency, must still have the same content hash
+  auto entryPath = getEntryPath(key);
+  std::ifstream manifest{entryPath / "manifest.txt"};
+  if(!manifest)return false;
+
+  std::vector<std::string> outputs{};
+  std::string line{};
+  while(std::getline(manifest, line)) {
+    if(line.starts_with("O ")) {
+      outputs.push_back(line.substr(2));
+    } else if(line.starts_with("D ") && line.size() > 19) {
+      uint64_t depHash = std::stoull(line.substr(2, 16), nullptr, 16);
+      auto depPath = line.substr(19);
+      if(hashFile(depPath) != depHash) {
+        if(config.verbose)printf("Cache: dependency changed: %s\n", depPath.c_str());
+        return false;
+      }
+    }
+  }
+  if(outputs.empty())return false;
+
+  std::error_code err{};
+  for(uint32_t i=0; i<outputs.size(); ++i) {
+    fs::copy_file(entryPath / std::to_string(i), outputs[i], fs::copy_options::overwrite_existing, err);
+    if(err)return false;
+  }
+
+  if(config.verbose)printf("Cache: hit %s\n", hashToString(key).c_str());
+  return true;
+}
+
+void Cache::store(uint64_t key, const std::vector<std::string> &outputs, const std::vector<std::string> &dependencies)
+{
+  auto entryPath = getEntryPath(key);
+
+  // write into a temp. directory first and then move it in place,
+  // so that concurrent builds never see a half written entry
+  auto tmpPath = entryPath;
+  tmpPath += ".tmp" + std::to_string(getpid());
+
+  std::error_code err{};
+  fs::remove_all(tmpPath, err);
+  fs::create_directories(tmpPath, err);
+  if(err) {
+    fprintf(stderr, "Cache: failed to create directory %s: %s\n", tmpPath.string().c_str(), err.message().c_str());
+    return;
+  }
+
+  std::stringstream manifest{};
+  for(uint32_t i=0; i<outputs.size() && !err; ++i) {
+    manifest << "O " << outputs[i] << "\n";
+    fs::copy_file(outputs[i], tmpPath / std::to_string(i), err);
+  }
+  for(auto &dep : dependencies) {
+    manifest << "D " << hashToString(hashFile(dep)) << " " << dep << "\n";
+  }
+
+  if(!err) {
+    // manifest last, an entry without one is never used
+    std::ofstream{tmpPath / "manifest.txt"} << manifest.str();
+    fs::remove_all(entryPath, err);
+    fs::rename(tmpPath, entryPath, err);
+  }
+
+  if(err) {
+    fprintf(stderr, "Cache: failed to store entry: %s\n", err.message().c_str());
+    fs::remove_all(tmpPath, err);
+  }
+}
@@ -0,0 +1,39 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "structs.h"
+
+/**
+ * On-disk conversion cache.
+ * Entries are keyed by the content of the input glTF (+ external buffers), the output path, the config
+ * and the converter executable itself, so a rebuilt converter never reuses entries of an older one.
+ * Since referenced textures are only known after parsing, each entry also stores a list of those files
+ * together with their content hash, which is validated again before an entry is used.
+ */
+namespace Cache
+{
+  /**
+   * @param toolPath path the converter was started with ('argv[0]'), only used if '/proc/self/exe' is not available
+   * @return key of the conversion, 0 if the converter executable could not be read (cache must not be used)
+   */
+  uint64_t calcKey(const std::string &gltfPath, const std::string &t3dmPath, const std::string &toolPath);
+
+  /**
+   * Restores all output files (.t3dm, .sdata) of a cached conversion to their original paths.
+   * @return true on a cache-hit, false if a full conversion is needed
+   */
+  bool restore(uint64_t key);
+
+  /**
+   * Stores the outputs of a conversion that were already written to disk.
+   * @param outputs files written by the conversion (.t3dm, .sdata)
+   * @param dependencies extra files the result depends on (e.g. textures), may not exist
+   */
+  void store(uint64_t key, const std::vector<std::string> &outputs, const std::vector<std::string> &dependencies);
+}
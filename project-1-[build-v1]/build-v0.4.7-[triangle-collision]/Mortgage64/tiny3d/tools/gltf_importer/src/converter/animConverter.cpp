@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <cassert>
 #include "converter.h"
+#include "../parallel.h"
 #include "../math/quantizer.h"
 #include "mse.h"
 
@@ -50,33 +51,114 @@ namespace {
     return false;
   }
 
+  /**
+   * Index of the keyframe that starts the segment containing 't'.
+   * This matches the (monotonic) search in 'calcMSE', returning 'size()' once 't' is past the last keyframe.
+   */
+  int findSegment(const std::vector<Keyframe> &kfs, float t) {
+    auto it = std::upper_bound(kfs.begin(), kfs.end(), t, [](float t, const Keyframe &kf) { return t < kf.time; });
+    int idx = (int)(it - kfs.begin());
+    if(idx == (int)kfs.size())return idx;
+    return idx == 0 ? 0 : idx-1;
+  }
+
+  /**
+   * Squared error of a single sample, computed exactly like one iteration of 'calcMSE'.
+   */
+  float sampleError(const std::vector<Keyframe> &kfsNew, const std::vector<Keyframe> &kfsOrg, float t, int idxOrg, bool isRotation) {
+    int idxNew = findSegment(kfsNew, t);
+    const Keyframe &kfOrg = safeKf(kfsOrg, idxOrg);
+    const Keyframe &kfOrgNext = safeKf(kfsOrg, idxOrg + 1);
+    const Keyframe &kfNew = safeKf(kfsNew, idxNew);
+    const Keyframe &kfNewNext = safeKf(kfsNew, idxNew + 1);
+
+    float tDiffOrg = kfOrgNext.time - kfOrg.time;
+    float tDiffNew = kfNewNext.time - kfNew.time;
+
+    float interpOrg = (tDiffOrg > 0.00001f) ? ((t - kfOrg.time) / tDiffOrg) : 0.0f;
+    float interpNew = (tDiffNew > 0.00001f) ? ((t - kfNew.time) / tDiffNew) : 0.0f;
+
+    if(isRotation) {
+      Vec4 quatOrg = kfOrg.valQuat.slerp(kfOrgNext.valQuat, interpOrg).toVec4();
+      Vec4 quatNew = kfNew.valQuat.slerp(kfNewNext.valQuat, interpNew).toVec4();
+      return (quatOrg - quatNew).length2();
+    }
+    float valOrg = kfOrg.valScalar + (kfOrgNext.valScalar - kfOrg.valScalar) * interpOrg;
+    float valNew = kfNew.valScalar + (kfNewNext.valScalar - kfNew.valScalar) * interpNew;
+    return (valOrg - valNew) * (valOrg - valNew);
+  }
+
   /**
    * Optimizes the keyframes of a channel.
    * This will attempt to remove keyframes while staying within a certain error threshold.
+   *
+   * Keyframes are tried from left to right, same as a plain sweep calling 'calcMSE' for the
+   * whole duration after each removal, and the result is identical to it.
+   * Instead, the error of each sample is kept around, so a removal only re-evaluates the
+   * samples between the two neighbors of the removed keyframe.
    */
   void optimizeChannel(AnimChannelMapping &channel, float time) {
     if(channel.keyframes.size() < 2)return;
     auto channelOrg = channel;
-    float mse = calcMSE(channel.keyframes, channelOrg.keyframes, 0, time, channel.isRotation());
-    assert(mse < 0.00001f); //  initial MSE must be zero
-    //printf("  - Channel %s %d: %d keyframes, MSE: %f\n", channel.targetName.c_str(), channel.targetType, channel.keyframes.size(), mse);
+    auto &kfs = channel.keyframes;
+    const auto &kfsOrg = channelOrg.keyframes;
+    bool isRot = channel.isRotation();
+
+    // sample times, same as the ones used by 'calcMSE' for the whole duration
+    std::vector<float> sampleTimes{};
+    for(float t=0; t<time; t += 1.0f / 60.0f)sampleTimes.push_back(t);
+
+    // original segment for each sample, this never changes
+    std::vector<int> sampleOrgIdx(sampleTimes.size());
+    std::vector<float> sampleErr(sampleTimes.size());
+    for(size_t s=0; s<sampleTimes.size(); ++s) {
+      sampleOrgIdx[s] = findSegment(kfsOrg, sampleTimes[s]);
+      sampleErr[s] = sampleError(kfs, kfsOrg, sampleTimes[s], sampleOrgIdx[s], isRot);
+    }
+
+    // sums up the errors in the same order as 'calcMSE', using 'newErr' for the samples in [sStart, sEnd)
+    auto calcMSEGlobal = [&](size_t sStart, size_t sEnd, const std::vector<float> &newErr) {
+      float mse = 0.0f;
+      for(size_t s=0; s<sampleTimes.size(); ++s) {
+        mse += (s >= sStart && s < sEnd) ? newErr[s - sStart] : sampleErr[s];
+      }
+      return mse / (float)sampleTimes.size();
+    };
+
+    // first sample at or after a given time
+    auto sampleLowerBound = [&](float t) {
+      return (size_t)(std::lower_bound(sampleTimes.begin(), sampleTimes.end(), t) - sampleTimes.begin());
+    };
+
+    std::vector<float> newErr{};
+    assert(calcMSEGlobal(0, 0, newErr) < 0.00001f); //  initial MSE must be zero
 
     // now remove keyframes and keep the error below a certain threshold
     float threshold      = 0.000001f;
     float thresholdLocal = 0.0000001f;
 
-    for(int i=1;; ++i) {
-      if(i >= channel.keyframes.size()-1)break;
-      float timeStart = channel.keyframes[i-1].time;
-      auto kf = channel.keyframes[i];
-      float timeEnd = channel.keyframes[i+1].time;
+    for(size_t i=1;; ++i) {
+      if(i >= kfs.size()-1)break;
+      float timeStart = kfs[i-1].time;
+      auto kf = kfs[i];
+      float timeEnd = kfs[i+1].time;
+
+      kfs.erase(kfs.begin() + i);
+      float newMSELocal = calcMSE(kfs, kfsOrg, timeStart, timeEnd, isRot);
+
+      // only samples inside the merged segment change (and the ones before the first keyframe, which extrapolate)
+      size_t sStart = i == 1 ? 0 : sampleLowerBound(timeStart);
+      size_t sEnd = std::max(sStart, sampleLowerBound(timeEnd));
+      newErr.resize(sEnd - sStart);
+      for(size_t s=sStart; s<sEnd; ++s) {
+        newErr[s - sStart] = sampleError(kfs, kfsOrg, sampleTimes[s], sampleOrgIdx[s], isRot);
+      }
+      float newMSE = calcMSEGlobal(sStart, sEnd, newErr);
 
-      channel.keyframes.erase(channel.keyframes.begin() + i);
-      float newMSELocal = calcMSE(channel.keyframes, channelOrg.keyframes, timeStart, timeEnd, channel.isRotation());
-      float newMSE = calcMSE(channel.keyframes, channelOrg.keyframes, 0, time, channel.isRotation());
       if(newMSE > threshold || newMSELocal > thresholdLocal) {
-        channel.keyframes.insert(channel.keyframes.begin() + i, kf);
+        kfs.insert(kfs.begin() + i, kf);
       } else {
+        std::copy(newErr.begin(), newErr.end(), sampleErr.begin() + sStart);
         --i;
       }
     }
@@ -102,10 +184,10 @@ void convertAnimation(Anim &anim, const std::unordered_map<std::string, const Bo
     anim.channelMap.end()
   );
 
-  // resample keyframes
-  for(auto &ch : anim.channelMap) {
-    optimizeChannel(ch, anim.duration);
-  }
+  // resample keyframes, channels are independent of each other
+  Parallel::forEach(anim.channelMap.size(), config.jobs, [&](size_t c) {
+    optimizeChannel(anim.channelMap[c], anim.duration);
+  });
 
   // Map the channel target by name to the node index
   for(auto &ch : anim.channelMap) {
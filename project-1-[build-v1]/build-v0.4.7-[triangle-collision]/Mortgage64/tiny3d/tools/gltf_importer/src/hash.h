@@ -4,6 +4,7 @@
 */
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 inline uint32_t stringHash(const std::string &str)
@@ -13,4 +14,17 @@ inline uint32_t stringHash(const std::string &str)
     hash = (hash >> 8) ^ (hash << 24) ^ c;
   }
   return hash;
-}
\ No newline at end of file
+}
+
+/**
+ * 64-bit FNV-1a hash over a block of memory.
+ * Pass the result of a previous call as 'hash' to continue hashing more data.
+ */
+inline uint64_t dataHash64(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL)
+{
+  auto bytes = (const uint8_t*)data;
+  for(size_t i=0; i<size; ++i) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+  }
+  return hash;
+}
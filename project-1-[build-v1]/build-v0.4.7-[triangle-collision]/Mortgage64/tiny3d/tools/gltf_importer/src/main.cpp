@@ -6,37 +6,36 @@
 #include <string>
 #include <filesystem>
 #include <algorithm>
+#include <bit>
 #include <cassert>
 
 #include "structs.h"
 #include "parser.h"
 #include "hash.h"
 #include "args.h"
+#include "cache.h"
+#include "bench.h"
+#include "tiling.h"
 
 #include "binaryFile.h"
+#include "stringTable.h"
 #include "converter/converter.h"
 #include "parser/rdp.h"
 #include "optimizer/optimizer.h"
+#include "parallel.h"
 
 Config config;
 
+constexpr float RSP_CLOCK_MHZ = 62.5f;
+constexpr uint8_t T3DS_VERSION = 0x01;
+
 namespace fs = std::filesystem;
 
 namespace {
-  uint32_t insertString(std::string &stringTable, const std::string &newString) {
-    auto strPos = stringTable.find(newString);
-    if(strPos == std::string::npos) {
-      strPos = stringTable.size();
-      stringTable += newString;
-      stringTable.push_back('\0');
-    }
-    return strPos;
-  }
-
-  int writeBone(BinaryFile &file, const Bone &bone, std::string &stringTable, int level) {
+  int writeBone(BinaryFile &file, const Bone &bone, StringTable &stringTable, int level) {
     //printf("Bone[%d]: %s -> %d\n", bone.index, bone.name.c_str(), bone.parentIndex);
 
-    file.write(insertString(stringTable, bone.name));
+    file.write(stringTable.insert(bone.name));
     file.write<uint16_t>(bone.parentIndex);
     file.write<uint16_t>(level); // level
 
@@ -52,6 +51,89 @@ namespace {
     return boneCount;
   };
 
+  constexpr uint32_t MORPH_TARGET_SIZE = 12;
+  constexpr uint32_t MORPH_RANGE_GAP = 2; // unchanged pairs a range may span before a new one is started
+
+  /**
+   * Writes the morph-targets of an object as sparse delta streams (see 'T3DChunkMorph').
+   * Per target, ranges of vertex-pairs with non-zero deltas are stored,
+   * followed by one int8 delta per pair in the same A/B interleaved order as the vertex buffer.
+   * Deltas are quantized with a shared shift, which is zero unless a target moves vertices by more than 127 units.
+   */
+  BinaryFile writeMorphTargets(const Model &model, const ModelChunked &chunks, uint32_t objectIdx, StringTable &stringTable)
+  {
+    BinaryFile f{};
+    f.write(objectIdx); // patched to a pointer at runtime
+    f.write<uint16_t>(model.morphTargets.size());
+    f.write<uint16_t>(chunks.vertices.size());
+
+    uint32_t offsetTargets = f.getPos();
+    f.skip(model.morphTargets.size() * MORPH_TARGET_SIZE);
+
+    uint32_t pairCount = chunks.vertices.size() / 2;
+    for(const auto &target : model.morphTargets)
+    {
+      auto getDelta = [&](uint32_t pair, int v, int c) {
+        return target.deltas[chunks.vertices[pair*2 + v].sourceIndex * 3 + c];
+      };
+
+      std::vector<std::pair<uint16_t, uint16_t>> ranges{}; // start, count
+      int32_t maxDelta = 0;
+      for(uint32_t p=0; p<pairCount; ++p) {
+        bool isZero = true;
+        for(int i=0; i<6; ++i) {
+          int32_t d = getDelta(p, i / 3, i % 3);
+          maxDelta = std::max(maxDelta, std::abs(d));
+          isZero = isZero && d == 0;
+        }
+        if(isZero)continue;
+
+        if(!ranges.empty() && p <= (uint32_t)(ranges.back().first + ranges.back().second + MORPH_RANGE_GAP)) {
+          ranges.back().second = p - ranges.back().first + 1;
+        } else {
+          ranges.push_back({(uint16_t)p, 1});
+        }
+      }
+
+      uint8_t shift = 0;
+      while((maxDelta >> shift) > 127)++shift;
+
+      f.align(4);
+      uint32_t dataOffset = f.getPos();
+      uint32_t pairsUsed = 0;
+      for(const auto &[start, count] : ranges) {
+        f.write(start);
+        f.write(count);
+        pairsUsed += count;
+      }
+      for(const auto &[start, count] : ranges) {
+        for(uint32_t p=start; p<start+count; ++p) {
+          for(int i=0; i<6; ++i) {
+            float d = getDelta(p, i / 3, i % 3) / (float)(1 << shift);
+            f.write((int8_t)std::clamp((int32_t)std::lround(d), -128, 127));
+          }
+        }
+      }
+
+      f.posPush();
+        f.setPos(offsetTargets);
+        f.write(stringTable.insert(target.name));
+        f.write<uint16_t>(ranges.size());
+        f.write(shift);
+        f.write<uint8_t>(0); // padding
+        f.write(dataOffset);
+        offsetTargets = f.getPos();
+      f.posPop();
+
+      if(config.verbose) {
+        printf("[%s] Morph-target '%s': %d/%d pairs in %zu ranges, shift: %d\n",
+          model.name.c_str(), target.name.c_str(), pairsUsed, pairCount, ranges.size(), shift
+        );
+      }
+    }
+    return f;
+  }
+
   std::string getRomPath(const std::string &path) {
     if(path.find("filesystem/") == 0) {
       return std::string("rom:/") + path.substr(11);
@@ -59,47 +141,42 @@ namespace {
     return path;
   }
 
+  // path of a texture as used at runtime (sprite in the ROM), empty if not set
+  std::string getTextureRomPath(const MaterialTexture &tex) {
+    if(tex.texPath.empty())return "";
+
+    std::string texPath = fs::relative(tex.texPath, std::filesystem::current_path()).string();
+    std::replace(texPath.begin(), texPath.end(), '\\', '/');
+
+    if(texPath.find(config.assetPath) == 0) {
+      texPath.replace(0, config.assetPath.size(), "rom:/");
+    }
+    if(texPath.find(".png") != std::string::npos) {
+      texPath.replace(texPath.find(".png"), 4, ".sprite");
+    }
+    return texPath;
+  }
+
   std::string getStreamDataPath(const char* filePath, uint32_t idx) {
     auto sdataPath = std::string(filePath).substr(0, std::string(filePath).size()-5);
     std::replace(sdataPath.begin(), sdataPath.end(), '\\', '/');
     return sdataPath + "." + std::to_string(idx) + ".sdata";
   }
-}
-
-int main(int argc, char* argv[])
-{
-  EnvArgs args{argc, argv};
-  if(args.checkArg("--help")) {
-    printf("Usage: %s <gltf-file> <t3dm-file> [--bvh] [--base-scale=64] [--ignore-materials] [--asset-path=assets] [--verbose]\n", argv[0]);
-    return 1;
-  }
-
-  const std::string gltfPath = args.getFilenameArg(0);
-  const std::string t3dmPath = args.getFilenameArg(1);
 
-  config.globalScale = (float)args.getU32Arg("--base-scale", 64);
-  config.ignoreMaterials = args.checkArg("--ignore-materials");
-  config.createBVH = args.checkArg("--bvh");
-  config.verbose = args.checkArg("--verbose");
-
-  config.assetPath = args.getStringArg("--asset-path");
-  if(config.assetPath.empty()) {
-    config.assetPath = "assets/";
+  std::string getCellPath(const std::string &indexPath, uint32_t idx) {
+    auto cellPath = fs::path{indexPath}.replace_extension("").string();
+    std::replace(cellPath.begin(), cellPath.end(), '\\', '/');
+    return cellPath + ".cell" + std::to_string(idx) + ".t3dm";
   }
-  if(config.assetPath.back() != '/') {
-    config.assetPath.push_back('/');
-  }
-
-  config.assetPathFull = fs::absolute(config.assetPath).string();
-  if(config.verbose) {
-    printf("Asset path: %s (%s)\n", config.assetPath.c_str(), config.assetPathFull.c_str());
-  }
-
-  config.animSampleRate = 60;
-
-  auto t3dm = parseGLTF(gltfPath.c_str(), config.globalScale);
-  fs::path gltfBasePath{gltfPath};
+}
 
+/**
+ * Converts a parsed scene and writes it into a .t3dm file (+ one .sdata file per animation).
+ * Textures referenced by the used materials are added to 'dependencies'.
+ * @return paths of all files written
+ */
+std::vector<std::string> writeT3DM(T3DMData &t3dm, const std::string &t3dmPath, std::vector<std::string> &dependencies)
+{
   // sort models by transparency mode (opaque -> cutout -> transparent)
   // within the same transparency mode, sort by material
   std::sort(t3dm.models.begin(), t3dm.models.end(), [](const Model &a, const Model &b) {
@@ -138,15 +215,65 @@ int main(int argc, char* argv[])
   uint32_t chunkIndex = 0;
   uint32_t chunkCount = 2; // vertices + indices
   if(config.createBVH)chunkCount += 1;
+  if(config.pvsCellSize > 0.0f)chunkCount += 1;
+
+  // collect triangles for the collision-mesh, skinned ones are ignored since they can move
+  std::vector<CollisionTri> collisionTris{};
+  if(config.createCollision) {
+    for(auto &model : t3dm.models) {
+      if(!config.collisionTag.empty()
+        && model.name.find(config.collisionTag) == std::string::npos
+        && model.material.name.find(config.collisionTag) == std::string::npos
+      )continue;
+
+      for(auto &tri : model.triangles) {
+        if(tri.vert[0].boneIndex >= 0 || tri.vert[1].boneIndex >= 0 || tri.vert[2].boneIndex >= 0)continue;
+        auto &collTri = collisionTris.emplace_back();
+        for(int v=0; v<3; ++v) {
+          for(int i=0; i<3; ++i)collTri.pos[v][i] = tri.vert[v].pos[i];
+        }
+        collTri.materialIdx = materialUUIDMap[model.material.uuid];
+      }
+    }
+    if(collisionTris.empty()) {
+      fprintf(stderr, "Warning: no triangles found for the collision-mesh (tag: '%s')\n", config.collisionTag.c_str());
+    } else {
+      chunkCount += 1;
+    }
+  }
   chunkCount += usedMaterials.size();
   std::vector<ModelChunked> modelChunks{};
-  modelChunks.reserve(t3dm.models.size());
-  for(const auto & model : t3dm.models) {
-    auto chunks = chunkUpModel(model);
+  modelChunks.resize(t3dm.models.size());
+  std::vector<uint32_t> rspCyclesBefore(t3dm.models.size(), 0);
+  std::vector<std::vector<ModelChunked>> lodChunks(t3dm.models.size());
+  std::vector<std::vector<float>> lodErrors(t3dm.models.size());
+
+  // models are independent of each other until written out, chunk + optimize them in parallel.
+  // Each job only writes into its own slot, so the output is the same as doing it in order.
+  Parallel::forEach(t3dm.models.size(), config.jobs, [&](size_t i) {
+    modelChunks[i] = chunkUpModel(t3dm.models[i]);
+    rspCyclesBefore[i] = estimateRspCycles(modelChunks[i]);
+    optimizeModelChunk(modelChunks[i]);
+    modelChunks[i].triCount = t3dm.models[i].triangles.size();
+
+    // LODs would need their own deltas, objects with morph-targets are always drawn in full detail
+    uint32_t lodLevels = t3dm.models[i].morphTargets.empty() ? config.lodLevels : 0;
+    for(auto &lod : createModelLODs(t3dm.models[i], lodLevels, config.lodRatio)) {
+      auto &chunks = lodChunks[i].emplace_back(chunkUpModel(lod.model));
+      optimizeModelChunk(chunks);
+      chunks.triCount = lod.model.triangles.size();
+      lodErrors[i].push_back(lod.error);
+    }
+  });
+
+  uint64_t totalCyclesBefore = 0;
+  uint64_t totalCyclesAfter = 0;
+  for(size_t i=0; i<t3dm.models.size(); ++i) {
+    const auto &model = t3dm.models[i];
+    const auto &chunks = modelChunks[i];
     if(config.verbose) {
       printf("[%s] Vertices out: %d\n", model.name.c_str(), chunks.vertices.size());
     }
-    optimizeModelChunk(chunks);
 
     if(config.verbose) {
       int totalIdx=0, totalStrips=0, totalStripCmd = 0;
@@ -164,11 +291,25 @@ int main(int argc, char* argv[])
         totalStripCmd += !c.stripIndices[0].empty() + !c.stripIndices[1].empty() + !c.stripIndices[2].empty() + !c.stripIndices[3].empty();
       }
       printf("[%s] Idx-Tris: %d, Idx-Strip: %d (commands: %d)\n", model.name.c_str(), totalIdx, totalStrips, totalStripCmd);
+
+      for(uint32_t l=0; l<lodChunks[i].size(); ++l) {
+        printf("[%s:lod-%d] Tris: %d, Vertices: %zu, Error: %.2f\n", model.name.c_str(), l+1,
+          lodChunks[i][l].triCount, lodChunks[i][l].vertices.size(), lodErrors[i][l]
+        );
+      }
+    }
+
+    if(config.reportCost) {
+      uint32_t cyclesAfter = estimateRspCycles(chunks);
+      printf("[%s] RSP est.: %6.2fus -> %6.2fus (%d -> %d cycles)\n", model.name.c_str(),
+        rspCyclesBefore[i] / RSP_CLOCK_MHZ, cyclesAfter / RSP_CLOCK_MHZ, rspCyclesBefore[i], cyclesAfter
+      );
+      totalCyclesBefore += rspCyclesBefore[i];
+      totalCyclesAfter += cyclesAfter;
     }
 
-    chunks.triCount = model.triangles.size();
-    modelChunks.push_back(chunks);
     chunkCount += 1; // object
+    if(!model.morphTargets.empty())chunkCount += 1;
 
     aabbMin[0] = std::min(aabbMin[0], chunks.aabbMin[0]);
     aabbMin[1] = std::min(aabbMin[1], chunks.aabbMin[1]);
@@ -178,6 +319,13 @@ int main(int argc, char* argv[])
     aabbMax[1] = std::max(aabbMax[1], chunks.aabbMax[1]);
     aabbMax[2] = std::max(aabbMax[2], chunks.aabbMax[2]);
   }
+  if(config.reportCost) {
+    printf("Total RSP est.: %.2fus -> %.2fus (%.1f%%)\n",
+      totalCyclesBefore / RSP_CLOCK_MHZ, totalCyclesAfter / RSP_CLOCK_MHZ,
+      totalCyclesBefore ? (100.0 * totalCyclesAfter / totalCyclesBefore) : 100.0
+    );
+  }
+
   chunkCount += t3dm.skeletons.empty() ? 0 : 1;
   chunkCount += t3dm.animations.size();
 
@@ -226,10 +374,13 @@ int main(int argc, char* argv[])
   BinaryFile chunkVerts{};
   BinaryFile chunkIndices{};
   BinaryFile chunkBVH{};
+  BinaryFile chunkCollision{};
+  BinaryFile chunkPVS{};
   std::vector<std::shared_ptr<BinaryFile>> chunkMaterials{};
   std::vector<BinaryFile> chunkSkeletons{};
+  std::vector<BinaryFile> chunkMorphs{};
 
-  std::string stringTable = "S";
+  StringTable stringTable{"S"};
 
   // now write out each model (aka. collection of mesh-parts + materials)
   int m=0;
@@ -255,6 +406,40 @@ int main(int argc, char* argv[])
     chunkBVH.writeArray(bvhData.data(), bvhData.size());
   }
 
+  if(!collisionTris.empty()) {
+    auto collData = createCollisionBVH(collisionTris);
+    chunkCollision.writeArray(collData.data(), collData.size());
+    if(config.verbose) {
+      printf("Collision: %d triangles, %d nodes, %d vertices\n", (uint16_t)collData[1], (uint16_t)collData[0], (uint16_t)collData[2]);
+    }
+  }
+
+  if(config.pvsCellSize > 0.0f) {
+    auto pvs = createPVS(t3dm.models, config.pvsCellSize * config.globalScale, config.jobs);
+    chunkPVS.writeArray(pvs.gridMin, 3);
+    chunkPVS.writeArray(pvs.gridSize, 3);
+    chunkPVS.write(pvs.cellSize);
+    chunkPVS.write(pvs.objectCount);
+    chunkPVS.write(pvs.setSize);
+    chunkPVS.write((uint16_t)pvs.sets.size());
+    chunkPVS.write<uint16_t>(0);
+    chunkPVS.writeArray(pvs.cellSets.data(), pvs.cellSets.size());
+    for(const auto &set : pvs.sets) {
+      chunkPVS.writeArray(set.data(), set.size());
+    }
+
+    if(config.verbose) {
+      uint32_t visibleSum = 0;
+      for(auto setIdx : pvs.cellSets) {
+        for(auto byte : pvs.sets[setIdx])visibleSum += std::popcount(byte);
+      }
+      printf("PVS: %dx%dx%d cells, %d unique sets, %.1f%% visible on average\n",
+        pvs.gridSize[0], pvs.gridSize[1], pvs.gridSize[2], (int)pvs.sets.size(),
+        pvs.cellSets.empty() || !pvs.objectCount ? 100.0 : 100.0 * visibleSum / (pvs.cellSets.size() * pvs.objectCount)
+      );
+    }
+  }
+
   // write used materials
   for(auto &material_ : usedMaterials) {
     auto &material = *material_;
@@ -277,7 +462,7 @@ int main(int argc, char* argv[])
     f->writeArray(material.primColor, 4);
     f->writeArray(material.envColor, 4);
     f->writeArray(material.blendColor, 4);
-    f->write(insertString(stringTable, material.name));
+    f->write(stringTable.insert(material.name));
 
     // @TODO: refactor materials to match file/runtime structure
     std::vector<const MaterialTexture*> materials{&material.texA, &material.texB};
@@ -285,22 +470,11 @@ int main(int argc, char* argv[])
       const MaterialTexture&mat = *mat_;
 
       f->write(mat.texReference);
-      std::string texPath = "";
-      if(!mat.texPath.empty()) {
-        texPath = fs::relative(mat.texPath, std::filesystem::current_path()).string();
-        std::replace(texPath.begin(), texPath.end(), '\\', '/');
-
-        if(texPath.find(config.assetPath) == 0) {
-          texPath.replace(0, config.assetPath.size(), "rom:/");
-        }
-        if(texPath.find(".png") != std::string::npos) {
-          texPath.replace(texPath.find(".png"), 4, ".sprite");
-        }
-      }
+      std::string texPath = getTextureRomPath(mat);
 
       if(!texPath.empty()) {
         // check if string already exits
-        auto strPos = insertString(stringTable, texPath);
+        auto strPos = stringTable.insert(texPath);
 
         uint32_t hash = stringHash(texPath);
         //printf("Texture: %s (%d)\n", texPath.c_str(), hash);
@@ -333,26 +507,11 @@ int main(int argc, char* argv[])
     chunkMaterials.push_back(f);
   }
 
-  file.align(8);
-  for(auto &model : t3dm.models)
+  // Writes the parts of an object, these are a collection of indices after a vertex-slice load.
+  // The vertices and indices referenced by them are appended to the global buffers.
+  auto writeParts = [&](const ModelChunked &chunks)
   {
-    addToChunkTable('O');
-    uint32_t matIdx = materialUUIDMap[model.material.uuid];
-
-    // write object chunk
-    const auto &chunks = modelChunks[m];
-    file.write(insertString(stringTable, chunks.chunks.back().name));
-    file.write((uint16_t)chunks.chunks.size());
-    file.write(chunks.triCount);
-    file.write(matIdx);
-    file.write<uint32_t>(0); // block, set at runtime
-    file.write<uint32_t>(0); // visibility, set at runtime + padding
-    file.writeArray(chunks.aabbMin, 3);
-    file.writeArray(chunks.aabbMax, 3);
-
     //printf("Object %d: %d vert offset\n", m, chunkVerts.getPos());
-
-    // Write parts, these are a collection of indices after a vertex-slice load
     for(const auto& chunk : chunks.chunks)
     {
       //printf("  t3d_vert_load(vertices, %d, %d);\n", chunk.vertexOffset, chunk.vertexCount);
@@ -389,14 +548,10 @@ int main(int argc, char* argv[])
       const auto &vertB = chunks.vertices[v+1];
 
       //printf("Pos: %d %d %d | %d %d %d\n", vertA.pos[0], vertA.pos[1], vertA.pos[2], vertB.pos[0], vertB.pos[1], vertB.pos[2]);
-      chunkVerts.write(vertA.pos[0]);
-      chunkVerts.write(vertA.pos[1]);
-      chunkVerts.write(vertA.pos[2]);
+      chunkVerts.writeArray(vertA.pos, 3);
       chunkVerts.write(vertA.norm);
 
-      chunkVerts.write(vertB.pos[0]);
-      chunkVerts.write(vertB.pos[1]);
-      chunkVerts.write(vertB.pos[2]);
+      chunkVerts.writeArray(vertB.pos, 3);
       chunkVerts.write(vertB.norm);
 
       chunkVerts.write(vertA.rgba);
@@ -408,6 +563,52 @@ int main(int argc, char* argv[])
       chunkVerts.write(vertB.t);
     }
     totalVertCount += chunks.vertices.size();
+  };
+
+  constexpr uint32_t LOD_ENTRY_SIZE = 12;
+
+  file.align(8);
+  for(auto &model : t3dm.models)
+  {
+    uint32_t objectOffset = file.getPos();
+    addToChunkTable('O');
+    uint32_t matIdx = materialUUIDMap[model.material.uuid];
+
+    // write object chunk
+    const auto &chunks = modelChunks[m];
+    file.write(stringTable.insert(chunks.chunks.back().name));
+    file.write((uint16_t)chunks.chunks.size());
+    file.write(chunks.triCount);
+    file.write(matIdx);
+    file.write<uint32_t>(0); // block, set at runtime
+    file.write<uint8_t>(0); // visibility, set at runtime
+    file.write<uint8_t>(lodChunks[m].size());
+    file.skip(2); // padding
+    file.writeArray(chunks.aabbMin, 3);
+    file.writeArray(chunks.aabbMax, 3);
+
+    writeParts(chunks);
+    if(!model.morphTargets.empty()) {
+      chunkMorphs.push_back(writeMorphTargets(model, chunks, m, stringTable));
+    }
+
+    // LODs: table after the full-detail parts, followed by the parts of each level
+    uint32_t offsetLodTable = file.getPos();
+    for(uint32_t l=0; l<lodChunks[m].size(); ++l) {
+      file.write<uint32_t>(0); // offset to parts, relative to the object (set later)
+      file.write((uint16_t)lodChunks[m][l].chunks.size());
+      file.write(lodChunks[m][l].triCount);
+      file.write(lodErrors[m][l]);
+    }
+
+    for(const auto &lod : lodChunks[m]) {
+      uint32_t partsOffset = file.posPush() - objectOffset;
+        file.setPos(offsetLodTable);
+        file.write(partsOffset);
+        offsetLodTable += LOD_ENTRY_SIZE;
+      file.posPop();
+      writeParts(lod);
+    }
 
     ++m;
   }
@@ -418,12 +619,12 @@ int main(int argc, char* argv[])
     file.align(4);
     addToChunkTable('A');
 
-    file.write(insertString(stringTable, anim.name));
+    file.write(stringTable.insert(anim.name));
     file.write<float>(anim.duration);
     file.write<uint32_t>(anim.keyframes.size());
     file.write<uint16_t>(anim.channelCountQuat);
     file.write<uint16_t>(anim.channelCountScalar);
-    file.write<uint32_t>(insertString(stringTable,
+    file.write<uint32_t>(stringTable.insert(
       getRomPath(getStreamDataPath(t3dmPath.c_str(), animIdx))
     ));
 
@@ -473,6 +674,24 @@ int main(int argc, char* argv[])
     file.writeMemFile(chunkBVH);
   }
 
+  if(!collisionTris.empty()) {
+    file.align(8);
+    addToChunkTable('C');
+    file.writeMemFile(chunkCollision);
+  }
+
+  if(config.pvsCellSize > 0.0f) {
+    file.align(8);
+    addToChunkTable('P');
+    file.writeMemFile(chunkPVS);
+  }
+
+  for(const auto &chunkMorph : chunkMorphs) {
+    file.align(4);
+    addToChunkTable('D');
+    file.writeMemFile(chunkMorph);
+  }
+
   file.align(16);
   addChunkTypeIndex();
   addToChunkTable('V');
@@ -499,7 +718,7 @@ int main(int argc, char* argv[])
   // String table
   file.align(4);
   uint32_t stringTableOffset = file.getPos();
-  file.write(stringTable);
+  file.write(stringTable.getData());
 
   file.setPos(offsetStringTablePtr);
   file.write(stringTableOffset);
@@ -512,8 +731,193 @@ int main(int argc, char* argv[])
   // write to actual file
   file.writeToFile(t3dmPath.c_str());
 
+  std::vector<std::string> outputPaths{t3dmPath};
   for(int s=0; s<streamFiles.size(); ++s) {
     auto sdataPath = getStreamDataPath(t3dmPath.c_str(), s);
     streamFiles[s].writeToFile(sdataPath.c_str());
+    outputPaths.push_back(sdataPath);
+  }
+
+  // textures are only known after parsing, these are needed to validate cache entries
+  for(auto &material : usedMaterials) {
+    if(!material->texA.texPath.empty())dependencies.push_back(material->texA.texPath);
+    if(!material->texB.texPath.empty())dependencies.push_back(material->texB.texPath);
+  }
+  return outputPaths;
+}
+
+/**
+ * Splits the scene into cells ('--tiles'), each written into its own .t3dm file.
+ * The file at 'indexPath' is then an index with the bounds, size and path of each cell,
+ * followed by all textures used across cells (e.g. to be loaded upfront).
+ * @return paths of all files written
+ */
+std::vector<std::string> writeTiles(T3DMData &t3dm, const std::string &indexPath, std::vector<std::string> &dependencies)
+{
+  float cellSize = config.tileSize * config.globalScale;
+  auto cells = Tiling::split(t3dm, cellSize);
+  if(cells.size() > 0xFFFF)throw std::runtime_error("Too many cells, increase the tile size");
+
+  std::vector<std::string> outputPaths{indexPath};
+  std::vector<std::string> texturePaths{};
+  std::unordered_set<std::string> textureSet{};
+  StringTable stringTable{"S"};
+
+  BinaryFile file{};
+  file.writeChars("T3S", 3);
+  file.write<uint8_t>(T3DS_VERSION);
+  file.write<uint16_t>(cells.size());
+  file.write<uint16_t>(0); // texture count (set later)
+  file.write(cellSize);
+
+  uint32_t offsetTablePtrs = file.getPos();
+  file.skip(2 * sizeof(uint32_t)); // texture-table + string-table offset (filled later)
+
+  for(uint32_t c=0; c<cells.size(); ++c) {
+    auto &cell = cells[c];
+
+    int16_t aabbMin[3] = {32767, 32767, 32767};
+    int16_t aabbMax[3] = {-32768, -32768, -32768};
+    uint32_t triCount = 0;
+    for(auto &model : cell.data.models) {
+      for(auto &tri : model.triangles) {
+        for(auto &v : tri.vert) {
+          for(int i=0; i<3; ++i) {
+            aabbMin[i] = std::min(aabbMin[i], v.pos[i]);
+            aabbMax[i] = std::max(aabbMax[i], v.pos[i]);
+          }
+        }
+      }
+      triCount += model.triangles.size();
+
+      for(auto tex : {&model.material.texA, &model.material.texB}) {
+        auto texPath = getTextureRomPath(*tex);
+        if(!texPath.empty() && textureSet.insert(texPath).second)texturePaths.push_back(texPath);
+      }
+    }
+
+    auto cellPath = getCellPath(indexPath, c);
+    auto cellOutputs = writeT3DM(cell.data, cellPath, dependencies);
+    outputPaths.insert(outputPaths.end(), cellOutputs.begin(), cellOutputs.end());
+    auto cellFileSize = (uint32_t)fs::file_size(cellPath);
+
+    if(config.verbose) {
+      printf("Cell[%d] (%d, %d): %zu objects, %d triangles, %d bytes -> %s\n",
+        c, cell.gridPos[0], cell.gridPos[1], cell.data.models.size(), triCount, cellFileSize, cellPath.c_str()
+      );
+    }
+
+    file.writeArray(aabbMin, 3);
+    file.writeArray(aabbMax, 3);
+    file.writeArray(cell.gridPos, 2);
+    file.write(stringTable.insert(getRomPath(cellPath)));
+    file.write(cellFileSize);
+    file.write((uint16_t)std::min(triCount, 0xFFFFu));
+    file.write((uint16_t)cell.data.models.size());
+  }
+
+  uint32_t textureTableOffset = file.getPos();
+  for(auto &texPath : texturePaths) {
+    file.write(stringTable.insert(texPath));
+  }
+
+  file.align(4);
+  uint32_t stringTableOffset = file.getPos();
+  file.write(stringTable.getData());
+
+  file.setPos(0x06);
+  file.write<uint16_t>(texturePaths.size());
+  file.setPos(offsetTablePtrs);
+  file.write(textureTableOffset);
+  file.write(stringTableOffset);
+
+  file.writeToFile(indexPath.c_str());
+  return outputPaths;
+}
+
+int main(int argc, char* argv[])
+{
+  EnvArgs args{argc, argv};
+  if(args.checkArg("--help")) {
+    printf("Usage: %s <gltf-file> <t3dm-file> [--bvh] [--collision[=tag]] [--lod=levels,ratio] [--tiles=size] [--pvs=size] [--base-scale=64] [--ignore-materials] [--asset-path=assets] [--jobs=N] [--cache=dir] [--report-cost] [--verbose]\n", argv[0]);
+    printf("       %s --bench-writer[=vertex-count]\n", argv[0]);
+    return 1;
+  }
+
+  if(args.checkArg("--bench-writer")) {
+    auto vertCount = args.getStringArg("--bench-writer");
+    return Bench::writer(vertCount.empty() ? 500'000 : std::stoul(vertCount));
+  }
+
+  const std::string gltfPath = args.getFilenameArg(0);
+  const std::string t3dmPath = args.getFilenameArg(1);
+
+  config.globalScale = (float)args.getU32Arg("--base-scale", 64);
+  config.ignoreMaterials = args.checkArg("--ignore-materials");
+  config.createBVH = args.checkArg("--bvh");
+  config.createCollision = args.checkArg("--collision");
+  config.collisionTag = args.getStringArg("--collision");
+
+  if(args.checkArg("--lod")) {
+    auto lodArg = args.getStringArg("--lod");
+    auto sep = lodArg.find(',');
+    config.lodLevels = std::stoul(lodArg.substr(0, sep));
+    if(config.lodLevels > 255) { // stored as a u8 ('lodCount') per object
+      throw std::runtime_error("At most 255 LOD levels are supported");
+    }
+    if(sep != std::string::npos)config.lodRatio = std::stof(lodArg.substr(sep+1));
+    if(config.lodRatio <= 0.0f || config.lodRatio >= 1.0f) {
+      throw std::runtime_error("LOD ratio must be between 0 and 1 (exclusive)");
+    }
+  }
+  if(args.checkArg("--tiles")) {
+    config.tileSize = std::stof(args.getStringArg("--tiles"));
+    if(config.tileSize <= 0.0f)throw std::runtime_error("Tile size must be greater than 0");
+  }
+  if(args.checkArg("--pvs")) {
+    config.pvsCellSize = std::stof(args.getStringArg("--pvs"));
+    if(config.pvsCellSize <= 0.0f)throw std::runtime_error("PVS cell size must be greater than 0");
+  }
+  config.verbose = args.checkArg("--verbose");
+  config.reportCost = args.checkArg("--report-cost");
+  config.jobs = args.getU32Arg("--jobs", 0);
+
+  config.assetPath = args.getStringArg("--asset-path");
+  if(config.assetPath.empty()) {
+    config.assetPath = "assets/";
+  }
+  if(config.assetPath.back() != '/') {
+    config.assetPath.push_back('/');
+  }
+
+  config.assetPathFull = fs::absolute(config.assetPath).string();
+  if(config.verbose) {
+    printf("Asset path: %s (%s)\n", config.assetPath.c_str(), config.assetPathFull.c_str());
+  }
+
+  config.animSampleRate = 60;
+  config.cachePath = args.getStringArg("--cache");
+
+  uint64_t cacheKey = 0;
+  if(!config.cachePath.empty()) {
+    cacheKey = Cache::calcKey(gltfPath, t3dmPath, argv[0]);
+    if(cacheKey == 0) {
+      fprintf(stderr, "Cache: failed to read the converter executable, cache disabled\n");
+      config.cachePath.clear();
+    } else if(Cache::restore(cacheKey)) {
+      return 0;
+    }
+  }
+
+  auto t3dm = parseGLTF(gltfPath.c_str(), config.globalScale);
+  fs::path gltfBasePath{gltfPath};
+
+  std::vector<std::string> dependencies{};
+  auto outputPaths = config.tileSize > 0.0f
+    ? writeTiles(t3dm, t3dmPath, dependencies)
+    : writeT3DM(t3dm, t3dmPath, dependencies);
+
+  if(!config.cachePath.empty()) {
+    Cache::store(cacheKey, outputPaths, dependencies);
   }
 }
\ No newline at end of file
@@ -4,6 +4,9 @@
 */
 #include "optimizer.h"
 
+#include <cmath>
+#include <stdexcept>
+
 #include "bvh/v2/bvh.h"
 #include "bvh/v2/vec.h"
 #include "bvh/v2/ray.h"
@@ -52,6 +55,16 @@ namespace
       out.push_back(prim_id);
     }
   }
+
+  // must match 'T3D_COLLISION_STACK_SIZE' in t3dmodel.h
+  constexpr uint32_t COLLISION_MAX_DEPTH = 64;
+
+  uint32_t getTreeDepth(const Bvh &bvh, uint32_t nodeIndex = 0) {
+    const auto &node = bvh.nodes[nodeIndex];
+    if(node.is_leaf())return 1;
+    uint32_t child = node.index.first_id();
+    return 1 + std::max(getTreeDepth(bvh, child), getTreeDepth(bvh, child+1));
+  }
 }
 
 /**
@@ -80,4 +93,83 @@ std::vector<int16_t> createMeshBVH(const std::vector<ModelChunked> &modelChunks)
   std::vector<int16_t> treeData;
   writeBVH(treeData, bvh);
   return treeData;
-}
\ No newline at end of file
+}
+
+/**
+ * Creates a BVH over individual triangles for collision checks.
+ * Layout (all 16bit): header, nodes, triangles (sorted by leaf), de-duplicated vertices.
+ * Inner nodes point to their first child (the second one follows), leaves to their first triangle.
+ * @param tris triangles, already filtered
+ */
+std::vector<int16_t> createCollisionBVH(const std::vector<CollisionTri> &tris)
+{
+  std::vector<BBox> aabbs;
+  std::vector<BVec3> centers;
+  for(auto &tri : tris) {
+    BBox box = BBox::make_empty();
+    for(auto &pos : tri.pos) {
+      box.extend(BVec3(pos[0], pos[1], pos[2]));
+    }
+    aabbs.push_back(box);
+    centers.push_back(box.get_center());
+  }
+
+  bvh::v2::ThreadPool thread_pool;
+  typename bvh::v2::DefaultBuilder<Node>::Config config;
+  config.quality = bvh::v2::DefaultBuilder<Node>::Quality::High;
+  // Leaves of up to 4 triangles: a triangle test (float, with vertex fetch) costs several times
+  // the int16 AABB test of a node, so leaves are kept small. Below 4 the per-node overhead of the
+  // traversal (stack, node load) outweighs the saved triangle tests, so the SAH counts triangles
+  // in clusters of 4 and never splits a node with 4 or less. Larger nodes are always split.
+  config.sah = bvh::v2::SplitHeuristic<Scalar>(2, 1.0);
+  config.max_leaf_size = 4;
+  auto bvh = bvh::v2::DefaultBuilder<Node>::build(thread_pool, aabbs, centers, config);
+
+  uint32_t depth = getTreeDepth(bvh);
+  if(bvh.nodes.size() > 0xFFFF || tris.size() > 0xFFFF || depth > COLLISION_MAX_DEPTH) {
+    throw std::runtime_error("Collision mesh too large, try to split it up or use '--collision=tag' to filter it");
+  }
+
+  // de-duplicate vertices, triangles are stored in leaf order
+  std::vector<int16_t> vertData{};
+  std::vector<int16_t> triData{};
+  std::unordered_map<uint64_t, uint16_t> vertIdxMap{};
+  for(auto primId : bvh.prim_ids) {
+    const auto &tri = tris[primId];
+    for(auto &pos : tri.pos) {
+      uint64_t key = (uint64_t)(uint16_t)pos[0] | ((uint64_t)(uint16_t)pos[1] << 16) | ((uint64_t)(uint16_t)pos[2] << 32);
+      auto it = vertIdxMap.find(key);
+      if(it == vertIdxMap.end()) {
+        if(vertIdxMap.size() >= 0xFFFF) {
+          throw std::runtime_error("Collision mesh has too many vertices");
+        }
+        it = vertIdxMap.emplace(key, (uint16_t)vertIdxMap.size()).first;
+        vertData.insert(vertData.end(), pos, pos + 3);
+      }
+      triData.push_back(it->second);
+    }
+    triData.push_back(tri.materialIdx);
+  }
+
+  std::vector<int16_t> res{};
+  res.push_back(bvh.nodes.size());
+  res.push_back(tris.size());
+  res.push_back(vertIdxMap.size());
+  res.push_back(depth);
+
+  for(auto &node : bvh.nodes) {
+    // 'bounds' layout is [min_x, max_x, min_y, max_y, min_z, max_z]
+    res.push_back((int16_t)std::floor(node.bounds[0]));
+    res.push_back((int16_t)std::floor(node.bounds[2]));
+    res.push_back((int16_t)std::floor(node.bounds[4]));
+    res.push_back((int16_t)std::ceil(node.bounds[1]));
+    res.push_back((int16_t)std::ceil(node.bounds[3]));
+    res.push_back((int16_t)std::ceil(node.bounds[5]));
+    res.push_back(node.index.first_id());
+    res.push_back(node.index.prim_count());
+  }
+
+  res.insert(res.end(), triData.begin(), triData.end());
+  res.insert(res.end(), vertData.begin(), vertData.end());
+  return res;
+}
@@ -0,0 +1,77 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#include "optimizer.h"
+
+#include "../lib/meshopt/meshoptimizer.h"
+
+namespace {
+  // stop generating levels once a level no longer removes at least this much
+  constexpr float MIN_LEVEL_REDUCTION = 0.9f;
+}
+
+/**
+ * Creates simplified versions of a model, each with 'ratio' times the triangles of the previous one.
+ * Levels are always simplified from the original mesh, and may be less than requested
+ * if the mesh can't be reduced any further.
+ * Skinned models are not supported, since vertices are stored in bone-space.
+ */
+std::vector<ModelLOD> createModelLODs(const Model &model, uint32_t levels, float ratio)
+{
+  std::vector<ModelLOD> res{};
+  if(levels == 0 || model.triangles.empty())return res;
+
+  // convert back into an index buffer, vertices are de-duplicated by all their attributes
+  std::vector<VertexT3D> vertices{};
+  std::vector<float> positions{};
+  std::vector<uint32_t> indices{};
+  std::unordered_map<uint64_t, uint32_t> vertIdxMap{};
+
+  for(const auto &tri : model.triangles) {
+    for(const auto &vert : tri.vert) {
+      if(vert.boneIndex >= 0)return res;
+
+      auto it = vertIdxMap.find(vert.hash);
+      if(it == vertIdxMap.end()) {
+        it = vertIdxMap.emplace(vert.hash, vertices.size()).first;
+        vertices.push_back(vert);
+        positions.push_back(vert.pos[0]);
+        positions.push_back(vert.pos[1]);
+        positions.push_back(vert.pos[2]);
+      }
+      indices.push_back(it->second);
+    }
+  }
+
+  // errors are relative to the mesh size, this converts them into model-space units
+  float errorScale = meshopt_simplifyScale(positions.data(), vertices.size(), sizeof(float) * 3);
+
+  float targetCount = indices.size();
+  size_t lastCount = indices.size();
+  std::vector<uint32_t> lodIndices(indices.size());
+
+  for(uint32_t l=0; l<levels; ++l) {
+    targetCount *= ratio;
+    size_t targetIndexCount = std::max<size_t>(3, (size_t)(targetCount / 3) * 3);
+
+    float error = 0.0f;
+    size_t count = meshopt_simplify(
+      lodIndices.data(), indices.data(), indices.size(),
+      positions.data(), vertices.size(), sizeof(float) * 3,
+      targetIndexCount, 1.0f, 0, &error
+    );
+    if(count == 0 || count > lastCount * MIN_LEVEL_REDUCTION)break;
+    lastCount = count;
+
+    auto &lod = res.emplace_back();
+    lod.error = error * errorScale;
+    lod.model.name = model.name;
+    lod.model.material = model.material;
+    lod.model.triangles.resize(count / 3);
+    for(size_t i=0; i<count; ++i) {
+      lod.model.triangles[i / 3].vert[i % 3] = vertices[lodIndices[i]];
+    }
+  }
+  return res;
+}
@@ -5,6 +5,7 @@
 #include "optimizer.h"
 #include <algorithm>
 #include <array>
+#include <cassert>
 
 #include "../lib/tristrip/tri_stripper.h"
 
@@ -13,6 +14,59 @@
 namespace {
   typedef std::array<int8_t, 3> Tri;
   typedef std::vector<Tri> TriList;
+  typedef std::vector<int8_t> Strip;
+
+  // Rough cost model of the ucode paths used to draw a part, in RSP cycles.
+  // This is not meant to be exact, it only has to be good enough to compare different schedules of the same part.
+  namespace RspCost {
+    constexpr uint32_t CMD_OVERHEAD    = 24;  // fetch + dispatch of any overlay command
+    constexpr uint32_t TRI_CMD         = 16;  // 't3d_tri_draw': index to DMEM pointer setup
+    constexpr uint32_t STRIP_CMD       = 40;  // 't3d_tri_draw_strip': DMA setup + loop init
+    constexpr uint32_t DMA_WAIT        = 70;  // latency until the index buffer arrived in DMEM
+    constexpr uint32_t DMA_PER_8_BYTES = 2;
+    constexpr uint32_t STRIP_PER_INDEX = 6;   // decoding + restart check per strip index
+    constexpr uint32_t TRI_SETUP       = 100; // clipping + RDP triangle setup, same for both paths
+    constexpr uint32_t VERT_LOAD       = 60;  // 't3d_vert_load': DMA + setup
+    constexpr uint32_t VERT_TRANSFORM  = 18;  // T&L per vertex
+    constexpr uint32_t TRI_SYNC        = 30;
+
+    constexpr uint32_t triCmd() {
+      return CMD_OVERHEAD + TRI_CMD;
+    }
+
+    constexpr uint32_t stripCmd(uint32_t indexCount) {
+      return CMD_OVERHEAD + STRIP_CMD + DMA_WAIT
+        + ((indexCount * 2 + 7) / 8) * DMA_PER_8_BYTES
+        + indexCount * STRIP_PER_INDEX;
+    }
+  }
+
+  // max. indices per strip command, the count is stored as a u8 in the file
+  constexpr int MAX_STRIP_INDICES = 255;
+
+  uint32_t countStripTris(const std::vector<int16_t> &strip) {
+    if(strip.empty())return 0;
+    uint32_t restarts = 0;
+    for(size_t i=1; i<strip.size(); ++i) {
+      if(strip[i] & (1<<15))++restarts;
+    }
+    return strip.size() - 2 * (restarts + 1);
+  }
+
+  uint32_t countStripTris(const Strip &strip) {
+    return strip.size() - 2;
+  }
+
+  /**
+   * Returns the first vertex slot that gets overwritten by the index DMA of a strip command.
+   * This mirrors the address calculation in 't3d_tri_draw_strip', where indices are placed
+   * at the end of the vertex cache (8-byte aligned).
+   */
+  int getFirstClobberedSlot(int indexCount) {
+    int dmemEnd = MAX_VERTEX_COUNT * CACHE_VERTEX_SIZE;
+    int dmemAddr = (dmemEnd - indexCount * 2) & ~7;
+    return dmemAddr / CACHE_VERTEX_SIZE;
+  }
 
   bool triHasIndex(const Tri &tri, int idx) {
     return tri[0] == idx || tri[1] == idx || tri[2] == idx;
@@ -48,13 +102,6 @@ namespace {
     return freeVertsEnd;
   }
 
-  int calcUsableIndices(int freeVertices) {
-    int res = freeVertices * CACHE_VERTEX_SIZE / 2;
-    // a single vertex is not aligned (2 are), sub. 8 bytes to not overwrite stuff
-    if(freeVertices % 2 != 0)res -= 8 / 2;
-    return res;
-  }
-
   // stripify the input triangle list into multiple strips
   std::vector<std::vector<int8_t>> stripify(const TriList& tris, int vertexCount)
   {
@@ -117,115 +164,226 @@ namespace {
   }
 }
 
-void optimizeModelChunk(ModelChunked &model)
+/**
+ * Returns the estimated RSP time (in cycles) to load and draw a single part.
+ */
+uint32_t estimateRspCycles(const MeshChunk &chunk)
 {
-  for(auto &chunk : model.chunks)
+  using namespace RspCost;
+  uint32_t cycles = CMD_OVERHEAD + VERT_LOAD + chunk.vertexCount * VERT_TRANSFORM;
+  if(chunk.indices.empty() && chunk.stripIndices[0].empty())return cycles; // partial load
+
+  cycles += (chunk.indices.size() / 3) * (triCmd() + TRI_SETUP);
+  for(const auto &strip : chunk.stripIndices) {
+    if(strip.empty())break;
+    cycles += stripCmd(strip.size()) + countStripTris(strip) * TRI_SETUP;
+  }
+  return cycles + CMD_OVERHEAD + TRI_SYNC;
+}
+
+uint32_t estimateRspCycles(const ModelChunked &model)
+{
+  uint32_t cycles = 0;
+  for(const auto &chunk : model.chunks) {
+    cycles += estimateRspCycles(chunk);
+  }
+  return cycles;
+}
+
+namespace {
+  /**
+   * Checks that no strip references a vertex slot that was already overwritten by the index DMA
+   * of itself or any previous strip command. Single triangles are drawn before any strip, so they are always valid.
+   */
+  bool isScheduleValid(const MeshChunk &chunk)
   {
-    // avoid skinned mesh parts with bones, these use partial loads and indices
-    // which mess up the used index detection (@TODO: handle this)
-    if(chunk.boneCount > 0)continue;
+    int firstClobbered = MAX_VERTEX_COUNT;
+    for(const auto &strip : chunk.stripIndices) {
+      if(strip.empty())break;
+      if(strip.size() > MAX_STRIP_INDICES)return false;
+      firstClobbered = std::min(firstClobbered, getFirstClobberedSlot(strip.size()));
+      for(auto idx : strip) {
+        if((idx & 0x7FFF) >= firstClobbered)return false;
+      }
+    }
+    return true;
+  }
 
-    // convert indices into split up triangles, then clear old indices
-    TriList tris{}; // input tris
-    for(int i=0; i<chunk.indices.size(); i+=3) {
-      tris.push_back({chunk.indices[i], chunk.indices[i+1], chunk.indices[i+2]});
+  bool isDegenerate(int a, int b, int c) {
+    return a == b || b == c || a == c;
+  }
+
+  /**
+   * Counts the triangles that actually get drawn, ignoring degenerate ones.
+   * Those are either part of the input or used to connect strips, and get dropped by 'destripify'.
+   */
+  uint32_t countTris(const MeshChunk &chunk) {
+    uint32_t count = 0;
+    for(size_t i=0; i+2<chunk.indices.size(); i+=3) {
+      if(!isDegenerate(chunk.indices[i], chunk.indices[i+1], chunk.indices[i+2]))++count;
+    }
+    for(const auto &strip : chunk.stripIndices) {
+      size_t start = 0; // first index of the current (restarted) strip
+      for(size_t i=0; i<strip.size(); ++i) {
+        if(i > 0 && (strip[i] & (1<<15)))start = i;
+        if(i < start + 2)continue;
+        if(!isDegenerate(strip[i-2] & 0x7FFF, strip[i-1] & 0x7FFF, strip[i] & 0x7FFF))++count;
+      }
     }
+    return count;
+  }
+
+  uint32_t countTris(const TriList &tris) {
+    uint32_t count = 0;
+    for(const auto &tri : tris) {
+      if(!isDegenerate(tri[0], tri[1], tri[2]))++count;
+    }
+    return count;
+  }
+
+  struct ScheduleParams {
+    int targetFreeVerts; // vertex slots at the end to free up by emitting single triangles first
+    uint32_t minStripTris; // strips with fewer triangles are emitted as single triangles instead
+  };
+
+  /**
+   * Builds a schedule for a part, meaning which triangles are drawn as single triangles
+   * and which ones are put into which of the (up to 4) strip commands.
+   * Single triangles are drawn first, then each strip command, whose index DMA will overwrite
+   * vertex slots at the end of the buffer. So each strip command can only be as big as the free space
+   * left by all vertices still needed by it and all following strip commands.
+   */
+  MeshChunk buildSchedule(const MeshChunk &input, TriList tris, const std::vector<Strip> &stripsIn, const ScheduleParams &params)
+  {
+    MeshChunk chunk = input;
     chunk.indices.clear();
+    for(auto &strip : chunk.stripIndices)strip.clear();
 
-    // writes out a single triangle (3 indices ina command, no DMAs)
-    auto emitTri = [&chunk](const Tri &tri) {
-      chunk.indices.push_back(tri[0]);
-      chunk.indices.push_back(tri[1]);
-      chunk.indices.push_back(tri[2]);
+    auto emitTris = [&chunk](const Strip &indices) {
+      chunk.indices.insert(chunk.indices.end(), indices.begin(), indices.end());
     };
 
-    // emits and appends a triangle strip (1 command, DMAs data)
-    auto emitStrip = [&chunk](const std::vector<int8_t> &strip, int stripIdx) {
-      auto &res = chunk.stripIndices[stripIdx];
-      int oldSize = res.size();
-      if(!res.empty()) {
-        res.push_back(strip[0] | (1<<15));
-        res.insert(res.end(), strip.begin()+1, strip.end());
+    for(auto &tri : tris) {
+      emitTris({tri[0], tri[1], tri[2]});
+    }
+
+    std::vector<Strip> strips{};
+    for(auto &strip : stripsIn) {
+      if(countStripTris(strip) < params.minStripTris) {
+        emitTris(destripify(strip));
       } else {
-        res.insert(res.end(), strip.begin(), strip.end());
+        strips.push_back(strip);
       }
-      return (int)(res.size() - oldSize);
-    };
+    }
 
-    // emits regular triangles until a given index is no longer used (aka free up a vertex slot)
-    auto freeVertexUsage = [&tris, &emitTri](int idx) {
-      for(int i=0; i<tris.size(); ++i) {
-        if(triHasIndex(tris[i], idx)) {
-          emitTri(tris[i]);
-          tris.erase(tris.begin() + i);
-          --i;
+    int stripCmdCount = 0;
+    while(stripCmdCount < 4 && !strips.empty())
+    {
+      // all vertices still needed by the remaining strips (including the ones in this command)
+      // must stay below the area the index DMA writes to
+      int lastUsedSlot = MAX_VERTEX_COUNT - countFreeVertsAtEnd(getVertexUsage(strips));
+
+      std::vector<int16_t> cmd{};
+      uint32_t cmdTris = 0;
+      std::vector<Strip> cmdStrips{};
+      for(size_t i=0; i<strips.size(); ++i) {
+        size_t newSize = cmd.size() + strips[i].size();
+        if(newSize > MAX_STRIP_INDICES || getFirstClobberedSlot(newSize) < lastUsedSlot)continue;
+
+        if(!cmd.empty()) {
+          cmd.push_back(strips[i][0] | (1<<15));
+          cmd.insert(cmd.end(), strips[i].begin()+1, strips[i].end());
+        } else {
+          cmd.insert(cmd.end(), strips[i].begin(), strips[i].end());
         }
+        cmdTris += countStripTris(strips[i]);
+        cmdStrips.push_back(strips[i]);
+        strips.erase(strips.begin() + i);
+        --i;
       }
-    };
 
-    // Strip encoding:
-    // First we stripify the entire triangle array, resulting in an array of strips.
-    // Since we have to fight with the vertex cache for DMEM, we need to make sure that the strips we write don't get too big.
-    // To do so we check how many vertices at the end of the buffer are unused and try to fit as many strips in there.
-    // After that is done we re-check how much space is free now, and repeat the process.
-    // To have a bit of space initially, we emit individual triangles until we have at least X vertices free.
-
-    // check how many vertex slots we are free to use (end of the buffer)
-    auto vertUsage = getVertexUsage(tris);
-    int freeVertsEnd = countFreeVertsAtEnd(vertUsage);
-    int targetFreeVerts = 2;
-
-    // now free until the last slots are free
-    if(freeVertsEnd < targetFreeVerts) {
-      for(int i=MAX_VERTEX_COUNT-targetFreeVerts; i<MAX_VERTEX_COUNT; ++i) {
-        freeVertexUsage(i);
+      if(cmd.empty())break;
+
+      // too few triangles are slower as a strip (DMA) than as single triangles
+      if(RspCost::stripCmd(cmd.size()) >= cmdTris * RspCost::triCmd()) {
+        for(auto &strip : cmdStrips)emitTris(destripify(strip));
+        continue;
       }
-      vertUsage = getVertexUsage(tris);
-      freeVertsEnd = countFreeVertsAtEnd(vertUsage);
+
+      chunk.stripIndices[stripCmdCount++] = cmd;
     }
 
-    int freeIndices = calcUsableIndices(freeVertsEnd);
+    // if we have some triangles left, de-stripify them and emit regular triangles
+    for(auto &strip : strips) {
+      emitTris(destripify(strip));
+    }
+    return chunk;
+  }
+}
+
+void optimizeModelChunk(ModelChunked &model)
+{
+  // Candidates for the schedule search, all combinations are tried and the cheapest one (cost-model) is used.
+  // Note that the results only depend on the input, so this stays deterministic.
+  constexpr int FREE_VERT_CANDIDATES[] = {0, 2, 4, 6, 8, 12, 16, 24};
+  constexpr uint32_t MIN_STRIP_TRI_CANDIDATES[] = {1, 2, 3, 5};
+
+  for(auto &chunk : model.chunks)
+  {
+    // Skinned parts split their vertex loads into one part per bone, only the last one has indices.
+    // Those indices reference the final vertex slots, so they can be handled like any other part.
+    if(chunk.indices.empty())continue;
+
+    // convert indices into split up triangles
+    TriList trisIn{};
+    for(int i=0; i<chunk.indices.size(); i+=3) {
+      trisIn.push_back({chunk.indices[i], chunk.indices[i+1], chunk.indices[i+2]});
+    }
 
-    auto stipChunks = stripify(tris, chunk.vertexCount);
-    std::reverse(stipChunks.begin(), stipChunks.end()); // puts larger indices first
+    // Fallback is the input itself (single triangles only), which is always valid
+    MeshChunk bestChunk = chunk;
+    uint32_t bestCost = estimateRspCycles(chunk);
 
-    // don't do any fancy algorithms here, we want to prefer the first entries (larger indices) in order
-    // to free up as much vertex space. meaning the next batch has way more space to work with
-    for(int s=0; s<4 && !stipChunks.empty(); ++s)
+    for(int targetFreeVerts : FREE_VERT_CANDIDATES)
     {
-      // check if it makes sense to emit the strip
-      // too few triangles are slower as strips than as regular triangles
-      uint32_t totalStripIndices = 0;
-      for(auto &strip : stipChunks) {
-        totalStripIndices += strip.size();
-      }
-      if(totalStripIndices < 7)break;
-
-      // if there are enough indices, emit the strip
-      for(size_t i=0; i<stipChunks.size(); ++i) {
-        int size = (int)stipChunks[i].size()+1;
-        if(freeIndices - size >= 0) {
-          /*printf("Emitting strip %d, space: %d: ", i, freeIndices);
-          for(auto idx : stipChunks[i])printf(" %d", idx);
-          printf("\n");*/
-          freeIndices -= emitStrip(stipChunks[i], s);
-          stipChunks.erase(stipChunks.begin() + i);
-          --i;
+      TriList tris = trisIn;
+      TriList trisSingle{};
+
+      // emits regular triangles until a given index is no longer used (aka free up a vertex slot)
+      auto freeVertexUsage = [&tris, &trisSingle](int idx) {
+        for(int i=0; i<tris.size(); ++i) {
+          if(triHasIndex(tris[i], idx)) {
+            trisSingle.push_back(tris[i]);
+            tris.erase(tris.begin() + i);
+            --i;
+          }
+        }
+      };
+
+      // check how many vertex slots we are free to use (end of the buffer)
+      if(countFreeVertsAtEnd(getVertexUsage(tris)) < targetFreeVerts) {
+        for(int i=MAX_VERTEX_COUNT-targetFreeVerts; i<MAX_VERTEX_COUNT; ++i) {
+          freeVertexUsage(i);
         }
       }
 
-      vertUsage = getVertexUsage(stipChunks);
-      freeVertsEnd = countFreeVertsAtEnd(vertUsage);
-      freeIndices = calcUsableIndices(freeVertsEnd);
-      //printf("strip indices: %d\n", chunk.stripIndices[s].size());
-    }
+      auto strips = stripify(tris, chunk.vertexCount);
+      std::reverse(strips.begin(), strips.end()); // puts larger indices first
 
-    // if we have some triangles left, de-stripify them and emit regular triangles
-    if(!stipChunks.empty()) {
-      for(auto &strip : stipChunks) {
-        auto indices = destripify(strip);
-        chunk.indices.insert(chunk.indices.end(), indices.begin(), indices.end());
+      for(uint32_t minStripTris : MIN_STRIP_TRI_CANDIDATES)
+      {
+        auto candidate = buildSchedule(chunk, trisSingle, strips, {targetFreeVerts, minStripTris});
+        assert(countTris(candidate) == countTris(trisIn));
+        if(!isScheduleValid(candidate))continue;
+
+        uint32_t cost = estimateRspCycles(candidate);
+        if(cost < bestCost) {
+          bestCost = cost;
+          bestChunk = std::move(candidate);
+        }
       }
     }
+
+    chunk = std::move(bestChunk);
   }
 }
\ No newline at end of file
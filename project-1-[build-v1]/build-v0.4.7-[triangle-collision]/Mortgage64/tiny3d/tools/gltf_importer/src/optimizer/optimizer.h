@@ -7,4 +7,9 @@
 #include "../structs.h"
 
 void optimizeModelChunk(ModelChunked &model);
-std::vector<int16_t> createMeshBVH(const std::vector<ModelChunked> &modelChunks);
\ No newline at end of file
+uint32_t estimateRspCycles(const MeshChunk &chunk);
+uint32_t estimateRspCycles(const ModelChunked &model);
+std::vector<int16_t> createMeshBVH(const std::vector<ModelChunked> &modelChunks);
+std::vector<ModelLOD> createModelLODs(const Model &model, uint32_t levels, float ratio);
+std::vector<int16_t> createCollisionBVH(const std::vector<CollisionTri> &tris);
+PVSData createPVS(const std::vector<Model> &models, float cellSize, uint32_t jobs);
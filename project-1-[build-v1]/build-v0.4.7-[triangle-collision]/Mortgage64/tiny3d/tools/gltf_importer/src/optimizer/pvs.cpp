@@ -0,0 +1,241 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#include "optimizer.h"
+#include "../parallel.h"
+#include "../parser/rdp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <random>
+#include <stdexcept>
+
+#include "bvh/v2/bvh.h"
+#include "bvh/v2/vec.h"
+#include "bvh/v2/ray.h"
+#include "bvh/v2/node.h"
+#include "bvh/v2/tri.h"
+#include "bvh/v2/stack.h"
+#include "bvh/v2/default_builder.h"
+
+namespace
+{
+  using Scalar = float;
+  using Vec3F  = bvh::v2::Vec<Scalar, 3>;
+  using BBoxF  = bvh::v2::BBox<Scalar, 3>;
+  using NodeF  = bvh::v2::Node<Scalar, 3>;
+  using BvhF   = bvh::v2::Bvh<NodeF>;
+  using TriF   = bvh::v2::PrecomputedTri<Scalar>;
+  using RayF   = bvh::v2::Ray<Scalar, 3>;
+
+  constexpr uint32_t CELL_SAMPLES = 8; // ray origins per cell, one per octant
+  constexpr uint32_t OBJECT_SAMPLES = 32; // ray targets per object, on its triangles
+  constexpr uint32_t RAYS_PER_OBJECT = 64; // rays per cell and object until it counts as hidden
+  constexpr uint32_t MAX_CELLS = 0xFFFF;
+
+  struct SceneTri {
+    TriF tri;
+    uint32_t objectIdx;
+    bool isOccluder;
+  };
+
+  // only fully opaque surfaces hide what's behind them, everything else can be seen through (or moves)
+  bool isOccluder(const Model &model, const TriangleT3D &tri) {
+    if(tri.vert[0].boneIndex >= 0 || tri.vert[1].boneIndex >= 0 || tri.vert[2].boneIndex >= 0)return false;
+    const auto &mat = model.material;
+    if(mat.blendMode == RDP::BLEND::MULTIPLY)return false;
+    if(mat.otherModeValue & (RDP::SOM::ALPHA_COMPARE | RDP::SOM::ZMODE_DECAL))return false;
+    return true;
+  }
+
+  Vec3F toVec(const VertexT3D &v) {
+    return Vec3F(v.pos[0], v.pos[1], v.pos[2]);
+  }
+
+  bool boxOverlap(const BBoxF &a, const BBoxF &b) {
+    for(int i=0; i<3; ++i) {
+      if(a.max[i] < b.min[i] || b.max[i] < a.min[i])return false;
+    }
+    return true;
+  }
+}
+
+/**
+ * Computes which objects may be visible from each cell of a regular grid over the scene.
+ * Rays are cast from a few points in each cell to points on the triangles of each object,
+ * an object is visible if any ray hits it before an opaque triangle of another object.
+ * This is sampled and therefore not exact, but it errs on the side of visibility.
+ * Skinned objects and objects overlapping a cell are always visible from it.
+ *
+ * @param models models in the same order as the objects in the file
+ * @param cellSize size of a cell in model space
+ * @param jobs worker threads, see '--jobs'
+ */
+PVSData createPVS(const std::vector<Model> &models, float cellSize, uint32_t jobs)
+{
+  if(models.size() > 0xFFFF) {
+    throw std::runtime_error("Too many objects for a PVS");
+  }
+
+  PVSData res{};
+  res.cellSize = cellSize;
+  res.objectCount = models.size();
+  res.setSize = (models.size() + 7) / 8;
+
+  std::vector<SceneTri> sceneTris{};
+  std::vector<BBoxF> objAABBs(models.size(), BBoxF::make_empty());
+  std::vector<std::vector<Vec3F>> objSamples(models.size());
+  std::vector<bool> alwaysVisible(models.size(), false);
+  BBoxF sceneAABB = BBoxF::make_empty();
+
+  for(uint32_t o=0; o<models.size(); ++o) {
+    const auto &model = models[o];
+    std::vector<float> areaSum{};
+    std::vector<const TriangleT3D*> objTris{};
+
+    for(const auto &tri : model.triangles) {
+      Vec3F p0 = toVec(tri.vert[0]);
+      Vec3F p1 = toVec(tri.vert[1]);
+      Vec3F p2 = toVec(tri.vert[2]);
+      objAABBs[o].extend(p0).extend(p1).extend(p2);
+      if(tri.vert[0].boneIndex >= 0 || tri.vert[1].boneIndex >= 0 || tri.vert[2].boneIndex >= 0) {
+        alwaysVisible[o] = true;
+      }
+
+      float area = bvh::v2::length(bvh::v2::cross(p1 - p0, p2 - p0)) * 0.5f;
+      if(area <= 0.0f)continue;
+
+      sceneTris.push_back({TriF(p0, p1, p2), o, isOccluder(model, tri)});
+      areaSum.push_back((areaSum.empty() ? 0.0f : areaSum.back()) + area);
+      objTris.push_back(&tri);
+    }
+    sceneAABB.extend(objAABBs[o]);
+
+    if(objTris.empty()) {
+      alwaysVisible[o] = true;
+      continue;
+    }
+
+    // points spread over the surface (by area), fixed seed to get the same output each time
+    std::mt19937 rng{o};
+    std::uniform_real_distribution<float> dist{0.0f, 1.0f};
+    for(uint32_t s=0; s<OBJECT_SAMPLES; ++s) {
+      float pick = dist(rng) * areaSum.back();
+      auto idx = std::lower_bound(areaSum.begin(), areaSum.end(), pick) - areaSum.begin();
+      const auto *tri = objTris[std::min<size_t>(idx, objTris.size()-1)];
+
+      float u = dist(rng), v = dist(rng);
+      if(u + v > 1.0f) { u = 1.0f - u; v = 1.0f - v; }
+      Vec3F p0 = toVec(tri->vert[0]);
+      objSamples[o].push_back(p0 + (toVec(tri->vert[1]) - p0) * u + (toVec(tri->vert[2]) - p0) * v);
+    }
+  }
+
+  if(models.empty() || sceneTris.empty())return res;
+
+  uint32_t cellCount = 1;
+  for(int i=0; i<3; ++i) {
+    res.gridMin[i] = (int16_t)std::floor(sceneAABB.min[i]);
+    float extend = sceneAABB.max[i] - res.gridMin[i];
+    res.gridSize[i] = (uint16_t)std::clamp((int)std::ceil(extend / cellSize), 1, (int)MAX_CELLS);
+    cellCount *= res.gridSize[i];
+    if(cellCount > MAX_CELLS) {
+      throw std::runtime_error("Too many PVS cells, increase the cell size ('--pvs=size')");
+    }
+  }
+
+  // BVH over all triangles, sorted into leaf order for faster access during traversal
+  std::vector<BBoxF> triAABBs{};
+  std::vector<Vec3F> triCenters{};
+  for(const auto &tri : sceneTris) {
+    triAABBs.push_back(tri.tri.get_bbox());
+    triCenters.push_back(tri.tri.get_center());
+  }
+
+  bvh::v2::ThreadPool threadPool;
+  typename bvh::v2::DefaultBuilder<NodeF>::Config bvhConfig;
+  bvhConfig.quality = bvh::v2::DefaultBuilder<NodeF>::Quality::High;
+  auto bvh = bvh::v2::DefaultBuilder<NodeF>::build(threadPool, triAABBs, triCenters, bvhConfig);
+
+  std::vector<SceneTri> leafTris{};
+  leafTris.reserve(sceneTris.size());
+  for(auto primId : bvh.prim_ids)leafTris.push_back(sceneTris[primId]);
+
+  std::vector<std::vector<uint8_t>> cellBits(cellCount);
+
+  Parallel::forEach(cellCount, jobs, [&](size_t cellIdx) {
+    auto &bits = cellBits[cellIdx];
+    bits.resize(res.setSize, 0);
+
+    uint32_t cellPos[3] = {
+      (uint32_t)(cellIdx % res.gridSize[0]),
+      (uint32_t)((cellIdx / res.gridSize[0]) % res.gridSize[1]),
+      (uint32_t)(cellIdx / (res.gridSize[0] * res.gridSize[1])),
+    };
+    Vec3F cellMin{}, cellMax{};
+    for(int i=0; i<3; ++i) {
+      cellMin[i] = res.gridMin[i] + cellPos[i] * cellSize;
+      cellMax[i] = cellMin[i] + cellSize;
+    }
+    BBoxF cellAABB{cellMin, cellMax};
+
+    // one random point in each octant of the cell
+    std::mt19937 rng{(uint32_t)cellIdx};
+    std::uniform_real_distribution<float> dist{0.0f, 0.5f};
+    Vec3F origins[CELL_SAMPLES];
+    for(uint32_t s=0; s<CELL_SAMPLES; ++s) {
+      for(int i=0; i<3; ++i) {
+        float offset = ((s >> i) & 1) ? 0.5f : 0.0f;
+        origins[s][i] = cellMin[i] + (offset + dist(rng)) * cellSize;
+      }
+    }
+
+    bvh::v2::SmallStack<BvhF::Index, 64> stack;
+    for(uint32_t o=0; o<models.size(); ++o) {
+      bool visible = alwaysVisible[o] || boxOverlap(cellAABB, objAABBs[o]);
+
+      for(uint32_t r=0; r<RAYS_PER_OBJECT && !visible; ++r) {
+        const Vec3F &origin = origins[r % CELL_SAMPLES];
+        // shifted after each round through all targets, so no origin/target pair repeats
+        const Vec3F &target = objSamples[o][(cellIdx + r + r / OBJECT_SAMPLES) % OBJECT_SAMPLES];
+
+        // direction is not normalized, a distance of 1 is the target point
+        RayF ray{origin, target - origin, 0.0f, 1.0f + 1e-4f};
+        int64_t hitObj = -1;
+        stack.size = 0;
+        bvh.intersect<false, true>(ray, bvh.get_root().index, stack, [&](size_t begin, size_t end) {
+          bool hit = false;
+          for(size_t i=begin; i<end; ++i) {
+            const auto &tri = leafTris[i];
+            // non-occluders are only relevant if they belong to the object itself
+            if(!tri.isOccluder && tri.objectIdx != o)continue;
+            if(tri.tri.intersect(ray)) {
+              hitObj = tri.objectIdx;
+              hit = true;
+            }
+          }
+          return hit;
+        });
+
+        // no hit at all can only happen due to precision issues at the target point
+        visible = hitObj < 0 || hitObj == o;
+      }
+
+      if(visible)bits[o / 8] |= 1 << (o % 8);
+    }
+  });
+
+  // neighbouring cells often see the same objects, store each set only once
+  std::map<std::vector<uint8_t>, uint16_t> setIndices{};
+  for(auto &bits : cellBits) {
+    auto it = setIndices.find(bits);
+    if(it == setIndices.end()) {
+      it = setIndices.emplace(bits, (uint16_t)res.sets.size()).first;
+      res.sets.push_back(bits);
+    }
+    res.cellSets.push_back(it->second);
+  }
+  return res;
+}
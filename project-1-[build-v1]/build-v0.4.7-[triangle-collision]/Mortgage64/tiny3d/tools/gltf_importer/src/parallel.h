@@ -0,0 +1,58 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "lib/bvh/v2/thread_pool.h"
+
+namespace Parallel
+{
+  /**
+   * Returns the amount of worker threads to use for a given '--jobs' value.
+   * A value of 0 means: use all hardware threads.
+   */
+  inline uint32_t getJobCount(uint32_t jobs) {
+    if(jobs == 0)jobs = std::thread::hardware_concurrency();
+    return jobs == 0 ? 1 : jobs;
+  }
+
+  /**
+   * Calls 'fn(i)' for each index in [0, count) using up to 'jobs' threads.
+   * Each index must only write to its own output slot, the order of execution is undefined.
+   * With a single job (or a single element) everything runs on the calling thread.
+   * Exceptions thrown inside a job are re-thrown here after all jobs are done.
+   */
+  inline void forEach(size_t count, uint32_t jobs, const std::function<void(size_t)> &fn)
+  {
+    jobs = getJobCount(jobs);
+    if(jobs <= 1 || count <= 1) {
+      for(size_t i=0; i<count; ++i)fn(i);
+      return;
+    }
+
+    std::exception_ptr error{};
+    std::mutex errorMutex{};
+
+    bvh::v2::ThreadPool threadPool{std::min<size_t>(jobs, count)};
+    for(size_t i=0; i<count; ++i) {
+      threadPool.push([&, i](size_t) {
+        try {
+          fn(i);
+        } catch(...) {
+          std::lock_guard lock{errorMutex};
+          if(!error)error = std::current_exception();
+        }
+      });
+    }
+    threadPool.wait();
+
+    if(error)std::rethrow_exception(error);
+  }
+}
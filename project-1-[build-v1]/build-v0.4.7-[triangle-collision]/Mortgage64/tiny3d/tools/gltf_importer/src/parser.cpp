@@ -304,6 +304,54 @@ T3DMData parseGLTF(const char *gltfPath, float modelScale)
           modelScale, texSizeX, texSizeY, vertices[k], verticesT3D[k],
           mat, matrixStack, model.material.uvFilterAdjust
         );
+        verticesT3D[k].sourceIndex = k;
+      }
+
+      // morph-targets, deltas are taken after the full conversion so they match the final positions exactly
+      for(cgltf_size t = 0; t < prim->targets_count; t++)
+      {
+        auto &target = model.morphTargets.emplace_back();
+        target.deltas.resize(vertices.size() * 3, 0);
+        if(t < mesh->target_names_count && mesh->target_names[t]) {
+          target.name = mesh->target_names[t];
+        } else {
+          target.name = "target" + std::to_string(t);
+        }
+
+        for(cgltf_size a = 0; a < prim->targets[t].attributes_count; a++)
+        {
+          auto attr = &prim->targets[t].attributes[a];
+          if(attr->type != cgltf_attribute_type_position)continue;
+
+          Mat4 mat = parseNodeMatrix(node);
+          for(size_t k = 0; k < vertices.size() && k < attr->data->count; k++)
+          {
+            float delta[3];
+            cgltf_accessor_read_float(attr->data, k, delta, 3); // handles sparse accessors too
+
+            VertexNorm morphed = vertices[k];
+            morphed.pos = morphed.pos + Vec3{delta[0], delta[1], delta[2]};
+            VertexT3D morphedT3D{};
+            convertVertex(
+              modelScale, texSizeX, texSizeY, morphed, morphedT3D,
+              mat, matrixStack, model.material.uvFilterAdjust
+            );
+            for(int c = 0; c < 3; c++) {
+              int32_t d = morphedT3D.pos[c] - verticesT3D[k].pos[c];
+              if(d < INT16_MIN || d > INT16_MAX)throw std::runtime_error("Morph-target delta out of range");
+              target.deltas[k*3 + c] = (int16_t)d;
+            }
+          }
+        }
+      }
+
+      // vertices may only be merged if they also move the same way
+      for(const auto &target : model.morphTargets) {
+        for(size_t k = 0; k < verticesT3D.size(); k++) {
+          for(int c = 0; c < 3; c++) {
+            verticesT3D[k].hash = (verticesT3D[k].hash ^ (uint16_t)target.deltas[k*3 + c]) * 0x100000001b3ULL;
+          }
+        }
       }
 
       // optimizations
@@ -324,6 +372,7 @@ T3DMData parseGLTF(const char *gltfPath, float modelScale)
       if(config.verbose) {
         printf("[%s] Vertices input: %d\n", mesh->name, vertexCount);
         printf("[%s] Indices input: %d\n", mesh->name, indices.size());
+        if(!model.morphTargets.empty())printf("[%s] Morph-targets: %zu\n", mesh->name, model.morphTargets.size());
       }
     }
   }
@@ -0,0 +1,45 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+/**
+ * String table of a T3DM file, a list of null-terminated strings.
+ * Strings are de-duplicated, including ones that are a suffix of an already inserted string.
+ * Lookups go through a hash-map of all suffixes instead of searching the whole table.
+ */
+class StringTable
+{
+  private:
+    std::string data{};
+    std::unordered_map<std::string, uint32_t> offsets{};
+
+  public:
+    explicit StringTable(const std::string &header = "") : data{header} {}
+
+    /**
+     * Returns the offset of a string in the table, adding it if not already present.
+     */
+    uint32_t insert(const std::string &str) {
+      auto it = offsets.find(str);
+      if(it != offsets.end())return it->second;
+
+      auto strPos = (uint32_t)data.size();
+      data += str;
+      data.push_back('\0');
+
+      // the first occurrence wins, so existing offsets never change
+      for(size_t i=0; i<=str.size(); ++i) {
+        offsets.try_emplace(str.substr(i), strPos + i);
+      }
+      return strPos;
+    }
+
+    const std::string& getData() const {
+      return data;
+    }
+};
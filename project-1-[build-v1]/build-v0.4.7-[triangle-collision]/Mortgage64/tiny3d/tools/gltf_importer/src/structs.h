@@ -4,6 +4,7 @@
 */
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <map>
 #include <unordered_map>
@@ -69,18 +70,22 @@ struct VertexT3D {
   uint64_t hash{};
   int32_t boneIndex{};
   uint32_t originalIndex{};
+  uint32_t sourceIndex{}; // index in the primitive it came from, used to look up morph-target deltas
 
   bool operator==(const VertexT3D& v) const {
     return hash == v.hash;
   }
 
-  constexpr static uint32_t byteSize() {
-    return sizeof(VertexT3D) - sizeof(hash) - sizeof(boneIndex) - sizeof(originalIndex);
-  }
+  constexpr static uint32_t byteSize();
 
   //bool operator<=>(const VertexT3D&) const = default;
 };
 
+// everything before the extra attributes, the struct itself may contain padding after them
+constexpr uint32_t VertexT3D::byteSize() {
+  return offsetof(VertexT3D, hash);
+}
+
 static_assert(VertexT3D::byteSize() == 0x10, "VertexT3D has wrong size");
 
 struct TriangleT3D {
@@ -88,6 +93,23 @@ struct TriangleT3D {
   //bool operator<=>(const TriangleT3D&) const = default;
 };
 
+// Triangle used for the collision-mesh, positions are the same as the ones in the vertex buffer
+struct CollisionTri {
+  int16_t pos[3][3]{};
+  uint16_t materialIdx{};
+};
+
+// Potentially-visible-set per cell of a regular grid over the scene, see 'createPVS'
+struct PVSData {
+  int16_t gridMin[3]{};
+  uint16_t gridSize[3]{}; // cells per axis
+  float cellSize{}; // in model space
+  uint16_t objectCount{};
+  uint16_t setSize{}; // bytes per bitset
+  std::vector<uint16_t> cellSets{}; // index into 'sets' per cell (X, then Y, then Z)
+  std::vector<std::vector<uint8_t>> sets{}; // de-duplicated, bit 'n' is object 'n'
+};
+
 struct TileParam {
   float low{};
   float high{};
@@ -156,10 +178,23 @@ struct MeshChunk {
   std::string name{};
 };
 
+// Position offsets of a glTF morph-target, already converted into the same space as 'VertexT3D::pos'
+struct MorphTarget {
+  std::string name{};
+  std::vector<int16_t> deltas{}; // 3 per vertex, indexed by 'VertexT3D::sourceIndex'
+};
+
 struct Model {
   std::vector<TriangleT3D> triangles{};
   std::string name{};
   Material material{};
+  std::vector<MorphTarget> morphTargets{};
+};
+
+// Simplified version of a model
+struct ModelLOD {
+  Model model{};
+  float error{}; // max. deviation from the original, in model-space units
 };
 
 struct ModelChunked {
@@ -251,12 +286,21 @@ struct Config {
   uint32_t animSampleRate{30};
   bool ignoreMaterials{false};
   bool createBVH{false};
+  bool createCollision{false};
+  std::string collisionTag{}; // only objects with this in the object/material name, empty for all
+  uint32_t lodLevels{0}; // extra levels-of-detail per object, 0 if disabled
+  float lodRatio{0.5f}; // triangle ratio of each level relative to the previous one
+  float tileSize{0.0f}; // size of a cell when splitting a scene into multiple files (glTF units), 0 if disabled
+  float pvsCellSize{0.0f}; // size of a cell for the potentially-visible-set (glTF units), 0 if disabled
   bool verbose{false};
+  bool reportCost{false};
+  uint32_t jobs{0}; // worker threads, 0 = hardware threads
   std::string assetPath{};
   std::string assetPathFull{};
+  std::string cachePath{}; // conversion cache directory, empty if disabled
 };
 extern Config config;
 
 constexpr int MAX_VERTEX_COUNT = 70;
 constexpr int CACHE_VERTEX_SIZE = 36;
-constexpr u8 T3DM_VERSION = 0x03;
\ No newline at end of file
+constexpr u8 T3DM_VERSION = 0x04;
\ No newline at end of file
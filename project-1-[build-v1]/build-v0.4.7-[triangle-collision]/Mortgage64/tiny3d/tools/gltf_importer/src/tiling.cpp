@@ -0,0 +1,60 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#include "tiling.h"
+
+#include <cmath>
+#include <map>
+#include <stdexcept>
+
+std::vector<Tiling::Cell> Tiling::split(const T3DMData &t3dm, float cellSize)
+{
+  if(!t3dm.skeletons.empty() || !t3dm.animations.empty()) {
+    throw std::runtime_error("Tiling is only supported for static scenes (no skeletons or animations)");
+  }
+
+  // key is (z, x), so that the cells end up sorted row by row
+  std::map<std::pair<int32_t, int32_t>, Cell> cells{};
+
+  for(const auto &model : t3dm.models) {
+    // the models of a cell are created on demand, this maps the cell to the index of this model in it
+    std::map<std::pair<int32_t, int32_t>, uint32_t> modelIdx{};
+
+    for(const auto &tri : model.triangles) {
+      float center[2]{};
+      for(const auto &v : tri.vert) {
+        center[0] += v.pos[0];
+        center[1] += v.pos[2];
+      }
+      std::pair<int32_t, int32_t> key{
+        (int32_t)floorf(center[1] / 3.0f / cellSize),
+        (int32_t)floorf(center[0] / 3.0f / cellSize)
+      };
+
+      auto &cell = cells[key];
+      auto it = modelIdx.find(key);
+      if(it == modelIdx.end()) {
+        if(key.first < INT16_MIN || key.first > INT16_MAX || key.second < INT16_MIN || key.second > INT16_MAX) {
+          throw std::runtime_error("Tile size too small for the scene");
+        }
+        cell.gridPos[0] = (int16_t)key.second;
+        cell.gridPos[1] = (int16_t)key.first;
+
+        it = modelIdx.emplace(key, cell.data.models.size()).first;
+        auto &cellModel = cell.data.models.emplace_back();
+        cellModel.name = model.name;
+        cellModel.material = model.material;
+        cellModel.morphTargets = model.morphTargets;
+      }
+      cell.data.models[it->second].triangles.push_back(tri);
+    }
+  }
+
+  std::vector<Cell> res{};
+  res.reserve(cells.size());
+  for(auto &[key, cell] : cells) {
+    res.push_back(std::move(cell));
+  }
+  return res;
+}
@@ -0,0 +1,26 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+#include <vector>
+
+#include "structs.h"
+
+namespace Tiling
+{
+  struct Cell {
+    int16_t gridPos[2]{}; // X/Z index in the grid
+    T3DMData data{}; // models of this cell, same names/materials as the source models
+  };
+
+  /**
+   * Splits a static scene into a uniform grid of cells on the X/Z plane ('--tiles=size').
+   * Triangles are assigned to the cell containing their center, so models crossing
+   * a cell border are split into one model per cell (the cell bounds may overlap).
+   * Empty cells are not returned, the order is by Z and then X.
+   * @param cellSize size of a cell, in the same units as the vertex positions
+   */
+  std::vector<Cell> split(const T3DMData &t3dm, float cellSize);
+}
@@ -0,0 +1,29 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+#ifndef T3D_MATH_BENCH_LIBDRAGON_H
+#define T3D_MATH_BENCH_LIBDRAGON_H
+
+// Minimal stand-in for the parts of libdragon used by 't3dmath', to build it for the host.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef struct { float v[3]; } fm_vec3_t;
+typedef struct { float v[4]; } fm_vec4_t;
+typedef struct { float v[4]; } fm_quat_t;
+typedef struct { float m[4][4]; } fm_mat4_t;
+
+#define fm_sinf sinf
+#define fm_cosf cosf
+
+#define assertf(expr, ...) do { \
+  if(!(expr)) { fprintf(stderr, "Assertion failed: " __VA_ARGS__); fputc('\n', stderr); abort(); } \
+} while(0)
+
+#endif
@@ -0,0 +1,126 @@
+/**
+* @copyright 2024 - Max Bebök
+* @license MIT
+*/
+
+// Host benchmark and golden-test for 't3d_mat4fp_from_srt_hierarchy' in 't3dmath'.
+// Results are compared against the scalar path ('t3d_mat4_from_srt' + 't3d_mat4_mul' + 't3d_mat4_to_fixed'),
+// which is what 't3d_skeleton_update' used per bone before.
+// Usage: ./math_bench [--iterations=N]
+
+#include <t3d/t3dmath.h>
+#include <time.h>
+
+#define MAX_TRANSFORMS 256
+
+static uint32_t rngState = 0x12345678;
+
+static float rand_float(float min, float max) {
+  rngState = rngState * 1664525 + 1013904223;
+  return min + (max - min) * ((rngState >> 8) / (float)(1 << 24));
+}
+
+static void random_srt(T3DSRT *srt) {
+  for(int i=0; i<3; ++i) {
+    srt->scale.v[i] = rand_float(0.5f, 2.0f);
+    srt->position.v[i] = rand_float(-100.0f, 100.0f);
+  }
+  for(int i=0; i<4; ++i)srt->rotation.v[i] = rand_float(-1.0f, 1.0f);
+  t3d_quat_normalize(&srt->rotation);
+}
+
+// random hierarchy with some long chains, parents always come before their children
+static void random_hierarchy(uint16_t *parentIdx, uint32_t count) {
+  for(uint32_t i=0; i<count; ++i) {
+    if(i == 0)parentIdx[i] = 0xFFFF;
+    else if(rand_float(0.0f, 1.0f) < 0.7f)parentIdx[i] = i - 1;
+    else parentIdx[i] = (uint16_t)rand_float(0.0f, (float)i);
+  }
+}
+
+static void reference_hierarchy(T3DMat4FP *matsOutFP, T3DMat4 *matsOut, const T3DSRT *srt, const uint16_t *parentIdx, uint32_t count) {
+  for(uint32_t i=0; i<count; ++i) {
+    const T3DSRT *t = &srt[i];
+    if(parentIdx[i] != 0xFFFF) {
+      T3DMat4 tmp;
+      t3d_mat4_from_srt(&tmp, t->scale.v, t->rotation.v, t->position.v);
+      t3d_mat4_mul(&matsOut[i], &matsOut[parentIdx[i]], &tmp);
+    } else {
+      t3d_mat4_from_srt(&matsOut[i], t->scale.v, t->rotation.v, t->position.v);
+    }
+    t3d_mat4_to_fixed(&matsOutFP[i], &matsOut[i]);
+  }
+}
+
+// returns the max. difference in fixed-point LSBs
+static uint32_t compare_fixed(const T3DMat4FP *a, const T3DMat4FP *b, uint32_t count) {
+  uint32_t maxDiff = 0;
+  for(uint32_t m=0; m<count; ++m) {
+    for(uint32_t y=0; y<4; ++y) {
+      for(uint32_t x=0; x<4; ++x) {
+        int32_t valA = (int32_t)((uint32_t)(uint16_t)a[m].m[y].i[x] << 16 | a[m].m[y].f[x]);
+        int32_t valB = (int32_t)((uint32_t)(uint16_t)b[m].m[y].i[x] << 16 | b[m].m[y].f[x]);
+        uint32_t diff = valA > valB ? (uint32_t)valA - (uint32_t)valB : (uint32_t)valB - (uint32_t)valA;
+        if(diff > maxDiff)maxDiff = diff;
+      }
+    }
+  }
+  return maxDiff;
+}
+
+static double time_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char* argv[])
+{
+  uint32_t iterations = 20000;
+  for(int i=1; i<argc; ++i) {
+    if(strncmp(argv[i], "--iterations=", 13) == 0)iterations = strtoul(argv[i] + 13, NULL, 10);
+  }
+
+  static T3DSRT srt[MAX_TRANSFORMS];
+  static uint16_t parentIdx[MAX_TRANSFORMS];
+  static T3DMat4 matsRef[MAX_TRANSFORMS], mats[MAX_TRANSFORMS];
+  static T3DMat4FP matsRefFP[MAX_TRANSFORMS], matsFP[MAX_TRANSFORMS];
+
+  const uint32_t counts[] = {1, 16, 64, MAX_TRANSFORMS};
+  bool failed = false;
+
+  printf("%-10s %6s %8s %12s %12s %8s\n", "test", "count", "max-lsb", "ref ns/mat", "new ns/mat", "speedup");
+  for(uint32_t c=0; c<sizeof(counts)/sizeof(counts[0]); ++c) {
+    uint32_t count = counts[c];
+    for(uint32_t i=0; i<count; ++i)random_srt(&srt[i]);
+    random_hierarchy(parentIdx, count);
+
+    // golden-test, results must match the scalar path exactly
+    reference_hierarchy(matsRefFP, matsRef, srt, parentIdx, count);
+    t3d_mat4fp_from_srt_hierarchy(matsFP, mats, srt, parentIdx, count);
+    uint32_t diffHierarchy = compare_fixed(matsRefFP, matsFP, count);
+
+    // benchmark, volatile sink keeps the compiler from dropping the loops
+    volatile int16_t sink = 0;
+    double t0 = time_now();
+    for(uint32_t it=0; it<iterations; ++it) {
+      reference_hierarchy(matsRefFP, matsRef, srt, parentIdx, count);
+      sink += matsRefFP[count-1].m[3].i[0];
+    }
+    double t1 = time_now();
+    for(uint32_t it=0; it<iterations; ++it) {
+      t3d_mat4fp_from_srt_hierarchy(matsFP, mats, srt, parentIdx, count);
+      sink += matsFP[count-1].m[3].i[0];
+    }
+    double t2 = time_now();
+
+    double scale = 1e9 / ((double)iterations * count);
+    printf("%-10s %6d %8d %12.2f %12.2f %7.2fx\n", "hierarchy", count, diffHierarchy,
+      (t1 - t0) * scale, (t2 - t1) * scale, (t1 - t0) / (t2 - t1));
+
+    if(diffHierarchy)failed = true;
+  }
+
+  printf(failed ? "FAILED: results differ from the scalar path\n" : "OK\n");
+  return failed ? 1 : 0;
+}